@@ -10,7 +10,7 @@ public class DeformMesh : ModuleRules
 	
 		PublicDependencyModuleNames.AddRange(new string[] { "Core", "CoreUObject", "Engine", "InputCore" });
 
-		PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "RHI", "Projects" });
+		PrivateDependencyModuleNames.AddRange(new string[] { "RenderCore", "RHI", "Projects", "PhysicsCore" });
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
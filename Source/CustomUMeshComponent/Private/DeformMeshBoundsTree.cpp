@@ -0,0 +1,116 @@
+#include "DeformMeshBoundsTree.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+void FDeformMeshBoundsTree::Reset(TArrayView<const FBox> LeafBoxes)
+{
+	NumLeaves = LeafBoxes.Num();
+	Nodes.Reset(2 * NumLeaves);
+	Nodes.SetNum(2 * NumLeaves);
+
+	//Leaves first, then every inner node from the bottom up
+	for (int32 LeafIndex = 0; LeafIndex < NumLeaves; LeafIndex++)
+	{
+		Nodes[NumLeaves + LeafIndex] = LeafBoxes[LeafIndex];
+	}
+	for (int32 NodeIndex = NumLeaves - 1; NodeIndex > 0; NodeIndex--)
+	{
+		Nodes[NodeIndex] = Nodes[2 * NodeIndex] + Nodes[2 * NodeIndex + 1];
+	}
+}
+
+void FDeformMeshBoundsTree::Update(int32 LeafIndex, const FBox& Box)
+{
+	check(LeafIndex >= 0 && LeafIndex < NumLeaves);
+
+	int32 NodeIndex = NumLeaves + LeafIndex;
+	Nodes[NodeIndex] = Box;
+
+	//Walk up to the root, recomputing each ancestor from its two children
+	for (NodeIndex /= 2; NodeIndex > 0; NodeIndex /= 2)
+	{
+		Nodes[NodeIndex] = Nodes[2 * NodeIndex] + Nodes[2 * NodeIndex + 1];
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshBoundsTree, Log, All);
+
+/*
+ * Moves the sections of trees of a few sizes, including sizes that aren't powers of two, and checks the bounds against the union of every box after each update
+ * The sections moved away must give their room back once they move back, and a cleared section must leave the bounds
+ * Usage: DeformMesh.TestBoundsTree
+*/
+static void TestBoundsTree()
+{
+	FDeformMeshTestChecks Checks(LogDeformMeshBoundsTree, TEXT("Bounds tree"));
+	auto Union = [](TArrayView<const FBox> Boxes)
+	{
+		FBox Bounds(ForceInit);
+		for (const FBox& Box : Boxes)
+		{
+			Bounds += Box;
+		}
+		return Bounds;
+	};
+	auto SameBox = [](const FBox& A, const FBox& B)
+	{
+		return A.IsValid == B.IsValid && (!A.IsValid || (A.Min == B.Min && A.Max == B.Max));
+	};
+
+	FRandomStream Random(0xDEF6);
+	for (const int32 NumLeaves : { 1, 2, 3, 7, 64, 100, 1000 })
+	{
+		TArray<FBox> Boxes;
+		for (int32 LeafIndex = 0; LeafIndex < NumLeaves; LeafIndex++)
+		{
+			const FVector Center = Random.GetUnitVector() * Random.FRandRange(0.0f, 1000.0f);
+			Boxes.Add(FBox::BuildAABB(Center, FVector(Random.FRandRange(1.0f, 100.0f))));
+		}
+
+		FDeformMeshBoundsTree Tree;
+		Tree.Reset(Boxes);
+		const FBox StartBounds = Union(Boxes);
+		Checks.Check(Tree.Num() == NumLeaves && SameBox(Tree.GetBounds(), StartBounds), TEXT("%d sections, the bounds after a reset aren't the union of the boxes"), NumLeaves);
+
+		//Every section goes far away and comes back, one at a time, the bounds must follow both ways
+		const TArray<FBox> StartBoxes = Boxes;
+		for (int32 LeafIndex = 0; LeafIndex < NumLeaves; LeafIndex++)
+		{
+			Boxes[LeafIndex] = StartBoxes[LeafIndex].ShiftBy(Random.GetUnitVector() * 100000.0);
+			Tree.Update(LeafIndex, Boxes[LeafIndex]);
+			Checks.Check(SameBox(Tree.GetBounds(), Union(Boxes)), TEXT("%d sections, the bounds didn't grow with a section moving away"), NumLeaves);
+
+			Boxes[LeafIndex] = StartBoxes[LeafIndex];
+			Tree.Update(LeafIndex, Boxes[LeafIndex]);
+			Checks.Check(SameBox(Tree.GetBounds(), StartBounds), TEXT("%d sections, the bounds didn't shrink back with the section moving back"), NumLeaves);
+		}
+
+		//Random moves and clears, then everything cleared
+		for (int32 UpdateIndex = 0; UpdateIndex < 4 * NumLeaves; UpdateIndex++)
+		{
+			const int32 LeafIndex = Random.RandHelper(NumLeaves);
+			Boxes[LeafIndex] = Random.FRand() < 0.2f ? FBox(ForceInit) : StartBoxes[LeafIndex].ShiftBy(Random.GetUnitVector() * Random.FRandRange(0.0f, 5000.0f));
+			Tree.Update(LeafIndex, Boxes[LeafIndex]);
+			Checks.Check(SameBox(Tree.GetBounds(), Union(Boxes)), TEXT("%d sections, the bounds aren't the union of the boxes after a random update"), NumLeaves);
+		}
+		for (int32 LeafIndex = 0; LeafIndex < NumLeaves; LeafIndex++)
+		{
+			Tree.Update(LeafIndex, FBox(ForceInit));
+		}
+		Checks.Check(!Tree.GetBounds().IsValid, TEXT("%d sections, the bounds of cleared sections aren't empty"), NumLeaves);
+	}
+
+	FDeformMeshBoundsTree EmptyTree;
+	EmptyTree.Reset(TArrayView<const FBox>());
+	Checks.Check(EmptyTree.Num() == 0 && !EmptyTree.GetBounds().IsValid, TEXT("an empty tree has bounds"));
+
+	Checks.Report();
+}
+
+static FAutoConsoleCommand TestBoundsTreeCommand(
+	TEXT("DeformMesh.TestBoundsTree"),
+	TEXT("Checks that the bounds of the sections follow their boxes, and shrink when sections move back. Usage: DeformMesh.TestBoundsTree"),
+	FConsoleCommandDelegate::CreateStatic(&TestBoundsTree));
+#endif
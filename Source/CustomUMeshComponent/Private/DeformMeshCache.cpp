@@ -0,0 +1,161 @@
+#include "DeformMeshCache.h"
+#include "DeformMeshResourceCache.h"
+#include "StaticMeshResources.h"
+#include "RenderGraphUtils.h"
+#include "RHICommandList.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Cache Compute Shader Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+bool FDeformMeshCacheCS::ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+}
+
+void FDeformMeshCacheCS::ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("THREADGROUP_SIZE"), ThreadGroupSize);
+}
+
+IMPLEMENT_GLOBAL_SHADER(FDeformMeshCacheCS, "/CustomShaders/DeformMeshCache.usf", "MainCS", SF_Compute);
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Section Cache Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+bool FDeformMeshSectionCache::IsSupported(const FStaticMeshVertexBuffers& VertexBuffers)
+{
+	return VertexBuffers.PositionVertexBuffer.GetSRV() != nullptr
+		&& VertexBuffers.StaticMeshVertexBuffer.GetTangentsSRV() != nullptr
+		&& VertexBuffers.PositionVertexBuffer.GetNumVertices() > 0;
+}
+
+FDeformMeshSectionCache::FDeformMeshSectionCache(int32 InLODIndex, const FStaticMeshVertexBuffers& VertexBuffers, ERHIFeatureLevel::Type InFeatureLevel)
+	: LODIndex(InLODIndex)
+	, NumVertices(VertexBuffers.PositionVertexBuffer.GetNumVertices())
+	, FeatureLevel(InFeatureLevel)
+	, SourcePositionsSRV(VertexBuffers.PositionVertexBuffer.GetSRV())
+	, SourceTangentsSRV(VertexBuffers.StaticMeshVertexBuffer.GetTangentsSRV())
+	, bPreviousPositionsStale(false)
+#if RHI_RAYTRACING
+	, bRayTracingGeometryStale(false)
+#endif
+{
+	check(IsInRenderingThread());
+	Positions.Initialize(TEXT("DeformMesh_CachePositions"), sizeof(float), NumVertices * 3, PF_R32_FLOAT, ERHIAccess::SRVMask, BUF_Static);
+	PreviousPositions.Initialize(TEXT("DeformMesh_CachePreviousPositions"), sizeof(float), NumVertices * 3, PF_R32_FLOAT, ERHIAccess::SRVMask, BUF_Static);
+	//The tangents are normalized, 16 bits per component are as precise as the high precision tangents of static meshes
+	Tangents.Initialize(TEXT("DeformMesh_CacheTangents"), 4 * sizeof(int16), NumVertices * 2, PF_R16G16B16A16_SNORM, ERHIAccess::SRVMask, BUF_Static);
+}
+
+FDeformMeshSectionCache::~FDeformMeshSectionCache()
+{
+	check(IsInRenderingThread());
+#if RHI_RAYTRACING
+	RayTracingGeometry.ReleaseResource();
+#endif
+	Positions.Release();
+	PreviousPositions.Release();
+	Tangents.Release();
+}
+
+void FDeformMeshSectionCache::Dispatch_RenderThread(FRHICommandListImmediate& RHICmdList, uint32 TransformIndex, EDeformMeshTransformFormat TransformFormat,
+	FRHIShaderResourceView* TransformsSRV, FRHIShaderResourceView* LatticeSlotsSRV, FRHIShaderResourceView* LatticesSRV)
+{
+	check(IsInRenderingThread());
+
+	FDeformMeshCacheCS::FParameters Parameters;
+	Parameters.TransformIndex = TransformIndex;
+	Parameters.NumVertices = NumVertices;
+	Parameters.DMTransformFormat = (uint32)TransformFormat;
+	Parameters.DMTransforms = TransformsSRV;
+	Parameters.DMLatticeSlots = LatticeSlotsSRV;
+	Parameters.DMLattices = LatticesSRV;
+	Parameters.SourcePositions = SourcePositionsSRV;
+	Parameters.SourceTangents = SourceTangentsSRV;
+	Parameters.OutPositions = Positions.UAV;
+	Parameters.OutTangents = Tangents.UAV;
+
+	TShaderMapRef<FDeformMeshCacheCS> ComputeShader(GetGlobalShaderMap(FeatureLevel));
+
+	RHICmdList.Transition({
+		FRHITransitionInfo(Positions.UAV, ERHIAccess::SRVMask, ERHIAccess::UAVCompute),
+		FRHITransitionInfo(Tangents.UAV, ERHIAccess::SRVMask, ERHIAccess::UAVCompute) });
+	FComputeShaderUtils::Dispatch(RHICmdList, ComputeShader, Parameters, FComputeShaderUtils::GetGroupCount(NumVertices, FDeformMeshCacheCS::ThreadGroupSize));
+	RHICmdList.Transition({
+		FRHITransitionInfo(Positions.UAV, ERHIAccess::UAVCompute, ERHIAccess::SRVMask),
+		FRHITransitionInfo(Tangents.UAV, ERHIAccess::UAVCompute, ERHIAccess::SRVMask) });
+
+	bPreviousPositionsStale = true;
+#if RHI_RAYTRACING
+	bRayTracingGeometryStale = RayTracingGeometry.RayTracingGeometryRHI.IsValid();
+#endif
+}
+
+void FDeformMeshSectionCache::UpdatePreviousPositions_RenderThread(FRHICommandListImmediate& RHICmdList)
+{
+	check(IsInRenderingThread());
+	if (!bPreviousPositionsStale)
+	{
+		return;
+	}
+
+	RHICmdList.Transition({
+		FRHITransitionInfo(Positions.Buffer, ERHIAccess::SRVMask, ERHIAccess::CopySrc),
+		FRHITransitionInfo(PreviousPositions.Buffer, ERHIAccess::SRVMask, ERHIAccess::CopyDest) });
+	RHICmdList.CopyBufferRegion(PreviousPositions.Buffer, 0, Positions.Buffer, 0, Positions.NumBytes);
+	RHICmdList.Transition({
+		FRHITransitionInfo(Positions.Buffer, ERHIAccess::CopySrc, ERHIAccess::SRVMask),
+		FRHITransitionInfo(PreviousPositions.Buffer, ERHIAccess::CopyDest, ERHIAccess::SRVMask) });
+
+	bPreviousPositionsStale = false;
+}
+
+#if RHI_RAYTRACING
+void FDeformMeshSectionCache::InitRayTracingGeometry_RenderThread(const FDeformMeshLODResources& LODResources)
+{
+	check(IsInRenderingThread());
+
+	FRayTracingGeometryInitializer Initializer;
+	Initializer.DebugName = FName(TEXT("DeformMesh_CacheGeometry"));
+	Initializer.IndexBuffer = LODResources.IndexBuffer->IndexBufferRHI;
+	Initializer.GeometryType = RTGT_Triangles;
+	//Refitting keeps the topology of the first build, it's only as good as the deformation is small, which is the case for lattices
+	Initializer.bFastBuild = true;
+	Initializer.bAllowUpdate = true;
+	Initializer.TotalPrimitiveCount = 0;
+
+	//One segment per range, like the static mesh geometry, so the materials are bound the same way
+	for (const FDeformMeshLODSection& LODSection : LODResources.Sections)
+	{
+		FRayTracingGeometrySegment Segment;
+		Segment.VertexBuffer = Positions.Buffer;
+		Segment.VertexBufferElementType = VET_Float3;
+		Segment.VertexBufferStride = 3 * sizeof(float);
+		Segment.VertexBufferOffset = 0;
+		Segment.MaxVertices = NumVertices;
+		Segment.FirstPrimitive = LODSection.FirstIndex / 3;
+		Segment.NumPrimitives = LODSection.NumTriangles;
+		Initializer.Segments.Add(Segment);
+		Initializer.TotalPrimitiveCount += LODSection.NumTriangles;
+	}
+
+	RayTracingGeometry.SetInitializer(Initializer);
+	RayTracingGeometry.InitResource();
+	bRayTracingGeometryStale = false;
+}
+
+bool FDeformMeshSectionCache::AddRayTracingRefit(TArray<FRayTracingGeometryBuildParams, TInlineAllocator<16>>& OutBuildParams)
+{
+	if (!bRayTracingGeometryStale)
+	{
+		return false;
+	}
+
+	FRayTracingGeometryBuildParams& BuildParams = OutBuildParams.AddDefaulted_GetRef();
+	BuildParams.Geometry = RayTracingGeometry.RayTracingGeometryRHI;
+	BuildParams.BuildMode = EAccelerationStructureBuildMode::Update;
+	bRayTracingGeometryStale = false;
+	return true;
+}
+#endif
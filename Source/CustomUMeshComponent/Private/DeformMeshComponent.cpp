@@ -1,5 +1,14 @@
 #include "DeformMeshComponent.h"
 #include "DeformMeshSceneProxy.h"
+#include "DeformMeshTransformUtils.h"
+#include "Engine/World.h"
+#include "PhysicsEngine/BodySetup.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "Materials/MaterialInterface.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "UObject/UObjectIterator.h"
+#include "UObject/Package.h"
 
 ///////////////////////////////////////////////////////////////////////
 // The Deform Mesh Component Methods' Definitions
@@ -7,6 +16,14 @@
 /*
  * Most of ths method below are self explanatory, they make changes to the game thread state and propagate changes to the render thread using the scene proxy
 */
+UDeformMeshComponent::UDeformMeshComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	//The tick is enabled only while there are hot sections (see TrackSectionTransformUpdates)
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+}
+
 void UDeformMeshComponent::CreateMeshSection(int32 SectionIndex, UStaticMesh* Mesh, const FTransform& Transform)
 {
 	// Ensure sections array is long enough
@@ -20,52 +37,179 @@ void UDeformMeshComponent::CreateMeshSection(int32 SectionIndex, UStaticMesh* Me
 	NewSection.Reset();
 
 	// Fill in the mesh section with the needed data
-	// I'm assuming that the StaticMesh has only one section and I'm only using that
 	NewSection.StaticMesh = Mesh;
 	NewSection.DeformTransform = Transform.ToMatrixWithScale().GetTransposed();
 
-	//Update the local bound using the bounds of the static mesh that we're adding
-	//I'm not taking in consideration the deformation here, if the deformation cause the mesh to go outside its bounds
+	//The local box of the section is the box of the static mesh that we're adding, deformed by the section's transform
 	NewSection.StaticMesh->CalculateExtendedBounds();
-	NewSection.SectionLocalBox += NewSection.StaticMesh->GetBoundingBox();
+	NewSection.SectionLocalBox = NewSection.StaticMesh->GetBoundingBox().TransformBy(Transform);
 
-	//Add this sections' material to the list of the component's materials, with the same index as the section
-	SetMaterial(SectionIndex, NewSection.StaticMesh->GetMaterial(0));
+	//Add this sections' first material to the list of the component's materials, with the same index as the section
+	//The static mesh's other materials are used as they are (see GetSectionMaterial)
+	//We don't use SetMaterial since it would recreate the scene proxy, UpdateSectionRenderState decides if that's needed
+	if (OverrideMaterials.Num() <= SectionIndex)
+	{
+		OverrideMaterials.SetNum(SectionIndex + 1);
+	}
+	OverrideMaterials[SectionIndex] = NewSection.StaticMesh->GetMaterial(0);
+	MarkCachedMaterialParameterNameIndicesDirty();
 	
 
-	UpdateLocalBounds(); // Update overall bounds
-	MarkRenderStateDirty(); // New section requires recreating scene proxy
+	UpdateSectionsLocalBounds(MakeArrayView(&SectionIndex, 1)); // Update overall bounds
+	UpdateSectionRenderState(SectionIndex); // Send the new section to the scene proxy
+	RecreateSectionBody(SectionIndex); // The body setup comes from the new static mesh
 }
 
 /// <summary>
 /// Update the Transform Matrix that we use to deform the mesh
-/// The update of the state in the game thread is simple, but for the scene proxy update, we need to enqueue a render command
+/// The update of the state in the game thread is simple, the scene proxy gets the transform through the mailbox at the end of the frame
 /// </summary>
 /// <param name="SectionIndex"> The index for the section that we want to update its DeformTransform </param>
 /// <param name="Transform"> The new Transform Matrix </param>
 void UDeformMeshComponent::UpdateMeshSectionTransform(int32 SectionIndex, const FTransform& Transform)
 {
-	if (SectionIndex < DeformMeshSections.Num())
+	//Cleared sections have no mesh box, and nothing on the render thread to move
+	if (DeformMeshSections.IsValidIndex(SectionIndex) && DeformMeshSections[SectionIndex].StaticMesh != nullptr)
 	{
 		//Set game thread state
 		const FMatrix TransformMatrix = Transform.ToMatrixWithScale().GetTransposed();
 		DeformMeshSections[SectionIndex].DeformTransform = TransformMatrix;
 
-		DeformMeshSections[SectionIndex].SectionLocalBox += DeformMeshSections[SectionIndex].StaticMesh->GetBoundingBox().TransformBy(Transform);
+		//The box only depends on the current transform, so it shrinks back when the section moves back
+		DeformMeshSections[SectionIndex].SectionLocalBox = DeformMeshSections[SectionIndex].GetMeshBox().TransformBy(Transform);
 
 
 		if (SceneProxy)
 		{
-			// Enqueue command to modify render thread info
-			FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
-			ENQUEUE_RENDER_COMMAND(FDeformMeshTransformsUpdate)(
-				[DeformMeshSceneProxy, SectionIndex, TransformMatrix](FRHICommandListImmediate& RHICmdList)
-				{
-					DeformMeshSceneProxy->UpdateDeformTransform_RenderThread(SectionIndex, TransformMatrix);
-				});
+			// Write to the mailbox, the render thread gets it at the end of the frame
+			TransformMailbox->Write(SectionIndex, FMatrix44f(TransformMatrix));
+			MarkRenderDynamicDataDirty();
+		}
+		UpdateSectionsLocalBounds(MakeArrayView(&SectionIndex, 1)); // Update overall bounds, this also sends them to the render thread
+		UpdateSectionBodies(MakeArrayView(&SectionIndex, 1));
+		if (BatchSlots.Num() > 0)
+		{
+			UpdateBatchedSectionTransforms(MakeArrayView(&SectionIndex, 1)); // The batch tracks the hot sections
+		}
+		else
+		{
+			TrackSectionTransformUpdates(MakeArrayView(&SectionIndex, 1));
+		}
+	}
+}
+
+/// <summary>
+/// Update the Transform Matrices of many sections in one go
+/// The matrices and the section boxes are converted in parallel (see FDeformMeshTransformUtils), the bounds are updated once, and a single render command carries all the matrices to the scene proxy
+/// </summary>
+/// <param name="SectionIndices"> The indices of the sections that we want to update </param>
+/// <param name="Transforms"> The new Transform of each section, in the same order as SectionIndices </param>
+void UDeformMeshComponent::UpdateMeshSectionTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> Transforms)
+{
+	check(SectionIndices.Num() == Transforms.Num());
+
+	//Gather the valid updates, with the local box of each section's static mesh
+	TArray<int32> UpdatedIndices;
+	TArray<FTransform> UpdatedTransforms;
+	TArray<FBox> MeshBoxes;
+	UpdatedIndices.Reserve(SectionIndices.Num());
+	UpdatedTransforms.Reserve(SectionIndices.Num());
+	MeshBoxes.Reserve(SectionIndices.Num());
+
+	for (int32 UpdateIndex = 0; UpdateIndex < SectionIndices.Num(); UpdateIndex++)
+	{
+		const int32 SectionIndex = SectionIndices[UpdateIndex];
+		if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
+		{
+			continue;
+		}
+
+		UpdatedIndices.Add(SectionIndex);
+		UpdatedTransforms.Add(Transforms[UpdateIndex]);
+		MeshBoxes.Add(DeformMeshSections[SectionIndex].GetMeshBox());
+	}
+
+	if (UpdatedIndices.Num() == 0)
+	{
+		return;
+	}
+
+	//Convert the transforms in parallel, the matrices are written straight into the array that we'll move to the render thread
+	TArray<FMatrix44f> UpdatedMatrices;
+	TArray<FBox> DeformedBoxes;
+	UpdatedMatrices.SetNumUninitialized(UpdatedIndices.Num());
+	DeformedBoxes.SetNumUninitialized(UpdatedIndices.Num());
+	FDeformMeshTransformUtils::ConvertTransforms(UpdatedTransforms, MeshBoxes, UpdatedMatrices, DeformedBoxes);
+
+	ApplySectionTransforms(MoveTemp(UpdatedIndices), MoveTemp(UpdatedMatrices), DeformedBoxes);
+}
+
+void UDeformMeshComponent::ApplySectionTransforms(TArray<int32>&& UpdatedIndices, TArray<FMatrix44f>&& UpdatedMatrices, TArrayView<const FBox> DeformedBoxes)
+{
+	//Set game thread state
+	for (int32 UpdateIndex = 0; UpdateIndex < UpdatedIndices.Num(); UpdateIndex++)
+	{
+		FDeformMeshSection& Section = DeformMeshSections[UpdatedIndices[UpdateIndex]];
+		Section.DeformTransform = FMatrix(UpdatedMatrices[UpdateIndex]);
+		Section.SectionLocalBox = DeformedBoxes[UpdateIndex];
+	}
+
+	UpdateSectionsLocalBounds(UpdatedIndices); // Update overall bounds once, this also sends them to the render thread
+	UpdateSectionBodies(UpdatedIndices);
+	if (BatchSlots.Num() > 0)
+	{
+		UpdateBatchedSectionTransforms(UpdatedIndices); // The batches track the hot sections
+	}
+	else
+	{
+		TrackSectionTransformUpdates(UpdatedIndices);
+	}
+
+	if (SceneProxy)
+	{
+		// Write all the sections to the mailbox, the render thread gets them at the end of the frame, with the other updates of the frame
+		for (int32 UpdateIndex = 0; UpdateIndex < UpdatedIndices.Num(); UpdateIndex++)
+		{
+			TransformMailbox->Write(UpdatedIndices[UpdateIndex], UpdatedMatrices[UpdateIndex]);
 		}
-		UpdateLocalBounds();		 // Update overall bounds
-		MarkRenderTransformDirty();  // Need to send new bounds to render thread
+		MarkRenderDynamicDataDirty();
+	}
+}
+
+void UDeformMeshComponent::SetMeshSectionLattice(int32 SectionIndex, TArrayView<const FVector3f> ControlPointOffsets)
+{
+	check(ControlPointOffsets.Num() == 0 || ControlPointOffsets.Num() == FDeformMeshLattice::NumControlPoints);
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
+	{
+		return;
+	}
+
+	//Set game thread state, the lattice moves the vertices inside the convex hull of its control points, so the local box grows with it
+	FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	const bool bHadLattice = Section.LatticeOffsets.Num() > 0;
+	Section.LatticeOffsets = ControlPointOffsets;
+	const FBox MeshBox = Section.GetMeshBox();
+	Section.SectionLocalBox = MeshBox.TransformBy(Section.DeformTransform.GetTransposed());
+
+	if (SceneProxy)
+	{
+		// Enqueue command to modify render thread info
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshLatticeUpdate)(
+			[DeformMeshSceneProxy, SectionIndex, LatticeOffsets = Section.LatticeOffsets, MeshBox](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->SetSectionLattice_RenderThread(SectionIndex, LatticeOffsets, MeshBox);
+			});
+	}
+	UDeformMeshSubsystem* Subsystem = GetBatchSubsystem();
+	if (Subsystem != nullptr && BatchSlots.IsValidIndex(SectionIndex))
+	{
+		Subsystem->SetSectionLattice(BatchSlots[SectionIndex], Section.LatticeOffsets);
+	}
+	UpdateSectionsLocalBounds(MakeArrayView(&SectionIndex, 1)); // Update overall bounds, this also sends them to the render thread
+	if (bHadLattice != (Section.LatticeOffsets.Num() > 0))
+	{
+		RecreateSectionBody(SectionIndex); // The lattice sections have no body, they're traced with their deformed box
 	}
 }
 
@@ -74,34 +218,82 @@ void UDeformMeshComponent::ClearMeshSection(int32 SectionIndex)
 	if (SectionIndex < DeformMeshSections.Num())
 	{
 		DeformMeshSections[SectionIndex].Reset();
-		UpdateLocalBounds();
-		MarkRenderStateDirty();
+		UpdateSectionsLocalBounds(MakeArrayView(&SectionIndex, 1));
+		UpdateSectionRenderState(SectionIndex); // Remove the section from the scene proxy
+		RecreateSectionBody(SectionIndex); // Remove the section's body
 	}
 }
 
 /// <summary>
 /// This method is called after we finished updating all the section transforms that we want to update
-/// This will update the structured buffer with the new transforms
+/// The transforms are sent at the end of the frame anyway, this sends them right away
 /// </summary>
 void UDeformMeshComponent::FinishTransformsUpdate()
 {
-	if (SceneProxy)
+	SendTransformMailbox();
+}
+
+void UDeformMeshComponent::SendRenderDynamicData_Concurrent()
+{
+	Super::SendRenderDynamicData_Concurrent();
+	SendTransformMailbox();
+}
+
+uint32 UDeformMeshComponent::SendTransformMailbox()
+{
+	if (!SceneProxy)
+	{
+		return 0;
+	}
+
+	//A publish over a frame the render thread skipped can leave some of that frame's transforms behind, they're published now rather than next frame
+	//since nothing would mark the dynamic data dirty again if no other section moves, the second publish always leaves the mailbox clean
+	bool bPublished = false;
+	do
+	{
+		bPublished |= TransformMailbox->Publish();
+	} while (TransformMailbox->HasUnpublishedWrites());
+
+	//Once a drain is queued the render thread takes the latest frame when it gets to it, so a render thread that falls behind doesn't accumulate commands
+	if (bPublished && TransformMailbox->RequestDrain())
 	{
 		// Enqueue command to modify render thread info
 		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
-		ENQUEUE_RENDER_COMMAND(FDeformMeshAllTransformsSBUpdate)(
+		ENQUEUE_RENDER_COMMAND(FDeformMeshTransformMailboxDrain)(
 			[DeformMeshSceneProxy](FRHICommandListImmediate& RHICmdList)
 			{
-				DeformMeshSceneProxy->UpdateDeformTransformsSB_RenderThread();
+				DeformMeshSceneProxy->DrainTransformMailbox_RenderThread();
 			});
 	}
+	return TransformMailbox->GetWriteSerial();
 }
 
 void UDeformMeshComponent::ClearAllMeshSections()
 {
 	DeformMeshSections.Empty();
+	HotSectionIndices.Empty();
+	DestroySectionBodies();
 	UpdateLocalBounds();
-	MarkRenderStateDirty();
+
+	if (BatchSlots.Num() > 0)
+	{
+		RemoveSectionsFromBatches();
+	}
+	else if (SceneProxy && !IsRenderStateDirty())
+	{
+		// Enqueue command to modify render thread info, the proxy keeps its buffers for the next sections
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		const uint32 MailboxSerial = SendTransformMailbox();
+		ENQUEUE_RENDER_COMMAND(FDeformMeshSectionsClear)(
+			[DeformMeshSceneProxy, MailboxSerial](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->ClearSections_RenderThread(MailboxSerial);
+			});
+	}
+	else
+	{
+		MarkRenderStateDirty();
+	}
 }
 
 void UDeformMeshComponent::SetMeshSectionVisible(int32 SectionIndex, bool bNewVisibility)
@@ -121,6 +313,11 @@ void UDeformMeshComponent::SetMeshSectionVisible(int32 SectionIndex, bool bNewVi
 					DeformMeshSceneProxy->SetSectionVisibility_RenderThread(SectionIndex, bNewVisibility);
 				});
 		}
+		UDeformMeshSubsystem* Subsystem = GetBatchSubsystem();
+		if (Subsystem != nullptr && BatchSlots.IsValidIndex(SectionIndex))
+		{
+			Subsystem->SetSectionVisible(BatchSlots[SectionIndex], bNewVisibility && IsVisible());
+		}
 	}
 }
 
@@ -129,11 +326,56 @@ bool UDeformMeshComponent::IsMeshSectionVisible(int32 SectionIndex) const
 	return (SectionIndex < DeformMeshSections.Num()) ? DeformMeshSections[SectionIndex].bSectionVisible : false;
 }
 
+void UDeformMeshComponent::SetMeshSectionShadowMode(int32 SectionIndex, EDeformMeshShadowMode NewShadowMode)
+{
+	if (SectionIndex < DeformMeshSections.Num() && DeformMeshSections[SectionIndex].ShadowMode != NewShadowMode)
+	{
+		// Set game thread state
+		DeformMeshSections[SectionIndex].ShadowMode = NewShadowMode;
+
+		if (SceneProxy)
+		{
+			// Enqueue command to modify render thread info
+			FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+			ENQUEUE_RENDER_COMMAND(FDeformMeshSectionShadowModeUpdate)(
+				[DeformMeshSceneProxy, SectionIndex, NewShadowMode](FRHICommandListImmediate& RHICmdList)
+				{
+					DeformMeshSceneProxy->SetSectionShadowMode_RenderThread(SectionIndex, NewShadowMode);
+				});
+		}
+	}
+}
+
+EDeformMeshShadowMode UDeformMeshComponent::GetMeshSectionShadowMode(int32 SectionIndex) const
+{
+	return (SectionIndex < DeformMeshSections.Num()) ? DeformMeshSections[SectionIndex].ShadowMode : EDeformMeshShadowMode::Full;
+}
+
+FDeformMeshShadowDrawStats UDeformMeshComponent::GetShadowDrawStats() const
+{
+	return SceneProxy && ShadowDrawCounts.IsValid() ? ShadowDrawCounts->GetLastFrame() : FDeformMeshShadowDrawStats();
+}
+
 int32 UDeformMeshComponent::GetNumSections() const
 {
 	return DeformMeshSections.Num();
 }
 
+UMaterialInterface* UDeformMeshComponent::GetSectionMaterial(int32 SectionIndex, int32 MaterialIndex) const
+{
+	if (!DeformMeshSections.IsValidIndex(SectionIndex) || DeformMeshSections[SectionIndex].StaticMesh == nullptr)
+	{
+		return nullptr;
+	}
+
+	//The first material can be overriden with the component's material slot of the section
+	if (MaterialIndex == 0)
+	{
+		return GetMaterial(SectionIndex);
+	}
+	return DeformMeshSections[SectionIndex].StaticMesh->GetMaterial(MaterialIndex);
+}
+
 
 FDeformMeshSection* UDeformMeshComponent::GetDeformMeshSection(int32 SectionIndex)
 {
@@ -156,50 +398,1205 @@ void UDeformMeshComponent::SetDeformMeshSection(int32 SectionIndex, const FDefor
 	}
 
 	DeformMeshSections[SectionIndex] = Section;
+	if (Section.bHot)
+	{
+		HotSectionIndices.AddUnique(SectionIndex);
+		SetComponentTickEnabled(true);
+	}
 
-	UpdateLocalBounds(); // Update overall bounds
-	MarkRenderStateDirty(); // New section requires recreating scene proxy
+	UpdateSectionsLocalBounds(MakeArrayView(&SectionIndex, 1)); // Update overall bounds
+	UpdateSectionRenderState(SectionIndex); // Send the new section to the scene proxy
+	RecreateSectionBody(SectionIndex); // The body setup comes from the new static mesh
 }
 
-FPrimitiveSceneProxy* UDeformMeshComponent::CreateSceneProxy()
+void UDeformMeshComponent::SetUseInstancedDrawing(bool bNewUseInstancedDrawing)
 {
-	if (!SceneProxy)
-		return new FDeformMeshSceneProxy(this);
-	else
-		return SceneProxy;
+	if (bUseInstancedDrawing != bNewUseInstancedDrawing)
+	{
+		bUseInstancedDrawing = bNewUseInstancedDrawing;
+		MarkRenderStateDirty(); // The draw path is chosen when creating the scene proxy
+	}
 }
 
-int32 UDeformMeshComponent::GetNumMaterials() const
+void UDeformMeshComponent::SetForcedLodModel(int32 NewForcedLodModel)
 {
-	return DeformMeshSections.Num();
+	if (ForcedLodModel != NewForcedLodModel)
+	{
+		ForcedLodModel = NewForcedLodModel;
+		MarkRenderStateDirty(); // The LOD settings are copied when creating the scene proxy
+	}
 }
 
+void UDeformMeshComponent::SetMinLOD(int32 NewMinLOD)
+{
+	if (MinLOD != NewMinLOD)
+	{
+		MinLOD = NewMinLOD;
+		MarkRenderStateDirty(); // The LOD settings are copied when creating the scene proxy
+	}
+}
 
-//Use this to update the Bounds by taking in consideration the deform transform
-FBoxSphereBounds UDeformMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+void UDeformMeshComponent::SetUseStaticDrawPath(bool bNewUseStaticDrawPath)
 {
-	FBoxSphereBounds Ret(LocalBounds.TransformBy(LocalToWorld));
+	if (bUseStaticDrawPath != bNewUseStaticDrawPath)
+	{
+		bUseStaticDrawPath = bNewUseStaticDrawPath;
+		MarkRenderStateDirty(); // The draw path is chosen when creating the scene proxy
+	}
+}
 
-	Ret.BoxExtent *= BoundsScale;
-	Ret.SphereRadius *= BoundsScale;
+void UDeformMeshComponent::SetShadowLODBias(int32 NewShadowLODBias)
+{
+	if (ShadowLODBias != NewShadowLODBias)
+	{
+		ShadowLODBias = NewShadowLODBias;
+		MarkRenderStateDirty(); // The shadow settings are copied when creating the scene proxy
+	}
+}
 
-	return Ret;
+void UDeformMeshComponent::SetShadowMinScreenSize(float NewShadowMinScreenSize)
+{
+	if (ShadowMinScreenSize != NewShadowMinScreenSize)
+	{
+		ShadowMinScreenSize = NewShadowMinScreenSize;
+		MarkRenderStateDirty(); // The shadow settings are copied when creating the scene proxy
+	}
 }
 
-void UDeformMeshComponent::UpdateLocalBounds()
+void UDeformMeshComponent::SetUseGPUSceneInstances(bool bNewUseGPUSceneInstances)
+{
+	if (bUseGPUSceneInstances != bNewUseGPUSceneInstances)
+	{
+		bUseGPUSceneInstances = bNewUseGPUSceneInstances;
+		MarkRenderStateDirty(); // The instances are created with the scene proxy
+	}
+}
+
+void UDeformMeshComponent::SetTransformFormat(EDeformMeshTransformFormat NewTransformFormat)
 {
-	FBox LocalBox(ForceInit);
+	if (TransformFormat != NewTransformFormat)
+	{
+		TransformFormat = NewTransformFormat;
+		MarkRenderStateDirty(); // The transforms buffer is created with its format by the scene proxy
+	}
+}
 
-	for (const FDeformMeshSection& Section : DeformMeshSections)
+void UDeformMeshComponent::SetUseDeformCache(bool bNewUseDeformCache)
+{
+	if (bUseDeformCache != bNewUseDeformCache)
 	{
-		LocalBox += Section.SectionLocalBox;
+		bUseDeformCache = bNewUseDeformCache;
+		MarkRenderStateDirty(); // The caches are created by the scene proxy
 	}
+}
 
-	LocalBounds = LocalBox.IsValid ? FBoxSphereBounds(LocalBox) : FBoxSphereBounds(FVector(0, 0, 0), FVector(0, 0, 0), 0); // fallback to reset box sphere bounds
+void UDeformMeshComponent::SetUseBatching(bool bNewUseBatching)
+{
+	if (bUseBatching != bNewUseBatching)
+	{
+		if (bNewUseBatching)
+		{
+			StopDeformTrack(); // The batches don't play tracks
+		}
+		bUseBatching = bNewUseBatching;
+		MarkRenderStateDirty(); // The sections move between the scene proxy and the batches when the render state is recreated
+	}
+}
 
-	// Update global bounds
-	UpdateBounds();
-	// Need to send to render thread
-	MarkRenderTransformDirty();
+void UDeformMeshComponent::TrackSectionTransformUpdates(TArrayView<const int32> SectionIndices)
+{
+	//Moving a GPU scene instance doesn't touch the cached draws, so there's no reason to make it hot
+	if (!bUseStaticDrawPath || bUseGPUSceneInstances)
+	{
+		return;
+	}
+
+	TArray<int32> PromotedIndices;
+	for (const int32 SectionIndex : SectionIndices)
+	{
+		FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+		//Several updates in the same frame count as one
+		if (Section.LastTransformUpdateFrame == GFrameCounter && Section.NumRecentTransformUpdates > 0)
+		{
+			continue;
+		}
+
+		const bool bRecent = GFrameCounter - Section.LastTransformUpdateFrame < (uint64)HotSectionIdleFrames;
+		Section.NumRecentTransformUpdates = bRecent ? Section.NumRecentTransformUpdates + 1 : 1;
+		Section.LastTransformUpdateFrame = GFrameCounter;
+
+		if (!Section.bHot && Section.NumRecentTransformUpdates >= HotSectionUpdateCount)
+		{
+			Section.bHot = true;
+			HotSectionIndices.Add(SectionIndex);
+			PromotedIndices.Add(SectionIndex);
+		}
+	}
+
+	if (PromotedIndices.Num() > 0)
+	{
+		SendSectionsHotState(PromotedIndices, true);
+		SetComponentTickEnabled(true);
+	}
+}
+
+void UDeformMeshComponent::SendSectionsHotState(TArrayView<const int32> SectionIndices, bool bHot)
+{
+	if (SceneProxy)
+	{
+		// Enqueue command to modify render thread info
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshSectionsHotUpdate)(
+			[DeformMeshSceneProxy, SectionIndices = TArray<int32>(SectionIndices), bHot](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->SetSectionsHot_RenderThread(SectionIndices, bHot);
+			});
+	}
+}
+
+void UDeformMeshComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	//Advance the deform track clock, the render thread does the rest
+	if (DeformTrack.IsValid())
+	{
+		const double Duration = DeformTrack->GetDuration();
+		double NewTime = DeformTrackTime + DeltaTime * DeformTrackPlayRate;
+		if (bLoopDeformTrack && Duration > 0.0)
+		{
+			NewTime = FMath::Fmod(NewTime, Duration);
+			NewTime += NewTime < 0.0 ? Duration : 0.0;
+		}
+		SetDeformTrackTime(NewTime);
+	}
+
+	//Demote the hot sections that weren't updated for a while, they go back to the cached draws
+	TArray<int32> DemotedIndices;
+	for (int32 HotIndex = HotSectionIndices.Num() - 1; HotIndex >= 0; HotIndex--)
+	{
+		const int32 SectionIndex = HotSectionIndices[HotIndex];
+		FDeformMeshSection* Section = DeformMeshSections.IsValidIndex(SectionIndex) ? &DeformMeshSections[SectionIndex] : nullptr;
+		//Cleared sections aren't hot anymore
+		if (Section == nullptr || !Section->bHot)
+		{
+			HotSectionIndices.RemoveAtSwap(HotIndex);
+		}
+		else if (GFrameCounter - Section->LastTransformUpdateFrame >= (uint64)HotSectionIdleFrames)
+		{
+			Section->bHot = false;
+			Section->NumRecentTransformUpdates = 0;
+			HotSectionIndices.RemoveAtSwap(HotIndex);
+			DemotedIndices.Add(SectionIndex);
+		}
+	}
+
+	if (DemotedIndices.Num() > 0)
+	{
+		SendSectionsHotState(DemotedIndices, false);
+	}
+
+	if (HotSectionIndices.Num() == 0 && !DeformTrack.IsValid())
+	{
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UDeformMeshComponent::UpdateSectionRenderState(int32 SectionIndex)
+{
+	//Batched components have no proxy, the section goes to its batch as long as the render state isn't going to be recreated
+	UDeformMeshSubsystem* Subsystem = GetBatchSubsystem();
+	if (Subsystem != nullptr && IsRenderStateCreated() && !IsRenderStateDirty())
+	{
+		UpdateSectionBatchSlot(Subsystem, SectionIndex);
+		return;
+	}
+
+	//Without a proxy, or if it's going to be recreated anyway, there's nothing to update
+	//If the section uses a material that the proxy doesn't know, its material relevance has to be recomputed, and that needs a new proxy
+	//The number of GPU scene instances is fixed when the primitive is added to the scene, a section past them needs a new proxy too
+	FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+	if (!SceneProxy || IsRenderStateDirty() || !AreSectionMaterialsInSceneProxy(SectionIndex) || !DeformMeshSceneProxy->HasInstanceSlot(SectionIndex))
+	{
+		MarkRenderStateDirty();
+		return;
+	}
+
+	//The section proxy is created here since it needs the component, the render thread only swaps it in
+	FDeformMeshSectionProxy* NewSection = FDeformMeshSceneProxy::CreateSectionProxy(this, SectionIndex, DeformMeshSceneProxy->GetScene().GetFeatureLevel());
+	const FMatrix44f Transform(DeformMeshSections[SectionIndex].DeformTransform);
+	//The transforms written before this are for the section being replaced
+	const uint32 MailboxSerial = SendTransformMailbox();
+
+	// Enqueue command to modify render thread info
+	ENQUEUE_RENDER_COMMAND(FDeformMeshSectionUpdate)(
+		[DeformMeshSceneProxy, SectionIndex, NewSection, Transform, MailboxSerial](FRHICommandListImmediate& RHICmdList)
+		{
+			DeformMeshSceneProxy->SetSection_RenderThread(SectionIndex, NewSection, Transform, MailboxSerial);
+		});
+}
+
+int32 UDeformMeshComponent::GetNumPendingSections() const
+{
+	return NumPendingSections;
+}
+
+void UDeformMeshComponent::SetNumPendingSections(int32 NewNumPendingSections)
+{
+	check(IsInGameThread());
+	NumPendingSections = NewNumPendingSections;
+	if (NumPendingSections == 0)
+	{
+		OnSectionsReady.Broadcast(this);
+	}
+}
+
+bool UDeformMeshComponent::AreSectionMaterialsInSceneProxy(int32 SectionIndex) const
+{
+	const UStaticMesh* StaticMesh = DeformMeshSections[SectionIndex].StaticMesh;
+	if (StaticMesh == nullptr)
+	{
+		return true;
+	}
+
+	const int32 NumMaterials = FMath::Max(StaticMesh->GetStaticMaterials().Num(), 1);
+	for (int32 MaterialIndex = 0; MaterialIndex < NumMaterials; MaterialIndex++)
+	{
+		//The proxy uses the default material for the empty slots
+		const UMaterialInterface* Material = GetSectionMaterial(SectionIndex, MaterialIndex);
+		if (!SceneProxyMaterials.Contains(Material != nullptr ? Material : UMaterial::GetDefaultMaterial(MD_Surface)))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+FPrimitiveSceneProxy* UDeformMeshComponent::CreateSceneProxy()
+{
+	//The sections of batched components are drawn by the batches
+	if (GetBatchSubsystem() != nullptr)
+	{
+		return nullptr;
+	}
+
+	if (!SceneProxy)
+	{
+		//Remember the materials that the proxy's material relevance is computed from, sections using only these materials can be added without a new proxy
+		TArray<UMaterialInterface*> UsedMaterials;
+		GetUsedMaterials(UsedMaterials);
+		SceneProxyMaterials.Reset();
+		for (const UMaterialInterface* Material : UsedMaterials)
+		{
+			SceneProxyMaterials.Add(Material);
+		}
+		SceneProxyMaterials.Add(UMaterial::GetDefaultMaterial(MD_Surface));
+
+		//Each proxy gets a new mailbox, it starts from the transforms of the component, and new shadow counts
+		TransformMailbox = MakeShared<FDeformMeshTransformMailbox, ESPMode::ThreadSafe>();
+		ShadowDrawCounts = MakeShared<FDeformMeshShadowDrawCounts, ESPMode::ThreadSafe>();
+		return new FDeformMeshSceneProxy(this);
+	}
+	else
+		return SceneProxy;
+}
+
+int32 UDeformMeshComponent::GetNumMaterials() const
+{
+	return DeformMeshSections.Num();
+}
+
+void UDeformMeshComponent::GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials) const
+{
+	Super::GetUsedMaterials(OutMaterials, bGetDebugMaterials);
+
+	for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+	{
+		const UStaticMesh* StaticMesh = DeformMeshSections[SectionIndex].StaticMesh;
+		if (StaticMesh != nullptr)
+		{
+			for (int32 MaterialIndex = 1; MaterialIndex < StaticMesh->GetStaticMaterials().Num(); MaterialIndex++)
+			{
+				UMaterialInterface* Material = GetSectionMaterial(SectionIndex, MaterialIndex);
+				if (Material != nullptr)
+				{
+					OutMaterials.AddUnique(Material);
+				}
+			}
+		}
+	}
+}
+
+void UDeformMeshComponent::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+	Super::GetResourceSizeEx(CumulativeResourceSize);
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(DeformMeshSections.GetAllocatedSize());
+	for (const FDeformMeshSection& Section : DeformMeshSections)
+	{
+		CumulativeResourceSize.AddDedicatedSystemMemoryBytes(Section.LatticeOffsets.GetAllocatedSize());
+	}
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(SectionBVH.GetAllocatedSize());
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(SectionBodies.GetAllocatedSize() + SectionBodies.Num() * sizeof(FBodyInstance));
+	CumulativeResourceSize.AddDedicatedSystemMemoryBytes(BatchSlots.GetAllocatedSize());
+}
+
+
+//Use this to update the Bounds by taking in consideration the deform transform
+FBoxSphereBounds UDeformMeshComponent::CalcBounds(const FTransform& LocalToWorld) const
+{
+	FBoxSphereBounds Ret(LocalBounds.TransformBy(LocalToWorld));
+
+	Ret.BoxExtent *= BoundsScale;
+	Ret.SphereRadius *= BoundsScale;
+
+	return Ret;
+}
+
+void UDeformMeshComponent::UpdateLocalBounds()
+{
+	//Rebuild the bounds tree from every section, this is only needed when sections are added or removed
+	TArray<FBox> SectionBoxes;
+	SectionBoxes.Reserve(DeformMeshSections.Num());
+	for (const FDeformMeshSection& Section : DeformMeshSections)
+	{
+		SectionBoxes.Add(Section.SectionLocalBox);
+	}
+	SectionBoundsTree.Reset(SectionBoxes);
+
+	//The BVH keeps the topology of its build, with sections added or removed the next trace builds it again
+	SectionBVH.Reset();
+
+	SetLocalBoundsFromTree();
+}
+
+void UDeformMeshComponent::UpdateSectionsLocalBounds(TArrayView<const int32> SectionIndices)
+{
+	//The tree isn't serialized, and doesn't know about sections added since it was built, in both cases we need a full rebuild
+	if (SectionBoundsTree.Num() != DeformMeshSections.Num())
+	{
+		UpdateLocalBounds();
+		return;
+	}
+
+	for (const int32 SectionIndex : SectionIndices)
+	{
+		SectionBoundsTree.Update(SectionIndex, DeformMeshSections[SectionIndex].SectionLocalBox);
+	}
+
+	//The section BVH is only refit once a trace built it
+	if (SectionBVH.Num() == DeformMeshSections.Num())
+	{
+		TArray<FBox, TInlineAllocator<16>> SectionBoxes;
+		SectionBoxes.Reserve(SectionIndices.Num());
+		for (const int32 SectionIndex : SectionIndices)
+		{
+			SectionBoxes.Add(DeformMeshSections[SectionIndex].SectionLocalBox);
+		}
+		SectionBVH.Refit(SectionIndices, SectionBoxes);
+	}
+
+	SetLocalBoundsFromTree();
+}
+
+void UDeformMeshComponent::SetLocalBoundsFromTree()
+{
+	FBox LocalBox = SectionBoundsTree.GetBounds();
+	if (DeformTrackBoundsChunk != INDEX_NONE)
+	{
+		LocalBox += GetDeformTrackBox(DeformTrackBoundsChunk);
+	}
+
+	const FBoxSphereBounds NewLocalBounds = LocalBox.IsValid ? FBoxSphereBounds(LocalBox) : FBoxSphereBounds(FVector(0, 0, 0), FVector(0, 0, 0), 0); // fallback to reset box sphere bounds
+
+	//Most updates move sections inside the bounds, the scene only has to hear about the ones that change them
+	if (NewLocalBounds.Origin == LocalBounds.Origin && NewLocalBounds.BoxExtent == LocalBounds.BoxExtent && NewLocalBounds.SphereRadius == LocalBounds.SphereRadius)
+	{
+		return;
+	}
+	LocalBounds = NewLocalBounds;
+
+	// Update global bounds
+	UpdateBounds();
+	// Need to send to render thread
+	MarkRenderTransformDirty();
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Collision
+/*
+ * The component has no body setup of its own, each section gets a body instance made from the simple collision of its static mesh body setup
+ * This is what the instanced static mesh component does for its instances: the body setup is shared and only scaled, nothing is cooked
+ * The section index is the InstanceBodyIndex of its body, so the hits and overlaps of the physics scene report it as their Item
+*/
+///////////////////////////////////////////////////////////////////////
+void UDeformMeshComponent::SetUseSectionCollision(bool bNewUseSectionCollision)
+{
+	if (bUseSectionCollision != bNewUseSectionCollision)
+	{
+		bUseSectionCollision = bNewUseSectionCollision;
+		RecreatePhysicsState(); // Create or release the section bodies
+	}
+}
+
+bool UDeformMeshComponent::ShouldCreatePhysicsState() const
+{
+	return bUseSectionCollision && Super::ShouldCreatePhysicsState();
+}
+
+void UDeformMeshComponent::OnCreatePhysicsState()
+{
+	//Skip the UPrimitiveComponent version, BodyInstance has no body setup to be created from and only holds the collision settings copied to the sections
+	USceneComponent::OnCreatePhysicsState();
+
+	check(SectionBodies.Num() == 0);
+	for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+	{
+		RecreateSectionBody(SectionIndex);
+	}
+}
+
+void UDeformMeshComponent::OnDestroyPhysicsState()
+{
+	DestroySectionBodies();
+	USceneComponent::OnDestroyPhysicsState();
+}
+
+FBodyInstance* UDeformMeshComponent::GetBodyInstance(FName BoneName, bool bGetWelded, int32 Index) const
+{
+	if (SectionBodies.IsValidIndex(Index) && SectionBodies[Index] != nullptr)
+	{
+		return SectionBodies[Index];
+	}
+	return Super::GetBodyInstance(BoneName, bGetWelded, Index);
+}
+
+void UDeformMeshComponent::OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	Super::OnUpdateTransform(UpdateTransformFlags, Teleport);
+
+	const bool bUpdateBodies = SectionBodies.Num() > 0 && !EnumHasAnyFlags(UpdateTransformFlags, EUpdateTransformFlags::SkipPhysicsUpdate);
+	if (bUpdateBodies || BatchSlots.Num() > 0)
+	{
+		TArray<int32> SectionIndices;
+		SectionIndices.Reserve(DeformMeshSections.Num());
+		for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+		{
+			SectionIndices.Add(SectionIndex);
+		}
+		if (bUpdateBodies)
+		{
+			UpdateSectionBodies(SectionIndices);
+		}
+		UpdateBatchedSectionTransforms(SectionIndices);
+	}
+}
+
+FMatrix UDeformMeshComponent::GetSectionWorldMatrix(int32 SectionIndex) const
+{
+	//The deform transform is stored transposed for the shaders (see CreateMeshSection)
+	return DeformMeshSections[SectionIndex].DeformTransform.GetTransposed() * GetComponentTransform().ToMatrixWithScale();
+}
+
+FTransform UDeformMeshComponent::GetSectionWorldTransform(int32 SectionIndex) const
+{
+	return FTransform(GetSectionWorldMatrix(SectionIndex));
+}
+
+void UDeformMeshComponent::RecreateSectionBody(int32 SectionIndex)
+{
+	if (!IsPhysicsStateCreated())
+	{
+		return;
+	}
+
+	if (SectionBodies.IsValidIndex(SectionIndex) && SectionBodies[SectionIndex] != nullptr)
+	{
+		SectionBodies[SectionIndex]->TermBody();
+		delete SectionBodies[SectionIndex];
+		SectionBodies[SectionIndex] = nullptr;
+	}
+
+	//The body would collide with the undeformed mesh, so the lattice sections go without one and LineTraceSections tests their deformed box instead
+	const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	UBodySetup* BodySetup = Section.StaticMesh != nullptr && Section.LatticeOffsets.Num() == 0 ? Section.StaticMesh->GetBodySetup() : nullptr;
+	FPhysScene* PhysScene = GetWorld() != nullptr ? GetWorld()->GetPhysicsScene() : nullptr;
+	if (BodySetup == nullptr || PhysScene == nullptr)
+	{
+		return;
+	}
+
+	if (SectionBodies.Num() <= SectionIndex)
+	{
+		SectionBodies.SetNumZeroed(SectionIndex + 1);
+	}
+
+	//The section bodies share the collision settings of the component, and are moved by the deform transforms rather than simulated
+	FBodyInstance* SectionBody = new FBodyInstance;
+	SectionBody->CopyBodyInstancePropertiesFrom(&BodyInstance);
+	SectionBody->InstanceBodyIndex = SectionIndex;
+	SectionBody->bAutoWeld = false;
+	SectionBody->bSimulatePhysics = false;
+	SectionBody->InitBody(BodySetup, GetSectionWorldTransform(SectionIndex), this, PhysScene);
+	SectionBodies[SectionIndex] = SectionBody;
+}
+
+void UDeformMeshComponent::UpdateSectionBodies(TArrayView<const int32> SectionIndices)
+{
+	for (const int32 SectionIndex : SectionIndices)
+	{
+		if (SectionBodies.IsValidIndex(SectionIndex) && SectionBodies[SectionIndex] != nullptr)
+		{
+			//Teleport, the bodies aren't simulated so there's no velocity to keep
+			const FTransform SectionTransform = GetSectionWorldTransform(SectionIndex);
+			SectionBodies[SectionIndex]->SetBodyTransform(SectionTransform, ETeleportType::TeleportPhysics);
+			SectionBodies[SectionIndex]->UpdateBodyScale(SectionTransform.GetScale3D());
+		}
+	}
+}
+
+void UDeformMeshComponent::DestroySectionBodies()
+{
+	for (FBodyInstance* SectionBody : SectionBodies)
+	{
+		if (SectionBody != nullptr)
+		{
+			SectionBody->TermBody();
+			delete SectionBody;
+		}
+	}
+	SectionBodies.Empty();
+}
+
+bool UDeformMeshComponent::LineTraceComponent(FHitResult& OutHit, const FVector Start, const FVector End, const FCollisionQueryParams& Params)
+{
+	if (!bUseSectionCollision)
+	{
+		return Super::LineTraceComponent(OutHit, Start, End, Params);
+	}
+	return LineTraceSections(Start, End, OutHit, Params);
+}
+
+bool UDeformMeshComponent::LineTraceSections(const FVector& Start, const FVector& End, FHitResult& OutHit, const FCollisionQueryParams& Params) const
+{
+	if (Params.GetIgnoredComponents().Contains(GetUniqueID()) || (GetOwner() != nullptr && Params.GetIgnoredActors().Contains(GetOwner()->GetUniqueID())))
+	{
+		return false;
+	}
+
+	if (SectionBVH.Num() != DeformMeshSections.Num())
+	{
+		TArray<FBox> SectionBoxes;
+		SectionBoxes.Reserve(DeformMeshSections.Num());
+		for (const FDeformMeshSection& Section : DeformMeshSections)
+		{
+			SectionBoxes.Add(Section.SectionLocalBox);
+		}
+		SectionBVH.Build(SectionBoxes);
+	}
+
+	//The BVH is in component space, the times along the segment are the same in every space since the transforms are affine
+	const FTransform& ComponentTransform = GetComponentTransform();
+	const FVector LocalStart = ComponentTransform.InverseTransformPosition(Start);
+	const FVector LocalEnd = ComponentTransform.InverseTransformPosition(End);
+
+	FHitResult ClosestHit;
+	const int32 HitSectionIndex = SectionBVH.Raycast(LocalStart, LocalEnd, [this, &Start, &End, &Params, &ComponentTransform, &ClosestHit](int32 SectionIndex, double& InOutTime)
+		{
+			const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+			if (Section.StaticMesh == nullptr)
+			{
+				return false;
+			}
+
+			if (SectionBodies.IsValidIndex(SectionIndex) && SectionBodies[SectionIndex] != nullptr)
+			{
+				FHitResult BodyHit;
+				if (SectionBodies[SectionIndex]->LineTrace(BodyHit, Start, End, Params.bTraceComplex, Params.bReturnPhysicalMaterial) && BodyHit.Time < InOutTime)
+				{
+					InOutTime = BodyHit.Time;
+					ClosestHit = BodyHit;
+					return true;
+				}
+				return false;
+			}
+
+			//Without a body, the segment is brought to the space of the static mesh and tested against its box
+			const FMatrix MeshToWorld = Section.DeformTransform.GetTransposed() * ComponentTransform.ToMatrixWithScale();
+			if (FMath::Abs(MeshToWorld.Determinant()) < UE_SMALL_NUMBER)
+			{
+				return false;
+			}
+			const FMatrix WorldToMesh = MeshToWorld.Inverse();
+
+			double Time;
+			FVector MeshNormal;
+			if (!FDeformMeshSectionBVH::IntersectSegmentBox(WorldToMesh.TransformPosition(Start), WorldToMesh.TransformVector(End - Start), Section.GetMeshBox(), InOutTime, Time, &MeshNormal) || Time >= InOutTime)
+			{
+				return false;
+			}
+
+			InOutTime = Time;
+			ClosestHit = FHitResult(Start, End);
+			ClosestHit.bBlockingHit = true;
+			ClosestHit.bStartPenetrating = Time == 0.0;
+			ClosestHit.Time = Time;
+			ClosestHit.Distance = (End - Start).Size() * Time;
+			ClosestHit.Location = ClosestHit.ImpactPoint = Start + (End - Start) * Time;
+			//The normals are transformed by the inverse transpose
+			ClosestHit.Normal = ClosestHit.ImpactNormal = WorldToMesh.GetTransposed().TransformVector(MeshNormal).GetSafeNormal();
+			if (Params.bReturnPhysicalMaterial)
+			{
+				//The box stands for the whole section, so it takes the physical material of the section's first material
+				const UMaterialInterface* Material = GetSectionMaterial(SectionIndex, 0);
+				ClosestHit.PhysMaterial = Material != nullptr ? Material->GetPhysicalMaterial() : nullptr;
+			}
+			return true;
+		});
+
+	if (HitSectionIndex == INDEX_NONE)
+	{
+		return false;
+	}
+
+	OutHit = ClosestHit;
+	OutHit.Item = HitSectionIndex;
+	OutHit.Component = const_cast<UDeformMeshComponent*>(this);
+	OutHit.HitObjectHandle = FActorInstanceHandle(GetOwner());
+	return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Batching
+/*
+ * A batched component has no scene proxy, each of its sections is a section of one of the batch components of the UDeformMeshSubsystem
+ * The batches are in world space, so the sections are sent with the component transform folded into their deform transform
+ * The sections are added to the batches with the render state and removed with it, the same way the scene proxy is created and destroyed
+*/
+///////////////////////////////////////////////////////////////////////
+UDeformMeshSubsystem* UDeformMeshComponent::GetBatchSubsystem() const
+{
+	UWorld* World = GetWorld();
+	return (bUseBatching && World != nullptr) ? World->GetSubsystem<UDeformMeshSubsystem>() : nullptr;
+}
+
+void UDeformMeshComponent::CreateRenderState_Concurrent(FRegisterComponentContext* Context)
+{
+	Super::CreateRenderState_Concurrent(Context);
+
+	if (UDeformMeshSubsystem* Subsystem = GetBatchSubsystem())
+	{
+		for (int32 SectionIndex = 0; SectionIndex < DeformMeshSections.Num(); SectionIndex++)
+		{
+			UpdateSectionBatchSlot(Subsystem, SectionIndex);
+		}
+	}
+}
+
+void UDeformMeshComponent::DestroyRenderState_Concurrent()
+{
+	RemoveSectionsFromBatches();
+	Super::DestroyRenderState_Concurrent();
+}
+
+bool UDeformMeshComponent::RequiresGameThreadEndOfFrameRecreate() const
+{
+	return bUseBatching || Super::RequiresGameThreadEndOfFrameRecreate();
+}
+
+void UDeformMeshComponent::OnVisibilityChanged()
+{
+	Super::OnVisibilityChanged();
+
+	if (UDeformMeshSubsystem* Subsystem = GetBatchSubsystem())
+	{
+		for (int32 SectionIndex = 0; SectionIndex < BatchSlots.Num(); SectionIndex++)
+		{
+			Subsystem->SetSectionVisible(BatchSlots[SectionIndex], DeformMeshSections[SectionIndex].bSectionVisible && IsVisible());
+		}
+	}
+}
+
+void UDeformMeshComponent::UpdateSectionBatchSlot(UDeformMeshSubsystem* Subsystem, int32 SectionIndex)
+{
+	//Removing first lets the section take back the same slot when its batch doesn't change
+	if (BatchSlots.IsValidIndex(SectionIndex))
+	{
+		Subsystem->RemoveSection(BatchSlots[SectionIndex]);
+	}
+
+	const FDeformMeshSection& Section = DeformMeshSections[SectionIndex];
+	if (Section.StaticMesh == nullptr)
+	{
+		return;
+	}
+
+	if (BatchSlots.Num() <= SectionIndex)
+	{
+		BatchSlots.SetNum(SectionIndex + 1);
+	}
+
+	//The hot state is tracked by the batch from the updates it receives
+	const FMatrix WorldMatrix = GetSectionWorldMatrix(SectionIndex);
+	FDeformMeshSection BatchedSection = Section;
+	BatchedSection.DeformTransform = WorldMatrix.GetTransposed();
+	BatchedSection.SectionLocalBox = Section.GetMeshBox().TransformBy(WorldMatrix);
+	BatchedSection.bSectionVisible = Section.bSectionVisible && IsVisible();
+	BatchedSection.bHot = false;
+	BatchedSection.LastTransformUpdateFrame = 0;
+	BatchedSection.NumRecentTransformUpdates = 0;
+	BatchSlots[SectionIndex] = Subsystem->AddSection(BatchedSection, GetSectionMaterial(SectionIndex, 0));
+}
+
+void UDeformMeshComponent::UpdateBatchedSectionTransforms(TArrayView<const int32> SectionIndices)
+{
+	UDeformMeshSubsystem* Subsystem = GetBatchSubsystem();
+	if (Subsystem == nullptr)
+	{
+		return;
+	}
+
+	for (const int32 SectionIndex : SectionIndices)
+	{
+		if (BatchSlots.IsValidIndex(SectionIndex))
+		{
+			Subsystem->UpdateSectionTransform(BatchSlots[SectionIndex], GetSectionWorldMatrix(SectionIndex));
+		}
+	}
+}
+
+void UDeformMeshComponent::RemoveSectionsFromBatches()
+{
+	//The subsystem can be gone when the world is torn down, the batches went with it
+	UWorld* World = GetWorld();
+	UDeformMeshSubsystem* Subsystem = World != nullptr ? World->GetSubsystem<UDeformMeshSubsystem>() : nullptr;
+	if (Subsystem != nullptr)
+	{
+		for (FDeformMeshBatchSlot& Slot : BatchSlots)
+		{
+			Subsystem->RemoveSection(Slot);
+		}
+	}
+	BatchSlots.Empty();
+}
+
+void UDeformMeshComponent::SetBatchedSection(int32 SectionIndex, const FDeformMeshSection& Section, UMaterialInterface* Material)
+{
+	//Set before the section so the scene proxy only gets recreated if the material is new to it
+	if (OverrideMaterials.Num() <= SectionIndex)
+	{
+		OverrideMaterials.SetNum(SectionIndex + 1);
+	}
+	OverrideMaterials[SectionIndex] = Material;
+	MarkCachedMaterialParameterNameIndicesDirty();
+
+	SetDeformMeshSection(SectionIndex, Section);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Component Tracks
+/*
+ * A deform track replaces the transform updates of the game thread with a clock: each tick sends the time to the scene proxy,
+ * which decodes the frame into its transforms (see FDeformMeshSceneProxy::EvaluateTrack_RenderThread)
+ * The game thread doesn't see the decoded transforms, the bounds are taken from the per chunk bounds of the track, recomputed when the clock enters a new chunk
+*/
+///////////////////////////////////////////////////////////////////////
+bool UDeformMeshComponent::PlayDeformTrack(const FString& Filename, bool bLoop)
+{
+	return PlayDeformTrack(FDeformMeshTrack::OpenFile(Filename), bLoop);
+}
+
+bool UDeformMeshComponent::PlayDeformTrack(TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> Track, bool bLoop)
+{
+	//The batches are fed from the game thread transforms, that the tracks bypass
+	if (!Track.IsValid() || bUseBatching)
+	{
+		return false;
+	}
+
+	StopDeformTrack();
+	DeformTrack = Track;
+	DeformTrackTime = 0.0;
+	bLoopDeformTrack = bLoop;
+
+	//The mesh can be rotated any way around its pivot, so the bounds use a sphere around the pivot
+	DeformTrackMeshRadius = 0.0f;
+	for (int32 SectionIndex = 0; SectionIndex < FMath::Min(Track->GetNumSections(), DeformMeshSections.Num()); SectionIndex++)
+	{
+		if (DeformMeshSections[SectionIndex].StaticMesh != nullptr)
+		{
+			const FBox MeshBox = DeformMeshSections[SectionIndex].GetMeshBox();
+			const FVector FarthestCorner = FVector::Max(MeshBox.Min.GetAbs(), MeshBox.Max.GetAbs());
+			DeformTrackMeshRadius = FMath::Max(DeformTrackMeshRadius, (float)FarthestCorner.Size());
+		}
+	}
+
+	if (SceneProxy)
+	{
+		// Enqueue command to modify render thread info
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshTrackPlay)(
+			[DeformMeshSceneProxy, Track](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->SetTrack_RenderThread(Track, 0.0);
+			});
+	}
+
+	DeformTrackBoundsChunk = INDEX_NONE;
+	SetDeformTrackTime(0.0);
+	SetComponentTickEnabled(true);
+	return true;
+}
+
+void UDeformMeshComponent::StopDeformTrack()
+{
+	if (!DeformTrack.IsValid())
+	{
+		return;
+	}
+
+	if (SceneProxy)
+	{
+		// Enqueue command to modify render thread info
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshTrackStop)(
+			[DeformMeshSceneProxy](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->SetTrack_RenderThread(nullptr, 0.0);
+			});
+	}
+
+	//Decode the last frame once on the game thread, so the bounds, the collision and the next updates start from where the track left the sections
+	TArray<FMatrix44f> TrackMatrices;
+	TrackMatrices.SetNumUninitialized(FMath::Min(DeformTrack->GetNumSections(), DeformMeshSections.Num()));
+	FDeformMeshTrackReader(DeformTrack.ToSharedRef()).Evaluate(DeformTrackTime, TrackMatrices);
+
+	DeformTrack.Reset();
+	DeformTrackBoundsChunk = INDEX_NONE;
+
+	TArray<int32> UpdatedIndices;
+	TArray<FMatrix44f> UpdatedMatrices;
+	TArray<FBox> DeformedBoxes;
+	for (int32 SectionIndex = 0; SectionIndex < TrackMatrices.Num(); SectionIndex++)
+	{
+		if (DeformMeshSections[SectionIndex].StaticMesh != nullptr)
+		{
+			UpdatedIndices.Add(SectionIndex);
+			UpdatedMatrices.Add(TrackMatrices[SectionIndex]);
+			DeformedBoxes.Add(DeformMeshSections[SectionIndex].GetMeshBox().TransformBy(FMatrix(TrackMatrices[SectionIndex]).GetTransposed()));
+		}
+	}
+	ApplySectionTransforms(MoveTemp(UpdatedIndices), MoveTemp(UpdatedMatrices), DeformedBoxes);
+}
+
+void UDeformMeshComponent::SetDeformTrackTime(double NewTime)
+{
+	if (!DeformTrack.IsValid())
+	{
+		return;
+	}
+
+	DeformTrackTime = FMath::Clamp(NewTime, 0.0, DeformTrack->GetDuration());
+
+	if (SceneProxy)
+	{
+		// Enqueue command to modify render thread info
+		FDeformMeshSceneProxy* DeformMeshSceneProxy = (FDeformMeshSceneProxy*)SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshTrackTimeUpdate)(
+			[DeformMeshSceneProxy, Time = DeformTrackTime](FRHICommandListImmediate& RHICmdList)
+			{
+				DeformMeshSceneProxy->EvaluateTrack_RenderThread(Time);
+			});
+	}
+
+	//The bounds cover a chunk and the next one, they only change when the clock enters another chunk
+	const int32 ChunkIndex = DeformTrack->GetChunkIndex(DeformTrackTime);
+	if (ChunkIndex != DeformTrackBoundsChunk)
+	{
+		DeformTrackBoundsChunk = ChunkIndex;
+		SetLocalBoundsFromTree();
+	}
+}
+
+double UDeformMeshComponent::GetDeformTrackTime() const
+{
+	return DeformTrackTime;
+}
+
+bool UDeformMeshComponent::IsPlayingDeformTrack() const
+{
+	return DeformTrack.IsValid();
+}
+
+FBox UDeformMeshComponent::GetDeformTrackBox(int32 ChunkIndex) const
+{
+	//The frames between two chunks are interpolated from both of them
+	const int32 LastChunkIndex = FMath::Min(ChunkIndex + 1, DeformTrack->GetNumChunks() - 1);
+	FBox TranslationBox(ForceInit);
+	float MaxScale = 0.0f;
+	for (int32 BoundsChunkIndex = ChunkIndex; BoundsChunkIndex <= LastChunkIndex; BoundsChunkIndex++)
+	{
+		const FDeformMeshTrackChunkBounds& ChunkBounds = DeformTrack->GetChunkBounds(BoundsChunkIndex);
+		TranslationBox += FBox(FVector(ChunkBounds.TranslationMin), FVector(ChunkBounds.TranslationMax));
+		MaxScale = FMath::Max(MaxScale, ChunkBounds.MaxScale);
+	}
+	return TranslationBox.ExpandBy(DeformTrackMeshRadius * MaxScale);
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshShadows, Log, All);
+
+/*
+ * Lists the shadow draws of the last frame of every deform mesh component that has a scene proxy, with the totals
+ * Usage: DeformMesh.ShadowDrawStats
+*/
+static void LogShadowDrawStats()
+{
+	FDeformMeshShadowDrawStats Total;
+	int32 NumComponents = 0;
+	for (TObjectIterator<UDeformMeshComponent> It; It; ++It)
+	{
+		if (It->SceneProxy == nullptr)
+		{
+			continue;
+		}
+
+		const FDeformMeshShadowDrawStats Stats = It->GetShadowDrawStats();
+		UE_LOG(LogDeformMeshShadows, Display, TEXT("%s: %d shadow views, %d sections drawn, %d skipped, %d cached shadow sections"),
+			*It->GetPathName(), Stats.NumShadowViews, Stats.NumSectionsDrawn, Stats.NumSectionsSkipped, Stats.NumCachedShadowSections);
+		Total.NumShadowViews += Stats.NumShadowViews;
+		Total.NumSectionsDrawn += Stats.NumSectionsDrawn;
+		Total.NumSectionsSkipped += Stats.NumSectionsSkipped;
+		Total.NumCachedShadowSections += Stats.NumCachedShadowSections;
+		NumComponents++;
+	}
+	UE_LOG(LogDeformMeshShadows, Display, TEXT("%d components: %d shadow views, %d sections drawn, %d skipped, %d cached shadow sections"),
+		NumComponents, Total.NumShadowViews, Total.NumSectionsDrawn, Total.NumSectionsSkipped, Total.NumCachedShadowSections);
+}
+
+static FAutoConsoleCommand ShadowDrawStatsCommand(
+	TEXT("DeformMesh.ShadowDrawStats"),
+	TEXT("Lists the shadow draws of the last frame of every deform mesh component. Usage: DeformMesh.ShadowDrawStats"),
+	FConsoleCommandDelegate::CreateStatic(&LogShadowDrawStats));
+#endif
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshTransforms, Log, All);
+
+/*
+ * Times the update of every section of a component, one UpdateMeshSectionTransform call per section against one UpdateMeshSectionTransforms call, and checks that both give the same transforms and bounds
+ * The component is registered to the world of the command when there is one, so the mailbox writes and the render thread drains are part of the frames, otherwise only the game thread work is timed
+ * Usage: DeformMesh.BenchmarkTransformUpdates [NumFrames=10] [NumSections=1000 10000 ...]
+*/
+static void BenchmarkTransformUpdates(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumFrames = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10;
+	TArray<int32> SectionCounts;
+	for (int32 ArgIndex = 1; ArgIndex < Args.Num(); ArgIndex++)
+	{
+		SectionCounts.Add(FMath::Max(FCString::Atoi(*Args[ArgIndex]), 1));
+	}
+	if (SectionCounts.Num() == 0)
+	{
+		SectionCounts = { 1000, 10000 };
+	}
+
+	UStaticMesh* Mesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (Mesh == nullptr)
+	{
+		UE_LOG(LogDeformMeshTransforms, Error, TEXT("Transform updates: the engine cube couldn't be loaded"));
+		return;
+	}
+
+	FRandomStream Random;
+	for (const int32 NumSections : SectionCounts)
+	{
+		//Adding a section rebuilds the bounds of the component, that part isn't timed
+		UDeformMeshComponent* Component = NewObject<UDeformMeshComponent>(GetTransientPackage());
+		for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+		{
+			Component->CreateMeshSection(SectionIndex, Mesh, FTransform::Identity);
+		}
+		if (World != nullptr)
+		{
+			Component->RegisterComponentWithWorld(World);
+			FlushRenderingCommands();
+		}
+
+		TArray<int32> SectionIndices;
+		TArray<FTransform> Transforms;
+		SectionIndices.SetNumUninitialized(NumSections);
+		Transforms.SetNumUninitialized(NumSections);
+		for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+		{
+			SectionIndices[SectionIndex] = SectionIndex;
+		}
+
+		//Each frame moves every section to a new random transform, the same frames are played by both paths
+		auto MakeFrame = [&Random, &Transforms](int32 Frame)
+		{
+			Random.Initialize(0xDEF3 + Frame);
+			for (FTransform& Transform : Transforms)
+			{
+				Transform = FTransform(FQuat(Random.GetUnitVector(), Random.FRandRange(-PI, PI)), Random.GetUnitVector() * Random.FRandRange(0.0f, 5000.0f), FVector(Random.FRandRange(0.5f, 2.0f)));
+			}
+		};
+
+		double OneByOneTime = 0.0;
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			MakeFrame(Frame);
+			const double StartTime = FPlatformTime::Seconds();
+			for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+			{
+				Component->UpdateMeshSectionTransform(SectionIndex, Transforms[SectionIndex]);
+			}
+			Component->FinishTransformsUpdate();
+			OneByOneTime += FPlatformTime::Seconds() - StartTime;
+			FlushRenderingCommands();
+		}
+
+		//The last frame of each path must leave the sections and the bounds in the same state
+		TArray<FMatrix> OneByOneMatrices;
+		for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+		{
+			OneByOneMatrices.Add(Component->GetDeformMeshSection(SectionIndex)->DeformTransform);
+		}
+		const FBoxSphereBounds OneByOneBounds = Component->Bounds;
+
+		double BulkTime = 0.0;
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			MakeFrame(Frame);
+			const double StartTime = FPlatformTime::Seconds();
+			Component->UpdateMeshSectionTransforms(SectionIndices, Transforms);
+			Component->FinishTransformsUpdate();
+			BulkTime += FPlatformTime::Seconds() - StartTime;
+			FlushRenderingCommands();
+		}
+
+		FDeformMeshTestChecks Checks(LogDeformMeshTransforms, TEXT("Transform updates"));
+		for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+		{
+			Checks.Check(Component->GetDeformMeshSection(SectionIndex)->DeformTransform.Equals(OneByOneMatrices[SectionIndex], 0.01), TEXT("section %d has another transform after the bulk update"), SectionIndex);
+		}
+		Checks.Check(Component->Bounds.GetBox().Equals(OneByOneBounds.GetBox(), 0.1), TEXT("the bounds differ after the bulk update"));
+
+		if (Component->IsRegistered())
+		{
+			Component->UnregisterComponent();
+		}
+		Component->MarkAsGarbage();
+
+		UE_LOG(LogDeformMeshTransforms, Display, TEXT("Transform updates, %d sections, %d frames%s: one by one %.3f ms per frame, bulk %.3f ms per frame (%.1fx)"),
+			NumSections, NumFrames, World != nullptr ? TEXT(" with a scene proxy") : TEXT(""), OneByOneTime * 1000.0 / NumFrames, BulkTime * 1000.0 / NumFrames, OneByOneTime / FMath::Max(BulkTime, UE_SMALL_NUMBER));
+		Checks.Report(FString::Printf(TEXT("%d sections"), NumSections));
+	}
+}
+
+static FAutoConsoleCommand BenchmarkTransformUpdatesCommand(
+	TEXT("DeformMesh.BenchmarkTransformUpdates"),
+	TEXT("Times the update of every section of a component one by one against the bulk update. Usage: DeformMesh.BenchmarkTransformUpdates [NumFrames=10] [NumSections=1000 10000 ...]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkTransformUpdates));
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshSections, Log, All);
+
+/*
+ * Adds, replaces and removes random sections of a registered component every frame, and moves some of the others
+ * After each frame the sections and transforms of the scene proxy are compared with the component, and the proxy must not have been recreated
+ * Usage: DeformMesh.StressSectionUpdates [NumFrames=200] [MaxSections=64] [NumChangesPerFrame=8]
+*/
+static void StressSectionUpdates(const TArray<FString>& Args, UWorld* World)
+{
+	const int32 NumFrames = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 200;
+	const int32 MaxSections = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 64;
+	const int32 NumChangesPerFrame = Args.Num() > 2 ? FMath::Max(FCString::Atoi(*Args[2]), 1) : 8;
+
+	UStaticMesh* Mesh = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (World == nullptr || World->Scene == nullptr || Mesh == nullptr)
+	{
+		UE_LOG(LogDeformMeshSections, Error, TEXT("Section updates: the stress test needs a world with a scene and the engine cube"));
+		return;
+	}
+
+	FRandomStream Random(0xDEF7);
+	auto MakeTransform = [&Random]()
+	{
+		return FTransform(FQuat(Random.GetUnitVector(), Random.FRandRange(-PI, PI)), Random.GetUnitVector() * Random.FRandRange(0.0f, 5000.0f), FVector(Random.FRandRange(0.5f, 2.0f)));
+	};
+
+	//The proxy is created with one section, so it already knows the material of the cube and every later section can be added to it
+	UDeformMeshComponent* Component = NewObject<UDeformMeshComponent>(GetTransientPackage());
+	Component->CreateMeshSection(0, Mesh, MakeTransform());
+	Component->RegisterComponentWithWorld(World);
+	FlushRenderingCommands();
+	const FPrimitiveSceneProxy* FirstSceneProxy = Component->SceneProxy;
+
+	FDeformMeshTestChecks Checks(LogDeformMeshSections, TEXT("Section updates"));
+	int32 NumChanges = 0;
+	for (int32 Frame = 0; Frame < NumFrames && Checks.HasPassed(); Frame++)
+	{
+		if (Random.FRand() < 0.02f)
+		{
+			Component->ClearAllMeshSections();
+		}
+		for (int32 ChangeIndex = 0; ChangeIndex < NumChangesPerFrame; ChangeIndex++, NumChanges++)
+		{
+			const int32 SectionIndex = Random.RandHelper(MaxSections);
+			const FDeformMeshSection* Section = Component->GetDeformMeshSection(SectionIndex);
+			const float Choice = Random.FRand();
+			if (Choice < 0.4f)
+			{
+				Component->CreateMeshSection(SectionIndex, Mesh, MakeTransform());
+			}
+			else if (Choice < 0.7f)
+			{
+				Component->ClearMeshSection(SectionIndex);
+			}
+			else if (Section != nullptr && Section->StaticMesh != nullptr)
+			{
+				Component->UpdateMeshSectionTransform(SectionIndex, MakeTransform());
+			}
+		}
+		Component->FinishTransformsUpdate();
+		//The proxy is only recreated or sent the dynamic data by the end of frame updates, a console command doesn't run inside a frame so they're sent here
+		World->SendAllEndOfFrameUpdates();
+		FlushRenderingCommands();
+
+		//Compare on the render thread, the component isn't touched until the flush below returns
+		if (!Checks.Check(Component->SceneProxy == FirstSceneProxy, TEXT("frame %d, the scene proxy was recreated"), Frame))
+		{
+			break;
+		}
+		const FDeformMeshSceneProxy* DeformMeshSceneProxy = (const FDeformMeshSceneProxy*)Component->SceneProxy;
+		ENQUEUE_RENDER_COMMAND(FDeformMeshStressSectionUpdates)(
+			[DeformMeshSceneProxy, Component, Frame, &Checks](FRHICommandListImmediate& RHICmdList)
+			{
+				const int32 NumSections = FMath::Max(DeformMeshSceneProxy->GetNumSections_RenderThread(), Component->GetNumSections());
+				Checks.Check(DeformMeshSceneProxy->GetTransformsCapacity_RenderThread() >= DeformMeshSceneProxy->GetNumSections_RenderThread(), TEXT("frame %d, the transforms buffer is smaller than the sections"), Frame);
+				for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+				{
+					const FDeformMeshSection* Section = Component->GetDeformMeshSection(SectionIndex);
+					const bool bExpected = Section != nullptr && Section->StaticMesh != nullptr;
+					const FMatrix44f* Transform = DeformMeshSceneProxy->FindSectionTransform_RenderThread(SectionIndex);
+					if (Checks.Check(bExpected == (Transform != nullptr), TEXT("frame %d, section %d is %s the scene proxy"), Frame, SectionIndex, bExpected ? TEXT("missing from") : TEXT("left in")) && bExpected)
+					{
+						Checks.Check(Transform->Equals(FMatrix44f(Section->DeformTransform), 1e-3f), TEXT("frame %d, section %d has another transform in the scene proxy"), Frame, SectionIndex);
+					}
+				}
+			});
+		FlushRenderingCommands();
+	}
+
+	Component->UnregisterComponent();
+	Component->MarkAsGarbage();
+
+	Checks.Report(FString::Printf(TEXT("%d frames, %d changes"), NumFrames, NumChanges));
 }
 
+static FAutoConsoleCommand StressSectionUpdatesCommand(
+	TEXT("DeformMesh.StressSectionUpdates"),
+	TEXT("Adds, replaces and removes sections every frame and checks the scene proxy follows without being recreated. Usage: DeformMesh.StressSectionUpdates [NumFrames=200] [MaxSections=64] [NumChangesPerFrame=8]"),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StressSectionUpdates));
+#endif
@@ -0,0 +1,22 @@
+#include "DeformMeshDirtyRanges.h"
+
+void FDeformMeshDirtyRanges::Build(const TBitArray<>& Dirty, int32 MaxGap, TArray<FDeformMeshDirtyRange, TInlineAllocator<16>>& OutRanges)
+{
+	OutRanges.Reset();
+
+	for (TConstSetBitIterator<> It(Dirty); It; ++It)
+	{
+		const int32 Index = It.GetIndex();
+		if (OutRanges.Num() > 0)
+		{
+			FDeformMeshDirtyRange& LastRange = OutRanges.Last();
+			//Extend the last range when the gap is small enough
+			if (Index - (LastRange.First + LastRange.Num) <= MaxGap)
+			{
+				LastRange.Num = Index - LastRange.First + 1;
+				continue;
+			}
+		}
+		OutRanges.Add({ Index, 1 });
+	}
+}
@@ -0,0 +1,29 @@
+#include "DeformMeshLODSelection.h"
+
+int32 FDeformMeshLODSelection::SelectLOD(TArrayView<const float> LODScreenSizes, float ScreenSize, int32 MinLOD, int32 ForcedLOD)
+{
+	const int32 NumLODs = LODScreenSizes.Num();
+	if (NumLODs == 0)
+	{
+		return 0;
+	}
+
+	const int32 LastLOD = NumLODs - 1;
+	if (ForcedLOD != INDEX_NONE)
+	{
+		return FMath::Clamp(ForcedLOD, 0, LastLOD);
+	}
+
+	const int32 FinestLOD = FMath::Clamp(MinLOD, 0, LastLOD);
+
+	//Walk backwards and return the first LOD whose screen size is bigger than the section, like ComputeStaticMeshLOD
+	for (int32 LODIndex = LastLOD; LODIndex > FinestLOD; LODIndex--)
+	{
+		if (LODScreenSizes[LODIndex] > ScreenSize)
+		{
+			return LODIndex;
+		}
+	}
+
+	return FinestLOD;
+}
@@ -0,0 +1,219 @@
+#include "DeformMeshLattice.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+/* Cubic Bernstein basis, the weight of each of the 4 control points along one axis */
+static void GetBernsteinWeights(double T, double Weights[FDeformMeshLattice::Resolution])
+{
+	const double S = 1.0 - T;
+	Weights[0] = S * S * S;
+	Weights[1] = 3.0 * T * S * S;
+	Weights[2] = 3.0 * T * T * S;
+	Weights[3] = T * T * T;
+}
+
+/* Inverse of the box size, 0 along the axes where the box is flat so that every point of those axes uses the first control points */
+static FVector GetInvBoxSize(const FBox& MeshBox)
+{
+	const FVector Size = MeshBox.GetSize();
+	return FVector(
+		Size.X > UE_KINDA_SMALL_NUMBER ? 1.0 / Size.X : 0.0,
+		Size.Y > UE_KINDA_SMALL_NUMBER ? 1.0 / Size.Y : 0.0,
+		Size.Z > UE_KINDA_SMALL_NUMBER ? 1.0 / Size.Z : 0.0);
+}
+
+FVector FDeformMeshLattice::GetRestControlPoint(const FBox& MeshBox, int32 X, int32 Y, int32 Z)
+{
+	const FVector Alpha = FVector(X, Y, Z) / (Resolution - 1);
+	return MeshBox.Min + MeshBox.GetSize() * Alpha;
+}
+
+FVector FDeformMeshLattice::Evaluate(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets, const FVector& Position)
+{
+	check(ControlPointOffsets.Num() == NumControlPoints);
+
+	const FVector UVW = ((Position - MeshBox.Min) * GetInvBoxSize(MeshBox)).BoundToBox(FVector::ZeroVector, FVector::OneVector);
+	double WeightsX[Resolution], WeightsY[Resolution], WeightsZ[Resolution];
+	GetBernsteinWeights(UVW.X, WeightsX);
+	GetBernsteinWeights(UVW.Y, WeightsY);
+	GetBernsteinWeights(UVW.Z, WeightsZ);
+
+	FVector Offset = FVector::ZeroVector;
+	for (int32 Z = 0; Z < Resolution; Z++)
+	{
+		for (int32 Y = 0; Y < Resolution; Y++)
+		{
+			for (int32 X = 0; X < Resolution; X++)
+			{
+				Offset += FVector(ControlPointOffsets[GetControlPointIndex(X, Y, Z)]) * (WeightsX[X] * WeightsY[Y] * WeightsZ[Z]);
+			}
+		}
+	}
+	return Position + Offset;
+}
+
+FBox FDeformMeshLattice::GetDeformedBox(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets)
+{
+	check(ControlPointOffsets.Num() == NumControlPoints);
+
+	FBox DeformedBox(ForceInit);
+	for (int32 Z = 0; Z < Resolution; Z++)
+	{
+		for (int32 Y = 0; Y < Resolution; Y++)
+		{
+			for (int32 X = 0; X < Resolution; X++)
+			{
+				DeformedBox += GetRestControlPoint(MeshBox, X, Y, Z) + FVector(ControlPointOffsets[GetControlPointIndex(X, Y, Z)]);
+			}
+		}
+	}
+	return DeformedBox;
+}
+
+void FDeformMeshLattice::WriteGPUData(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets, FVector4f* Dest)
+{
+	check(ControlPointOffsets.Num() == NumControlPoints);
+
+	Dest[0] = FVector4f(FVector3f(MeshBox.Min), 0.0f);
+	Dest[1] = FVector4f(FVector3f(GetInvBoxSize(MeshBox)), 0.0f);
+	for (int32 Index = 0; Index < NumControlPoints; Index++)
+	{
+		Dest[2 + Index] = FVector4f(ControlPointOffsets[Index], 0.0f);
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshLattice, Log, All);
+
+/* The evaluation of ApplyDeformLattice in DeformMeshCommon.ush, in float, from the data written by WriteGPUData */
+static FVector3f EvaluateGPUData(const FVector4f* Data, const FVector3f& Position)
+{
+	const FVector3f BoxMin(Data[0]);
+	const FVector3f InvBoxSize(Data[1]);
+	const FVector3f UVW = ((Position - BoxMin) * InvBoxSize).BoundToBox(FVector3f::ZeroVector, FVector3f::OneVector);
+
+	float WeightsX[FDeformMeshLattice::Resolution], WeightsY[FDeformMeshLattice::Resolution], WeightsZ[FDeformMeshLattice::Resolution];
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		float* Weights = Axis == 0 ? WeightsX : Axis == 1 ? WeightsY : WeightsZ;
+		const float T = UVW[Axis];
+		const float S = 1.0f - T;
+		Weights[0] = S * S * S;
+		Weights[1] = 3.0f * T * S * S;
+		Weights[2] = 3.0f * T * T * S;
+		Weights[3] = T * T * T;
+	}
+
+	FVector3f Offset = FVector3f::ZeroVector;
+	for (int32 Z = 0; Z < FDeformMeshLattice::Resolution; Z++)
+	{
+		for (int32 Y = 0; Y < FDeformMeshLattice::Resolution; Y++)
+		{
+			for (int32 X = 0; X < FDeformMeshLattice::Resolution; X++)
+			{
+				Offset += FVector3f(Data[2 + FDeformMeshLattice::GetControlPointIndex(X, Y, Z)]) * (WeightsX[X] * WeightsY[Y] * WeightsZ[Z]);
+			}
+		}
+	}
+	return Position + Offset;
+}
+
+/*
+ * Checks the CPU reference evaluator of the lattice against the properties of the Bernstein blend, and the GPU data against it
+ * 1 Zero offsets don't move the mesh, a uniform offset moves every point by that offset
+ * 2 Offsets that are an affine function of the rest control points deform the mesh by that same affine function, the corners follow their control points exactly
+ * 3 The points outside of the box move like the closest point of the box, and a flat box doesn't give NaNs
+ * 4 Random lattices keep the deformed points inside GetDeformedBox, and the float evaluation of the GPU data stays close to the CPU one
+ * Usage: DeformMesh.TestLattice [NumPoints=1000]
+*/
+static void TestLattice(const TArray<FString>& Args)
+{
+	const int32 NumPoints = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 1000;
+
+	FDeformMeshTestChecks Checks(LogDeformMeshLattice, TEXT("Lattice"));
+
+	FRandomStream Random(0xDEF9);
+	const FBox MeshBox(FVector(-50.0, -20.0, 0.0), FVector(50.0, 20.0, 200.0));
+	const double Tolerance = 1e-6 * MeshBox.GetSize().GetMax();
+	auto RandomPointInBox = [&Random](const FBox& Box)
+	{
+		return Box.Min + Box.GetSize() * FVector(Random.FRand(), Random.FRand(), Random.FRand());
+	};
+
+	TArray<FVector3f> Offsets;
+	Offsets.SetNumZeroed(FDeformMeshLattice::NumControlPoints);
+	const FVector3f UniformOffset(3.0f, -7.0f, 11.0f);
+	TArray<FVector3f> UniformOffsets;
+	UniformOffsets.Init(UniformOffset, FDeformMeshLattice::NumControlPoints);
+	for (int32 PointIndex = 0; PointIndex < NumPoints; PointIndex++)
+	{
+		const FVector Position = RandomPointInBox(MeshBox);
+		Checks.Check(FDeformMeshLattice::Evaluate(MeshBox, Offsets, Position).Equals(Position, Tolerance), TEXT("a lattice without offsets moves the mesh"));
+		Checks.Check(FDeformMeshLattice::Evaluate(MeshBox, UniformOffsets, Position).Equals(Position + FVector(UniformOffset), Tolerance), TEXT("a uniform offset doesn't move the mesh by that offset"));
+	}
+
+	//Linear precision: with the control points moved by an affine map, every point is moved by the same map
+	const FMatrix Affine(FVector(0.1, 0.02, -0.05), FVector(0.0, -0.2, 0.03), FVector(0.04, 0.0, 0.3), FVector(5.0, -3.0, 8.0));
+	for (int32 Z = 0; Z < FDeformMeshLattice::Resolution; Z++)
+	{
+		for (int32 Y = 0; Y < FDeformMeshLattice::Resolution; Y++)
+		{
+			for (int32 X = 0; X < FDeformMeshLattice::Resolution; X++)
+			{
+				Offsets[FDeformMeshLattice::GetControlPointIndex(X, Y, Z)] = FVector3f(Affine.TransformPosition(FDeformMeshLattice::GetRestControlPoint(MeshBox, X, Y, Z)));
+			}
+		}
+	}
+	for (int32 PointIndex = 0; PointIndex < NumPoints; PointIndex++)
+	{
+		const FVector Position = RandomPointInBox(MeshBox);
+		Checks.Check(FDeformMeshLattice::Evaluate(MeshBox, Offsets, Position).Equals(Position + Affine.TransformPosition(Position), 1e-4 * MeshBox.GetSize().GetMax()), TEXT("an affine lattice doesn't deform the mesh by its affine map"));
+	}
+	for (int32 Corner = 0; Corner < 8; Corner++)
+	{
+		const int32 X = (Corner & 1) ? FDeformMeshLattice::Resolution - 1 : 0;
+		const int32 Y = (Corner & 2) ? FDeformMeshLattice::Resolution - 1 : 0;
+		const int32 Z = (Corner & 4) ? FDeformMeshLattice::Resolution - 1 : 0;
+		const FVector Rest = FDeformMeshLattice::GetRestControlPoint(MeshBox, X, Y, Z);
+		Checks.Check(FDeformMeshLattice::Evaluate(MeshBox, Offsets, Rest).Equals(Rest + FVector(Offsets[FDeformMeshLattice::GetControlPointIndex(X, Y, Z)]), Tolerance), TEXT("a corner of the box doesn't follow its control point"));
+	}
+
+	//Outside of the box, and a box that's flat along Z
+	for (int32 PointIndex = 0; PointIndex < NumPoints; PointIndex++)
+	{
+		const FVector Position = RandomPointInBox(MeshBox.ExpandBy(100.0));
+		const FVector Closest = MeshBox.GetClosestPointTo(Position);
+		Checks.Check(FDeformMeshLattice::Evaluate(MeshBox, Offsets, Position).Equals(Position + FDeformMeshLattice::Evaluate(MeshBox, Offsets, Closest) - Closest, Tolerance), TEXT("a point outside of the box doesn't move like the closest point of the box"));
+	}
+	const FBox FlatBox(FVector(-50.0, -20.0, 10.0), FVector(50.0, 20.0, 10.0));
+	const FVector FlatPosition = FDeformMeshLattice::Evaluate(FlatBox, Offsets, FVector(0.0, 0.0, 10.0));
+	Checks.Check(!FlatPosition.ContainsNaN() && FlatBox.ExpandBy(1000.0).IsInside(FlatPosition), TEXT("a flat box gives an invalid position"));
+
+	//Random lattices, the points stay in the convex hull of the control points, and the shader sees the same deformation
+	FVector4f GPUData[FDeformMeshLattice::GPUStride];
+	for (int32 LatticeIndex = 0; LatticeIndex < 16; LatticeIndex++)
+	{
+		for (FVector3f& Offset : Offsets)
+		{
+			Offset = FVector3f(Random.GetUnitVector() * Random.FRandRange(0.0f, 40.0f));
+		}
+		const FBox DeformedBox = FDeformMeshLattice::GetDeformedBox(MeshBox, Offsets).ExpandBy(Tolerance);
+		FDeformMeshLattice::WriteGPUData(MeshBox, Offsets, GPUData);
+		for (int32 PointIndex = 0; PointIndex < NumPoints; PointIndex++)
+		{
+			const FVector Position = RandomPointInBox(MeshBox);
+			const FVector Deformed = FDeformMeshLattice::Evaluate(MeshBox, Offsets, Position);
+			Checks.Check(DeformedBox.IsInsideOrOn(Deformed), TEXT("a deformed point is outside of the deformed box"));
+			Checks.Check(FVector(EvaluateGPUData(GPUData, FVector3f(Position))).Equals(Deformed, 1e-3), TEXT("the GPU data doesn't give the deformation of the CPU reference"));
+		}
+	}
+
+	Checks.Report();
+}
+
+static FAutoConsoleCommand TestLatticeCommand(
+	TEXT("DeformMesh.TestLattice"),
+	TEXT("Checks the CPU reference evaluator of the lattice, and the GPU data the vertex factory reads. Usage: DeformMesh.TestLattice [NumPoints=1000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&TestLattice));
+#endif
@@ -5,6 +5,7 @@
 #include "Misc/Paths.h"
 #include "GlobalShader.h"
 #include "Interfaces/IPluginManager.h"
+#include "DeformMeshResourceCache.h"
 
 IMPLEMENT_GAME_MODULE( FDeformMeshModule, DeformMesh);
 
@@ -14,9 +15,12 @@ void FDeformMeshModule::StartupModule()
 	// Maps virtual shader source directory to actual shaders directory on disk.
 	FString ShaderDirectory = FPaths::Combine(IPluginManager::Get().FindPlugin(TEXT("DeformMesh"))->GetBaseDir(), TEXT("Shaders/Private"));
 	AddShaderSourceDirectoryMapping("/CustomShaders", ShaderDirectory);
+
+	FDeformMeshResourceCache::Get().Startup();
 }
 
 void FDeformMeshModule::ShutdownModule()
 {
+	FDeformMeshResourceCache::Get().Shutdown();
 }
 
@@ -0,0 +1,91 @@
+#include "DeformMeshRayTracing.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+
+void FDeformMeshRayTracing::GatherInstances(TArrayView<const FDeformMeshRayTracingSection> Sections, const FMatrix& LocalToWorld, TArray<FDeformMeshRayTracingInstanceDesc>& OutInstances)
+{
+	OutInstances.Reset();
+	for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+	{
+		const FDeformMeshRayTracingSection& Section = Sections[SectionIndex];
+		if (!Section.bVisible || (!Section.bHasStaticGeometry && !Section.bHasCachedGeometry))
+		{
+			continue;
+		}
+
+		//The acceleration structures can't invert a singular instance transform, and such a section has no area anyway
+		const FMatrix SectionLocalToWorld = FMatrix(Section.DeformTransform.GetTransposed()) * LocalToWorld;
+		if (FMath::IsNearlyZero(SectionLocalToWorld.Determinant(), UE_SMALL_NUMBER))
+		{
+			continue;
+		}
+
+		FDeformMeshRayTracingInstanceDesc& Instance = OutInstances.AddDefaulted_GetRef();
+		Instance.SectionIndex = SectionIndex;
+		Instance.LODIndex = Section.LODIndex;
+		Instance.Mode = Section.bHasCachedGeometry ? EDeformMeshRayTracingMode::Cached : EDeformMeshRayTracingMode::Rigid;
+		Instance.InstanceToWorld = Section.bHasCachedGeometry ? LocalToWorld : SectionLocalToWorld;
+		Instance.ShadingLocalToWorld = SectionLocalToWorld;
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshRayTracing, Log, All);
+
+/*
+ * Checks the instances gathered for a few sections against the transforms they should have
+ * Usage: DeformMesh.TestRayTracingGather
+*/
+static void TestRayTracingGather()
+{
+	const FMatrix LocalToWorld = FTransform(FQuat(FVector::UpVector, UE_HALF_PI), FVector(100.0, 0.0, 0.0), FVector(2.0)).ToMatrixWithScale();
+	const FTransform Deform(FQuat(FVector::ForwardVector, 0.5), FVector(0.0, 50.0, 0.0), FVector(1.0, 3.0, 1.0));
+	const FMatrix44f DeformTransform = FMatrix44f(Deform.ToMatrixWithScale().GetTransposed());
+
+	TArray<FDeformMeshRayTracingSection> Sections;
+	Sections.SetNum(6);
+	//0 rigid, 1 cached, 2 hidden, 3 without any geometry, 4 scaled to nothing, 5 cached without the static geometry
+	for (FDeformMeshRayTracingSection& Section : Sections)
+	{
+		Section.DeformTransform = DeformTransform;
+		Section.LODIndex = 1;
+		Section.bVisible = true;
+		Section.bHasStaticGeometry = true;
+	}
+	Sections[1].bHasCachedGeometry = true;
+	Sections[2].bVisible = false;
+	Sections[3].bHasStaticGeometry = false;
+	Sections[4].DeformTransform = FMatrix44f(FScaleMatrix(FVector(1.0, 0.0, 1.0)).GetTransposed());
+	Sections[5].bHasStaticGeometry = false;
+	Sections[5].bHasCachedGeometry = true;
+
+	TArray<FDeformMeshRayTracingInstanceDesc> Instances;
+	FDeformMeshRayTracing::GatherInstances(Sections, LocalToWorld, Instances);
+
+	FDeformMeshTestChecks Checks(LogDeformMeshRayTracing, TEXT("Ray tracing gather"));
+
+	Checks.Check(Instances.Num() == 3, TEXT("expected the rigid and the two cached sections only"));
+	if (Instances.Num() == 3)
+	{
+		//A point of the mesh must end up where the vertex factory would draw it: deformed, then moved by the primitive
+		const FVector MeshPoint(10.0, 20.0, 30.0);
+		const FVector Expected = LocalToWorld.TransformPosition(Deform.TransformPosition(MeshPoint));
+		const FVector Deformed = Deform.TransformPosition(MeshPoint);
+
+		Checks.Check(Instances[0].SectionIndex == 0 && Instances[0].Mode == EDeformMeshRayTracingMode::Rigid, TEXT("section 0 should be rigid"));
+		Checks.Check(Instances[0].InstanceToWorld.TransformPosition(MeshPoint).Equals(Expected, 0.01), TEXT("the rigid instance transform doesn't include the deform transform"));
+		Checks.Check(Instances[1].SectionIndex == 1 && Instances[1].Mode == EDeformMeshRayTracingMode::Cached, TEXT("section 1 should be cached"));
+		Checks.Check(Instances[1].InstanceToWorld.TransformPosition(Deformed).Equals(Expected, 0.01), TEXT("the cached instance transform must not deform the cached positions again"));
+		Checks.Check(Instances[1].ShadingLocalToWorld.TransformPosition(MeshPoint).Equals(Expected, 0.01), TEXT("the cached shading transform doesn't include the deform transform"));
+		Checks.Check(Instances[2].SectionIndex == 5 && Instances[2].Mode == EDeformMeshRayTracingMode::Cached, TEXT("section 5 should be cached"));
+		Checks.Check(Instances[0].LODIndex == 1, TEXT("the LOD of the section isn't kept"));
+	}
+
+	Checks.Report();
+}
+
+static FAutoConsoleCommand TestRayTracingGatherCommand(
+	TEXT("DeformMesh.TestRayTracingGather"),
+	TEXT("Checks the ray tracing instances gathered for the sections of a deform mesh. Usage: DeformMesh.TestRayTracingGather"),
+	FConsoleCommandDelegate::CreateStatic(&TestRayTracingGather));
+#endif
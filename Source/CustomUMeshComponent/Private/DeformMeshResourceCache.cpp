@@ -0,0 +1,442 @@
+#include "DeformMeshResourceCache.h"
+#include "Engine/StaticMesh.h"
+#include "StaticMeshResources.h"
+#include "RenderingThread.h"
+#include "Misc/CoreDelegates.h"
+#if WITH_EDITOR
+#include "DeformMeshComponent.h"
+#include "UObject/UObjectIterator.h"
+#include "Async/Async.h"
+#endif
+
+/* Helper function that initializes a render resource if it's not initialized, or updates it otherwise*/
+static inline void InitOrUpdateResource(FRenderResource* Resource)
+{
+	if (!Resource->IsInitialized())
+	{
+		Resource->InitResource();
+	}
+	else
+	{
+		Resource->UpdateRHI();
+	}
+}
+
+/*
+ * Helper function that binds the static mesh vertex buffers to the vertex factory
+ * The static mesh already initialized its vertex buffers, so we only create the vertex streams that we're interested in, we never modify or re-upload the static mesh data
+*/
+static void InitVertexFactoryData_RenderThread(FLocalVertexFactory* VertexFactory, const FStaticMeshVertexBuffers* VertexBuffers)
+{
+	check(IsInRenderingThread());
+	int LightMapIndex = 0;
+
+	//Use the RHI vertex buffers to create the needed Vertex stream components in an FDataType instance, and then set it as the data of the vertex factory
+	FLocalVertexFactory::FDataType Data;
+	VertexBuffers->PositionVertexBuffer.BindPositionVertexBuffer(VertexFactory, Data);
+	VertexBuffers->StaticMeshVertexBuffer.BindTangentVertexBuffer(VertexFactory, Data);
+	VertexBuffers->StaticMeshVertexBuffer.BindPackedTexCoordVertexBuffer(VertexFactory, Data);
+	VertexBuffers->StaticMeshVertexBuffer.BindLightMapVertexBuffer(VertexFactory, Data, LightMapIndex);
+	VertexBuffers->ColorVertexBuffer.BindColorVertexBuffer(VertexFactory, Data);
+	VertexFactory->SetData(Data);
+
+	//Initalize the vertex factory using the data that we just set, this will call the InitRHI() method that we implemented in out vertex factory
+	InitOrUpdateResource(VertexFactory);
+}
+
+/* Whether the static mesh finished initializing the buffers of this LOD, it can still be doing it when the mesh was just loaded or built */
+static bool AreStaticMeshBuffersInitialized(const FDeformMeshLODResources& LODResources)
+{
+	return LODResources.VertexBuffers->PositionVertexBuffer.IsInitialized()
+		&& LODResources.VertexBuffers->StaticMeshVertexBuffer.IsInitialized()
+		&& LODResources.IndexBuffer->IsInitialized();
+}
+
+/* Points the resources of a LOD to the buffers of the static mesh render data, the vertex factories are initialized separately */
+static void BindLOD(FDeformMeshLODResources& LODResources, const FStaticMeshRenderData& RenderData, int32 LODIndex)
+{
+	const FStaticMeshLODResources& LODResource = RenderData.LODResources[LODIndex];
+	LODResources.VertexBuffers = &LODResource.VertexBuffers;
+	LODResources.IndexBuffer = &LODResource.IndexBuffer;
+	LODResources.NumIndices = LODResource.IndexBuffer.GetNumIndices();
+	LODResources.MaxVertexIndex = LODResource.VertexBuffers.PositionVertexBuffer.GetNumVertices() - 1;
+	LODResources.StaticVertexFactory = &RenderData.LODVertexFactories[LODIndex].VertexFactory;
+#if RHI_RAYTRACING
+	LODResources.RayTracingGeometry = &LODResource.RayTracingGeometry;
+#endif
+	LODResources.Sections.Reset();
+	for (const FStaticMeshSection& StaticMeshSection : LODResource.Sections)
+	{
+		if (StaticMeshSection.NumTriangles > 0)
+		{
+			LODResources.Sections.Add({ StaticMeshSection.MaterialIndex, StaticMeshSection.FirstIndex, StaticMeshSection.NumTriangles, StaticMeshSection.MinVertexIndex, StaticMeshSection.MaxVertexIndex, StaticMeshSection.bCastShadow });
+		}
+	}
+}
+
+/* Releases the vertex factories of a LOD and forgets its buffers, once the LOD is streamed out */
+static void UnbindLOD_RenderThread(FDeformMeshLODResources& LODResources)
+{
+	check(IsInRenderingThread());
+	LODResources.VertexFactory.ReleaseResource();
+	LODResources.CachedVertexFactory.ReleaseResource();
+	LODResources.VertexBuffers = nullptr;
+	LODResources.IndexBuffer = nullptr;
+	LODResources.NumIndices = 0;
+	LODResources.MaxVertexIndex = 0;
+	LODResources.StaticVertexFactory = nullptr;
+#if RHI_RAYTRACING
+	LODResources.RayTracingGeometry = nullptr;
+#endif
+	LODResources.Sections.Reset();
+}
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Resource Cache Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+FDeformMeshResourceCache& FDeformMeshResourceCache::Get()
+{
+	static FDeformMeshResourceCache Instance;
+	return Instance;
+}
+
+FDeformMeshRenderResources* FDeformMeshResourceCache::Acquire(UStaticMesh* StaticMesh, ERHIFeatureLevel::Type FeatureLevel)
+{
+	check(StaticMesh);
+	FStaticMeshRenderData* RenderData = StaticMesh->GetRenderData();
+	check(RenderData && RenderData->LODResources.Num() > 0);
+
+	FScopeLock Lock(&CacheLock);
+
+	const FKey Key{ StaticMesh, FeatureLevel };
+	if (FDeformMeshRenderResources** Found = Entries.Find(Key))
+	{
+		if ((*Found)->RenderData == RenderData)
+		{
+			(*Found)->NumReferences++;
+			return *Found;
+		}
+
+		//The static mesh has new render data, new proxies get a new entry
+		//In the editor the proxies using the old entry were destroyed before the old render data was released (see BeginStaticMeshChange), they've released it or are about to
+		Entries.Remove(Key);
+	}
+
+	FDeformMeshRenderResources* Resources = new FDeformMeshRenderResources(FeatureLevel);
+	Resources->StaticMesh = StaticMesh;
+	Resources->RenderData = RenderData;
+	Resources->NumReferences = 1;
+
+	//Bind every LOD that is streamed in, the LOD drawn by each section is picked per view by the scene proxy
+	Resources->FirstLOD = FMath::Clamp<int32>(RenderData->CurrentFirstLODIdx, 0, RenderData->LODResources.Num() - 1);
+	for (int32 LODIndex = 0; LODIndex < RenderData->LODResources.Num(); LODIndex++)
+	{
+		FDeformMeshLODResources* LODResources = new FDeformMeshLODResources(FeatureLevel);
+		Resources->LODs.Add(LODResources);
+		Resources->LODScreenSizes.Add(RenderData->ScreenSize[LODIndex].GetValue());
+
+		if (LODIndex >= Resources->FirstLOD)
+		{
+			BindLOD(*LODResources, *RenderData, LODIndex);
+		}
+	}
+
+	Entries.Add(Key, Resources);
+#if WITH_EDITOR
+	WatchStaticMesh(StaticMesh);
+#endif
+
+	//The vertex factories are initialized later on the render thread (see InitPendingResources_RenderThread), the sections using them are hidden until then
+	ENQUEUE_RENDER_COMMAND(DeformMeshRenderResourcesQueue)(
+		[this, Resources](FRHICommandListImmediate& RHICmdList)
+		{
+			PendingResources.Add(Resources);
+			LiveResources.Add(Resources);
+		});
+	return Resources;
+}
+
+void FDeformMeshResourceCache::Release(FDeformMeshRenderResources* Resources)
+{
+	check(Resources);
+	{
+		FScopeLock Lock(&CacheLock);
+
+		check(Resources->NumReferences > 0);
+		if (--Resources->NumReferences > 0)
+		{
+			return;
+		}
+
+		//Only remove the entry if it wasn't already replaced by a newer one for a rebuilt static mesh
+		const FKey Key{ Resources->StaticMesh, Resources->FeatureLevel };
+		FDeformMeshRenderResources** Found = Entries.Find(Key);
+		if (Found && *Found == Resources)
+		{
+			Entries.Remove(Key);
+		}
+	}
+
+	//This has to happen on the render thread since the renderer might still be using the resources until then
+	if (IsInRenderingThread())
+	{
+		ReleaseResources_RenderThread(Resources);
+	}
+	else
+	{
+		ENQUEUE_RENDER_COMMAND(DeformMeshRenderResourcesRelease)(
+			[this, Resources](FRHICommandListImmediate& RHICmdList)
+			{
+				ReleaseResources_RenderThread(Resources);
+			});
+	}
+}
+
+void FDeformMeshResourceCache::ReleaseResources_RenderThread(FDeformMeshRenderResources* Resources)
+{
+	check(IsInRenderingThread());
+	//The resources can be released before they were ever initialized
+	PendingResources.Remove(Resources);
+	LiveResources.RemoveSwap(Resources);
+
+	for (FDeformMeshLODResources& LODResources : Resources->LODs)
+	{
+		LODResources.VertexFactory.ReleaseResource();
+		LODResources.CachedVertexFactory.ReleaseResource();
+	}
+	delete Resources;
+}
+
+void FDeformMeshResourceCache::Startup()
+{
+	BeginFrameHandle = FCoreDelegates::OnBeginFrameRT.AddRaw(this, &FDeformMeshResourceCache::OnBeginFrame_RenderThread);
+
+#if WITH_EDITOR
+	//Property edits release the render data in PreEditChange, after the pre edit delegate is broadcast
+	PreObjectPropertyChangedHandle = FCoreUObjectDelegates::OnPreObjectPropertyChanged.AddLambda([this](UObject* Object, const FEditPropertyChain& PropertyChain)
+		{
+			UStaticMesh* StaticMesh = Cast<UStaticMesh>(Object);
+			if (StaticMesh != nullptr && WatchedStaticMeshes.Contains(StaticMesh))
+			{
+				BeginStaticMeshChange(StaticMesh);
+			}
+		});
+	ObjectPropertyChangedHandle = FCoreUObjectDelegates::OnObjectPropertyChanged.AddLambda([this](UObject* Object, FPropertyChangedEvent& PropertyChangedEvent)
+		{
+			UStaticMesh* StaticMesh = Cast<UStaticMesh>(Object);
+			if (StaticMesh != nullptr && StaticMeshChanges.Contains(StaticMesh))
+			{
+				EndStaticMeshChange(StaticMesh);
+			}
+		});
+#endif
+}
+
+void FDeformMeshResourceCache::Shutdown()
+{
+	FCoreDelegates::OnBeginFrameRT.Remove(BeginFrameHandle);
+	BeginFrameHandle.Reset();
+
+#if WITH_EDITOR
+	FCoreUObjectDelegates::OnPreObjectPropertyChanged.Remove(PreObjectPropertyChangedHandle);
+	FCoreUObjectDelegates::OnObjectPropertyChanged.Remove(ObjectPropertyChangedHandle);
+	for (const TWeakObjectPtr<UStaticMesh>& WeakStaticMesh : WatchedStaticMeshes)
+	{
+		if (UStaticMesh* StaticMesh = WeakStaticMesh.Get())
+		{
+			StaticMesh->OnPreMeshBuild().RemoveAll(this);
+			StaticMesh->OnPostMeshBuild().RemoveAll(this);
+		}
+	}
+	WatchedStaticMeshes.Empty();
+	StaticMeshChanges.Empty();
+#endif
+}
+
+void FDeformMeshResourceCache::OnBeginFrame_RenderThread()
+{
+	UpdateStreamedLODs_RenderThread();
+	InitPendingResources_RenderThread();
+}
+
+void FDeformMeshResourceCache::UpdateStreamedLODs_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	for (FDeformMeshRenderResources* Resources : LiveResources)
+	{
+		const int32 NewFirstLOD = FMath::Clamp<int32>(Resources->RenderData->CurrentFirstLODIdx, 0, Resources->LODs.Num() - 1);
+		if (NewFirstLOD == Resources->FirstLOD)
+		{
+			continue;
+		}
+
+		//The streamer lowers CurrentFirstLODIdx once the new LODs are initialized, this only waits if that ever changes
+		bool bStreamedInReady = true;
+		for (int32 LODIndex = NewFirstLOD; LODIndex < Resources->FirstLOD; LODIndex++)
+		{
+			const FStaticMeshLODResources& LODResource = Resources->RenderData->LODResources[LODIndex];
+			bStreamedInReady &= LODResource.VertexBuffers.PositionVertexBuffer.IsInitialized() && LODResource.VertexBuffers.StaticMeshVertexBuffer.IsInitialized() && LODResource.IndexBuffer.IsInitialized();
+		}
+		if (!bStreamedInReady)
+		{
+			continue;
+		}
+
+		const int32 OldFirstLOD = Resources->FirstLOD;
+		for (int32 LODIndex = NewFirstLOD; LODIndex < OldFirstLOD; LODIndex++)
+		{
+			FDeformMeshLODResources& LODResources = Resources->LODs[LODIndex];
+			BindLOD(LODResources, *Resources->RenderData, LODIndex);
+			//Resources that are still pending get these LODs initialized with the others
+			if (Resources->bInitialized)
+			{
+				InitVertexFactoryData_RenderThread(&LODResources.VertexFactory, LODResources.VertexBuffers);
+				if (Resources->FeatureLevel >= ERHIFeatureLevel::SM5)
+				{
+					InitVertexFactoryData_RenderThread(&LODResources.CachedVertexFactory, LODResources.VertexBuffers);
+				}
+			}
+		}
+		Resources->FirstLOD = NewFirstLOD;
+
+		//The proxies move their caches and cached draws off the streamed out LODs before their vertex factories are released
+		OnResourcesFirstLODChanged_RenderThread.Broadcast(Resources);
+		for (int32 LODIndex = OldFirstLOD; LODIndex < NewFirstLOD; LODIndex++)
+		{
+			UnbindLOD_RenderThread(Resources->LODs[LODIndex]);
+		}
+	}
+}
+
+#if WITH_EDITOR
+void FDeformMeshResourceCache::WatchStaticMesh(UStaticMesh* StaticMesh)
+{
+	//The proxies are created on the game thread, the delegates of the static mesh can only be bound there
+	if (!IsInGameThread())
+	{
+		AsyncTask(ENamedThreads::GameThread, [this, WeakStaticMesh = TWeakObjectPtr<UStaticMesh>(StaticMesh)]()
+			{
+				if (UStaticMesh* GameThreadStaticMesh = WeakStaticMesh.Get())
+				{
+					WatchStaticMesh(GameThreadStaticMesh);
+				}
+			});
+		return;
+	}
+
+	bool bAlreadyWatched = false;
+	WatchedStaticMeshes.Add(StaticMesh, &bAlreadyWatched);
+	if (!bAlreadyWatched)
+	{
+		StaticMesh->OnPreMeshBuild().AddRaw(this, &FDeformMeshResourceCache::BeginStaticMeshChange);
+		StaticMesh->OnPostMeshBuild().AddRaw(this, &FDeformMeshResourceCache::EndStaticMeshChange);
+	}
+}
+
+void FDeformMeshResourceCache::BeginStaticMeshChange(UStaticMesh* StaticMesh)
+{
+	check(IsInGameThread());
+	FStaticMeshChange& Change = StaticMeshChanges.FindOrAdd(StaticMesh);
+	if (Change.Depth++ > 0)
+	{
+		return;
+	}
+
+	//The proxies are destroyed by render commands queued before the ones releasing the render data, so they release their resources first
+	for (TObjectIterator<UDeformMeshComponent> It; It; ++It)
+	{
+		UDeformMeshComponent* Component = *It;
+		if (Component->SceneProxy == nullptr)
+		{
+			continue;
+		}
+		for (int32 SectionIndex = 0; SectionIndex < Component->GetNumSections(); SectionIndex++)
+		{
+			if (Component->GetDeformMeshSection(SectionIndex)->StaticMesh == StaticMesh)
+			{
+				Change.RecreateContexts.Add(MakeUnique<FComponentRecreateRenderStateContext>(Component));
+				break;
+			}
+		}
+	}
+}
+
+void FDeformMeshResourceCache::EndStaticMeshChange(UStaticMesh* StaticMesh)
+{
+	check(IsInGameThread());
+	FStaticMeshChange* Change = StaticMeshChanges.Find(StaticMesh);
+	if (Change != nullptr && --Change->Depth == 0)
+	{
+		//Destroying the contexts recreates the render state of the components, from the new render data
+		StaticMeshChanges.Remove(StaticMesh);
+	}
+}
+#endif
+
+void FDeformMeshResourceCache::InitPendingResources_RenderThread()
+{
+	check(IsInRenderingThread());
+
+	int32 NumInitsLeft = MaxVertexFactoryInitsPerFrame;
+	for (int32 PendingIndex = 0; PendingIndex < PendingResources.Num() && NumInitsLeft > 0;)
+	{
+		FDeformMeshRenderResources* Resources = PendingResources[PendingIndex];
+
+		//A resource can take several frames, the LODs that are already initialized are skipped
+		bool bAllLODsInitialized = true;
+		for (int32 LODIndex = Resources->FirstLOD; LODIndex < Resources->LODs.Num(); LODIndex++)
+		{
+			FDeformMeshLODResources& LODResources = Resources->LODs[LODIndex];
+			if (LODResources.VertexFactory.IsInitialized())
+			{
+				continue;
+			}
+
+			if (NumInitsLeft == 0 || !AreStaticMeshBuffersInitialized(LODResources))
+			{
+				bAllLODsInitialized = false;
+				continue;
+			}
+
+			InitVertexFactoryData_RenderThread(&LODResources.VertexFactory, LODResources.VertexBuffers);
+			if (Resources->FeatureLevel >= ERHIFeatureLevel::SM5)
+			{
+				InitVertexFactoryData_RenderThread(&LODResources.CachedVertexFactory, LODResources.VertexBuffers);
+			}
+			NumInitsLeft--;
+		}
+
+		if (bAllLODsInitialized)
+		{
+			Resources->bInitialized = true;
+			PendingResources.RemoveAt(PendingIndex);
+			OnResourcesInitialized_RenderThread.Broadcast(Resources);
+		}
+		else
+		{
+			PendingIndex++;
+		}
+	}
+}
+
+int32 FDeformMeshResourceCache::GetNum() const
+{
+	FScopeLock Lock(&CacheLock);
+	return Entries.Num();
+}
+
+SIZE_T FDeformMeshResourceCache::GetAllocatedSize() const
+{
+	FScopeLock Lock(&CacheLock);
+	SIZE_T Size = Entries.GetAllocatedSize() + Entries.Num() * sizeof(FDeformMeshRenderResources);
+	for (const TPair<FKey, FDeformMeshRenderResources*>& Entry : Entries)
+	{
+		Size += Entry.Value->LODs.GetAllocatedSize() + Entry.Value->LODs.Num() * sizeof(FDeformMeshLODResources) + Entry.Value->LODScreenSizes.GetAllocatedSize();
+		for (const FDeformMeshLODResources& LODResources : Entry.Value->LODs)
+		{
+			Size += LODResources.Sections.GetAllocatedSize();
+		}
+	}
+	return Size;
+}
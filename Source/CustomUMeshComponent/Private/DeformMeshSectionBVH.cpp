@@ -0,0 +1,383 @@
+#include "DeformMeshSectionBVH.h"
+#include "Algo/Sort.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+void FDeformMeshSectionBVH::Build(TArrayView<const FBox> InItemBoxes)
+{
+	Reset();
+	ItemBoxes.Append(InItemBoxes.GetData(), InItemBoxes.Num());
+	ItemLeaves.Init(INDEX_NONE, ItemBoxes.Num());
+	if (ItemBoxes.Num() == 0)
+	{
+		return;
+	}
+
+	//The sections are split by the position of their centers, the cleared ones end up around the origin
+	TArray<FVector> Centers;
+	Centers.Reserve(ItemBoxes.Num());
+	LeafItems.Reserve(ItemBoxes.Num());
+	for (int32 Item = 0; Item < ItemBoxes.Num(); Item++)
+	{
+		Centers.Add(ItemBoxes[Item].IsValid ? ItemBoxes[Item].GetCenter() : FVector::ZeroVector);
+		LeafItems.Add(Item);
+	}
+
+	//Median splits leave more than MaxLeafSize / 2 sections per leaf, so less than 2 * N / MaxLeafSize leaves and twice as many nodes
+	Nodes.Reserve(4 * ItemBoxes.Num() / MaxLeafSize + 1);
+	NodeParents.Reserve(Nodes.Max());
+	Nodes.AddDefaulted();
+	NodeParents.Add(INDEX_NONE);
+	BuildNode(0, 0, ItemBoxes.Num(), Centers);
+
+	RefitAll();
+}
+
+void FDeformMeshSectionBVH::BuildNode(int32 NodeIndex, int32 Begin, int32 End, TArray<FVector>& Centers)
+{
+	const int32 Count = End - Begin;
+	if (Count <= MaxLeafSize)
+	{
+		Nodes[NodeIndex].First = Begin;
+		Nodes[NodeIndex].NumItems = Count;
+		for (int32 LeafItemIndex = Begin; LeafItemIndex < End; LeafItemIndex++)
+		{
+			ItemLeaves[LeafItems[LeafItemIndex]] = NodeIndex;
+		}
+		return;
+	}
+
+	FBox CenterBox(ForceInit);
+	for (int32 LeafItemIndex = Begin; LeafItemIndex < End; LeafItemIndex++)
+	{
+		CenterBox += Centers[LeafItems[LeafItemIndex]];
+	}
+	const FVector Extent = CenterBox.GetExtent();
+	const int32 Axis = (Extent.X >= Extent.Y && Extent.X >= Extent.Z) ? 0 : (Extent.Y >= Extent.Z ? 1 : 2);
+
+	//Median split, both children get the same number of sections so the depth stays log2(N / MaxLeafSize)
+	Algo::Sort(MakeArrayView(&LeafItems[Begin], Count), [&Centers, Axis](int32 A, int32 B)
+		{
+			return Centers[A][Axis] < Centers[B][Axis];
+		});
+	const int32 Middle = Begin + Count / 2;
+
+	const int32 FirstChild = Nodes.Num();
+	Nodes.AddDefaulted(2);
+	NodeParents.Add(NodeIndex);
+	NodeParents.Add(NodeIndex);
+	Nodes[NodeIndex].First = FirstChild;
+	Nodes[NodeIndex].NumItems = 0;
+
+	BuildNode(FirstChild, Begin, Middle, Centers);
+	BuildNode(FirstChild + 1, Middle, End, Centers);
+}
+
+void FDeformMeshSectionBVH::Reset()
+{
+	Nodes.Reset();
+	NodeParents.Reset();
+	ItemBoxes.Reset();
+	LeafItems.Reset();
+	ItemLeaves.Reset();
+}
+
+void FDeformMeshSectionBVH::RefitNode(int32 NodeIndex)
+{
+	FNode& Node = Nodes[NodeIndex];
+	if (Node.NumItems > 0)
+	{
+		//Invalid boxes are ignored by the union
+		Node.Box.Init();
+		for (int32 LeafItemIndex = Node.First; LeafItemIndex < Node.First + Node.NumItems; LeafItemIndex++)
+		{
+			Node.Box += ItemBoxes[LeafItems[LeafItemIndex]];
+		}
+	}
+	else
+	{
+		Node.Box = Nodes[Node.First].Box + Nodes[Node.First + 1].Box;
+	}
+}
+
+void FDeformMeshSectionBVH::RefitAll()
+{
+	//The children come after their parent, so going backwards computes every child before its parent
+	for (int32 NodeIndex = Nodes.Num() - 1; NodeIndex >= 0; NodeIndex--)
+	{
+		RefitNode(NodeIndex);
+	}
+}
+
+void FDeformMeshSectionBVH::Refit(TArrayView<const int32> Items, TArrayView<const FBox> Boxes)
+{
+	check(Items.Num() == Boxes.Num());
+	for (int32 UpdateIndex = 0; UpdateIndex < Items.Num(); UpdateIndex++)
+	{
+		ItemBoxes[Items[UpdateIndex]] = Boxes[UpdateIndex];
+	}
+
+	if (Items.Num() > Num() * FullRefitRatio)
+	{
+		RefitAll();
+		return;
+	}
+
+	for (const int32 Item : Items)
+	{
+		for (int32 NodeIndex = ItemLeaves[Item]; NodeIndex != INDEX_NONE; NodeIndex = NodeParents[NodeIndex])
+		{
+			RefitNode(NodeIndex);
+		}
+	}
+}
+
+int32 FDeformMeshSectionBVH::Raycast(const FVector& Start, const FVector& End, TFunctionRef<bool(int32 Item, double& InOutTime)> HitItem) const
+{
+	const FVector Delta = End - Start;
+	double BestTime = 1.0;
+	int32 BestItem = INDEX_NONE;
+
+	struct FStackEntry
+	{
+		int32 NodeIndex;
+		double Time;
+	};
+	TArray<FStackEntry, TInlineAllocator<64>> Stack;
+
+	double RootTime;
+	if (Nodes.Num() == 0 || !IntersectSegmentBox(Start, Delta, Nodes[0].Box, BestTime, RootTime))
+	{
+		return INDEX_NONE;
+	}
+	Stack.Add({ 0, RootTime });
+
+	while (Stack.Num() > 0)
+	{
+		const FStackEntry Entry = Stack.Pop(false);
+		//A closer section was hit since this node was pushed
+		if (Entry.Time > BestTime)
+		{
+			continue;
+		}
+
+		const FNode& Node = Nodes[Entry.NodeIndex];
+		if (Node.NumItems > 0)
+		{
+			for (int32 LeafItemIndex = Node.First; LeafItemIndex < Node.First + Node.NumItems; LeafItemIndex++)
+			{
+				const int32 Item = LeafItems[LeafItemIndex];
+				double ItemTime;
+				if (IntersectSegmentBox(Start, Delta, ItemBoxes[Item], BestTime, ItemTime) && HitItem(Item, BestTime))
+				{
+					BestItem = Item;
+				}
+			}
+			continue;
+		}
+
+		double Times[2];
+		const bool bHits[2] = {
+			IntersectSegmentBox(Start, Delta, Nodes[Node.First].Box, BestTime, Times[0]),
+			IntersectSegmentBox(Start, Delta, Nodes[Node.First + 1].Box, BestTime, Times[1]) };
+
+		//The closest child is pushed last so it's visited first
+		const int32 Near = (bHits[0] && bHits[1]) ? (Times[0] <= Times[1] ? 0 : 1) : (bHits[0] ? 0 : 1);
+		const int32 Far = 1 - Near;
+		if (bHits[Far])
+		{
+			Stack.Add({ Node.First + Far, Times[Far] });
+		}
+		if (bHits[Near])
+		{
+			Stack.Add({ Node.First + Near, Times[Near] });
+		}
+	}
+	return BestItem;
+}
+
+bool FDeformMeshSectionBVH::IntersectSegmentBox(const FVector& Start, const FVector& Delta, const FBox& Box, double MaxTime, double& OutTime, FVector* OutNormal)
+{
+	if (!Box.IsValid)
+	{
+		return false;
+	}
+
+	//Slab test, the entry time is the latest entry over the 3 axes and the exit time the earliest exit
+	double EntryTime = 0.0;
+	double ExitTime = MaxTime;
+	int32 EntryAxis = INDEX_NONE;
+	double EntrySign = 0.0;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		if (FMath::Abs(Delta[Axis]) < UE_SMALL_NUMBER)
+		{
+			//Parallel to the slab, the segment has to be between its planes
+			if (Start[Axis] < Box.Min[Axis] || Start[Axis] > Box.Max[Axis])
+			{
+				return false;
+			}
+			continue;
+		}
+
+		const double InvDelta = 1.0 / Delta[Axis];
+		double SlabEntry = (Box.Min[Axis] - Start[Axis]) * InvDelta;
+		double SlabExit = (Box.Max[Axis] - Start[Axis]) * InvDelta;
+		double Sign = -1.0;
+		if (SlabEntry > SlabExit)
+		{
+			Swap(SlabEntry, SlabExit);
+			Sign = 1.0;
+		}
+
+		if (SlabEntry > EntryTime)
+		{
+			EntryTime = SlabEntry;
+			EntryAxis = Axis;
+			EntrySign = Sign;
+		}
+		ExitTime = FMath::Min(ExitTime, SlabExit);
+		if (EntryTime > ExitTime)
+		{
+			return false;
+		}
+	}
+
+	OutTime = EntryTime;
+	if (OutNormal != nullptr)
+	{
+		//Starting inside the box, the normal faces back along the segment like the initial overlaps of the engine traces
+		*OutNormal = -Delta.GetSafeNormal();
+		if (EntryAxis != INDEX_NONE)
+		{
+			*OutNormal = FVector::ZeroVector;
+			(*OutNormal)[EntryAxis] = EntrySign;
+		}
+	}
+	return true;
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshBVH, Log, All);
+
+/*
+ * Times the build, the refits and the ray queries on random sections, and compares the queries to testing every section
+ * Two sections can be entered at the same time, so the queries are compared by hit time, within a tolerance, and not by section
+ * Usage: DeformMesh.BenchmarkSectionBVH [NumSections=10000] [NumRays=100000]
+*/
+static void BenchmarkSectionBVH(const TArray<FString>& Args)
+{
+	const int32 NumSections = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10000;
+	const int32 NumRays = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 100000;
+	FRandomStream Random(0xDEF0);
+
+	//Sections from 1 to 10 meters scattered in a 100 meters radius, like the pieces of a big destructible structure
+	TArray<FBox> Boxes;
+	Boxes.Reserve(NumSections);
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		const FVector Center = Random.GetUnitVector() * Random.FRandRange(0.0f, 10000.0f);
+		const FVector Extent(Random.FRandRange(50.0f, 500.0f), Random.FRandRange(50.0f, 500.0f), Random.FRandRange(50.0f, 500.0f));
+		Boxes.Add(FBox(Center - Extent, Center + Extent));
+	}
+
+	FDeformMeshSectionBVH BVH;
+	double StartTime = FPlatformTime::Seconds();
+	BVH.Build(Boxes);
+	const double BuildTime = FPlatformTime::Seconds() - StartTime;
+
+	//Every section moves, one pass over all the nodes
+	TArray<int32> AllItems;
+	AllItems.Reserve(NumSections);
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		AllItems.Add(SectionIndex);
+		Boxes[SectionIndex] = Boxes[SectionIndex].ShiftBy(Random.GetUnitVector() * 100.0);
+	}
+	StartTime = FPlatformTime::Seconds();
+	BVH.Refit(AllItems, Boxes);
+	const double FullRefitTime = FPlatformTime::Seconds() - StartTime;
+
+	//1% of the sections move, each one walks up to the root
+	TArray<int32> SomeItems;
+	TArray<FBox> SomeBoxes;
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex += 100)
+	{
+		SomeItems.Add(SectionIndex);
+		Boxes[SectionIndex] = Boxes[SectionIndex].ShiftBy(Random.GetUnitVector() * 100.0);
+		SomeBoxes.Add(Boxes[SectionIndex]);
+	}
+	StartTime = FPlatformTime::Seconds();
+	BVH.Refit(SomeItems, SomeBoxes);
+	const double PartialRefitTime = FPlatformTime::Seconds() - StartTime;
+
+	TArray<FVector> RayStarts;
+	TArray<FVector> RayEnds;
+	for (int32 RayIndex = 0; RayIndex < NumRays; RayIndex++)
+	{
+		RayStarts.Add(Random.GetUnitVector() * 15000.0);
+		RayEnds.Add(Random.GetUnitVector() * 15000.0);
+	}
+
+	TArray<int32> BVHHits;
+	TArray<double> BVHHitTimes;
+	BVHHits.SetNumUninitialized(NumRays);
+	BVHHitTimes.SetNumUninitialized(NumRays);
+	StartTime = FPlatformTime::Seconds();
+	for (int32 RayIndex = 0; RayIndex < NumRays; RayIndex++)
+	{
+		const FVector Delta = RayEnds[RayIndex] - RayStarts[RayIndex];
+		double HitTime = 1.0;
+		BVHHits[RayIndex] = BVH.Raycast(RayStarts[RayIndex], RayEnds[RayIndex], [&Boxes, &RayStarts, &Delta, RayIndex, &HitTime](int32 Item, double& InOutTime)
+			{
+				double Time;
+				if (FDeformMeshSectionBVH::IntersectSegmentBox(RayStarts[RayIndex], Delta, Boxes[Item], InOutTime, Time) && Time < InOutTime)
+				{
+					InOutTime = HitTime = Time;
+					return true;
+				}
+				return false;
+			});
+		BVHHitTimes[RayIndex] = HitTime;
+	}
+	const double BVHRaysTime = FPlatformTime::Seconds() - StartTime;
+
+	//Testing every section is slow, it only runs on a part of the rays
+	const int32 NumBruteForceRays = FMath::Min(NumRays, 1000);
+	constexpr double HitTimeTolerance = 1e-9;
+	FDeformMeshTestChecks Checks(LogDeformMeshBVH, TEXT("Section BVH"));
+	StartTime = FPlatformTime::Seconds();
+	for (int32 RayIndex = 0; RayIndex < NumBruteForceRays; RayIndex++)
+	{
+		const FVector Delta = RayEnds[RayIndex] - RayStarts[RayIndex];
+		double BestTime = 1.0;
+		int32 BestItem = INDEX_NONE;
+		for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+		{
+			double Time;
+			if (FDeformMeshSectionBVH::IntersectSegmentBox(RayStarts[RayIndex], Delta, Boxes[SectionIndex], BestTime, Time) && Time < BestTime)
+			{
+				BestTime = Time;
+				BestItem = SectionIndex;
+			}
+		}
+		if (Checks.Check((BestItem == INDEX_NONE) == (BVHHits[RayIndex] == INDEX_NONE), TEXT("ray %d, the BVH found %s hit"), RayIndex, BestItem == INDEX_NONE ? TEXT("a") : TEXT("no")) && BestItem != INDEX_NONE)
+		{
+			Checks.Check(FMath::Abs(BVHHitTimes[RayIndex] - BestTime) <= HitTimeTolerance, TEXT("ray %d, the BVH hit time %.9f isn't the closest one %.9f"), RayIndex, BVHHitTimes[RayIndex], BestTime);
+		}
+	}
+	const double BruteForceRaysTime = FPlatformTime::Seconds() - StartTime;
+
+	UE_LOG(LogDeformMeshBVH, Display, TEXT("Section BVH, %d sections: build %.3f ms, full refit %.3f ms, refit of %d sections %.3f ms"),
+		NumSections, BuildTime * 1000.0, FullRefitTime * 1000.0, SomeItems.Num(), PartialRefitTime * 1000.0);
+	UE_LOG(LogDeformMeshBVH, Display, TEXT("Section BVH, %d rays: %.0f rays/s, every section: %.0f rays/s"),
+		NumRays, NumRays / FMath::Max(BVHRaysTime, UE_SMALL_NUMBER), NumBruteForceRays / FMath::Max(BruteForceRaysTime, UE_SMALL_NUMBER));
+	Checks.Report(FString::Printf(TEXT("%d rays compared to every section"), NumBruteForceRays));
+}
+
+static FAutoConsoleCommand BenchmarkSectionBVHCommand(
+	TEXT("DeformMesh.BenchmarkSectionBVH"),
+	TEXT("Times the deform mesh section BVH build, refits and ray queries, and checks the hits against testing every section. Usage: DeformMesh.BenchmarkSectionBVH [NumSections=10000] [NumRays=100000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkSectionBVH));
+#endif
@@ -0,0 +1,165 @@
+#include "DeformMeshSectionGroups.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+
+void FDeformMeshSectionGroups::Build(TArrayView<const FDeformMeshSectionGroupKey> Sections, TArray<FDeformMeshSectionGroup>& OutGroups, TArray<uint32>& OutInstanceTransformIndices)
+{
+	OutGroups.Reset();
+	OutInstanceTransformIndices.Reset(Sections.Num());
+
+	//First pass, find the group of each section and count the instances of each group
+	TMap<TTuple<const void*, const void*, uint8>, int32> GroupIndices;
+	TArray<int32, TInlineAllocator<64>> SectionGroupIndices;
+	SectionGroupIndices.Init(INDEX_NONE, Sections.Num());
+
+	for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+	{
+		const FDeformMeshSectionGroupKey& Section = Sections[SectionIndex];
+		if (Section.Mesh == nullptr || !Section.bVisible)
+		{
+			continue;
+		}
+
+		const TTuple<const void*, const void*, uint8> Key(Section.Mesh, Section.Material, Section.ShadowMode);
+		int32* GroupIndex = GroupIndices.Find(Key);
+		if (GroupIndex == nullptr)
+		{
+			GroupIndex = &GroupIndices.Add(Key, OutGroups.Num());
+			FDeformMeshSectionGroup& NewGroup = OutGroups.AddDefaulted_GetRef();
+			NewGroup.FirstSection = SectionIndex;
+			NewGroup.FirstInstance = 0;
+			NewGroup.NumInstances = 0;
+		}
+
+		OutGroups[*GroupIndex].NumInstances++;
+		SectionGroupIndices[SectionIndex] = *GroupIndex;
+	}
+
+	//Prefix sum to get the offset of each group
+	int32 NumInstances = 0;
+	for (FDeformMeshSectionGroup& Group : OutGroups)
+	{
+		Group.FirstInstance = NumInstances;
+		NumInstances += Group.NumInstances;
+	}
+
+	//Second pass, scatter the section indices into the ranges of their groups
+	OutInstanceTransformIndices.SetNumUninitialized(NumInstances);
+	TArray<int32, TInlineAllocator<16>> GroupCursors;
+	GroupCursors.SetNumUninitialized(OutGroups.Num());
+	for (int32 GroupIndex = 0; GroupIndex < OutGroups.Num(); GroupIndex++)
+	{
+		GroupCursors[GroupIndex] = OutGroups[GroupIndex].FirstInstance;
+	}
+
+	for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+	{
+		const int32 GroupIndex = SectionGroupIndices[SectionIndex];
+		if (GroupIndex != INDEX_NONE)
+		{
+			OutInstanceTransformIndices[GroupCursors[GroupIndex]++] = (uint32)SectionIndex;
+		}
+	}
+}
+
+void FDeformMeshSectionGroups::BuildInstanceRuns(TArrayView<const FDeformMeshSectionGroup> Groups, TArrayView<const uint32> InstanceTransformIndices, TArray<FDeformMeshInstanceRuns>& OutGroupRuns, TArray<uint32>& OutRuns)
+{
+	OutGroupRuns.Reset(Groups.Num());
+	OutRuns.Reset();
+
+	for (const FDeformMeshSectionGroup& Group : Groups)
+	{
+		FDeformMeshInstanceRuns& GroupRuns = OutGroupRuns.AddDefaulted_GetRef();
+		GroupRuns.FirstRun = OutRuns.Num() / 2;
+		GroupRuns.NumRuns = 0;
+
+		for (int32 InstanceIndex = Group.FirstInstance; InstanceIndex < Group.FirstInstance + Group.NumInstances; InstanceIndex++)
+		{
+			const uint32 SectionIndex = InstanceTransformIndices[InstanceIndex];
+			//Extend the last run of the group when this section follows it
+			if (GroupRuns.NumRuns > 0 && OutRuns.Last() + 1 == SectionIndex)
+			{
+				OutRuns.Last() = SectionIndex;
+				continue;
+			}
+			OutRuns.Add(SectionIndex);
+			OutRuns.Add(SectionIndex);
+			GroupRuns.NumRuns++;
+		}
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshSectionGroups, Log, All);
+
+/*
+ * Groups a few sections and checks the groups, the instance transform indices and the instance runs against the expected ones
+ * Usage: DeformMesh.TestSectionGroups
+*/
+static void TestSectionGroups()
+{
+	//The keys are only compared, any distinct addresses will do
+	const int32 MeshA = 0, MeshB = 0, Material1 = 0, Material2 = 0;
+
+	TArray<FDeformMeshSectionGroupKey> Keys;
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true));		//0
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshB, &Material1, true));		//1, another mesh
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true));		//2
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material2, true));		//3, another material
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, false));	//4, hidden
+	Keys.Add(FDeformMeshSectionGroupKey(nullptr, &Material1, true));	//5, cleared
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true));		//6
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true, 1));	//7, another shadow mode
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true));		//8
+	Keys.Add(FDeformMeshSectionGroupKey(&MeshA, &Material1, true));		//9
+
+	//Filled with garbage, to check that they're reset
+	TArray<FDeformMeshSectionGroup> Groups;
+	Groups.AddZeroed(3);
+	TArray<uint32> Indices = { 42, 42 };
+	FDeformMeshSectionGroups::Build(Keys, Groups, Indices);
+
+	TArray<FDeformMeshInstanceRuns> GroupRuns;
+	TArray<uint32> Runs = { 42 };
+	FDeformMeshSectionGroups::BuildInstanceRuns(Groups, Indices, GroupRuns, Runs);
+
+	FDeformMeshTestChecks Checks(LogDeformMeshSectionGroups, TEXT("Section groups"));
+
+	//The groups come in the order of their first section, each one is a range of the indices
+	const int32 ExpectedGroups[4][3] = { { 0, 0, 5 }, { 1, 5, 1 }, { 3, 6, 1 }, { 7, 7, 1 } };
+	const TArray<uint32> ExpectedIndices = { 0, 2, 6, 8, 9, 1, 3, 7 };
+	Checks.Check(Groups.Num() == 4, TEXT("expected 4 groups"));
+	for (int32 GroupIndex = 0; GroupIndex < FMath::Min(Groups.Num(), 4); GroupIndex++)
+	{
+		const FDeformMeshSectionGroup& Group = Groups[GroupIndex];
+		Checks.Check(Group.FirstSection == ExpectedGroups[GroupIndex][0] && Group.FirstInstance == ExpectedGroups[GroupIndex][1] && Group.NumInstances == ExpectedGroups[GroupIndex][2], TEXT("a group doesn't have the expected range"));
+	}
+	Checks.Check(Indices == ExpectedIndices, TEXT("the instance transform indices aren't the sections of each group in order"));
+
+	//Consecutive sections of a group share a run, 6 and 8 don't since 7 is in another group
+	const int32 ExpectedGroupRuns[4][2] = { { 0, 4 }, { 4, 1 }, { 5, 1 }, { 6, 1 } };
+	const TArray<uint32> ExpectedRuns = { 0, 0, 2, 2, 6, 6, 8, 9, 1, 1, 3, 3, 7, 7 };
+	Checks.Check(GroupRuns.Num() == Groups.Num(), TEXT("expected one set of runs per group"));
+	for (int32 GroupIndex = 0; GroupIndex < FMath::Min(GroupRuns.Num(), 4); GroupIndex++)
+	{
+		Checks.Check(GroupRuns[GroupIndex].FirstRun == ExpectedGroupRuns[GroupIndex][0] && GroupRuns[GroupIndex].NumRuns == ExpectedGroupRuns[GroupIndex][1], TEXT("the runs of a group aren't where expected"));
+	}
+	Checks.Check(Runs == ExpectedRuns, TEXT("the instance runs aren't the expected [First, Last] pairs"));
+
+	//Nothing visible, nothing drawn
+	for (FDeformMeshSectionGroupKey& Key : Keys)
+	{
+		Key.bVisible = false;
+	}
+	FDeformMeshSectionGroups::Build(Keys, Groups, Indices);
+	FDeformMeshSectionGroups::BuildInstanceRuns(Groups, Indices, GroupRuns, Runs);
+	Checks.Check(Groups.Num() == 0 && Indices.Num() == 0 && GroupRuns.Num() == 0 && Runs.Num() == 0, TEXT("hidden sections were grouped"));
+
+	Checks.Report();
+}
+
+static FAutoConsoleCommand TestSectionGroupsCommand(
+	TEXT("DeformMesh.TestSectionGroups"),
+	TEXT("Checks the instanced groups and the instance runs built for a few sections. Usage: DeformMesh.TestSectionGroups"),
+	FConsoleCommandDelegate::CreateStatic(&TestSectionGroups));
+#endif
@@ -0,0 +1,14 @@
+#include "DeformMeshStats.h"
+
+DEFINE_STAT(STAT_DeformMesh_SectionsCulled);
+DEFINE_STAT(STAT_DeformMesh_SectionsSubmitted);
+DEFINE_STAT(STAT_DeformMesh_TransformBytesUploaded);
+DEFINE_STAT(STAT_DeformMesh_CacheDispatches);
+DEFINE_STAT(STAT_DeformMesh_RayTracingInstances);
+DEFINE_STAT(STAT_DeformMesh_RayTracingRefits);
+DEFINE_STAT(STAT_DeformMesh_ShadowSectionsSubmitted);
+DEFINE_STAT(STAT_DeformMesh_ShadowSectionsSkipped);
+DEFINE_STAT(STAT_DeformMesh_GPUSceneInstancesUpdated);
+DEFINE_STAT(STAT_DeformMesh_GetDynamicMeshElements);
+DEFINE_STAT(STAT_DeformMesh_GetDynamicRayTracingInstances);
+DEFINE_STAT(STAT_DeformMesh_PrimitiveUniformBuffer);
@@ -0,0 +1,199 @@
+#include "DeformMeshSubsystem.h"
+#include "DeformMeshComponent.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Subsystem Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+FDeformMeshBatchSlot UDeformMeshSubsystem::AddSection(const FDeformMeshSection& Section, UMaterialInterface* Material)
+{
+	check(Section.StaticMesh != nullptr);
+	if (GetWorld() == nullptr || GetWorld()->bIsTearingDown)
+	{
+		return FDeformMeshBatchSlot();
+	}
+
+	//The queued transforms refer to sections by index, they're sent before any index is reused
+	FlushSectionTransforms();
+
+	const FBatchKey Key{ Section.StaticMesh, Material };
+	TArray<int32, TInlineAllocator<1>>& KeyBatches = BatchesByKey.FindOrAdd(Key);
+	int32 BatchIndex = INDEX_NONE;
+	for (const int32 Candidate : KeyBatches)
+	{
+		if (BatchStates[Candidate].NumSections < MaxSectionsPerBatch)
+		{
+			BatchIndex = Candidate;
+			break;
+		}
+	}
+	if (BatchIndex == INDEX_NONE)
+	{
+		BatchIndex = CreateBatch();
+		KeyBatches.Add(BatchIndex);
+	}
+
+	FBatch& Batch = BatchStates[BatchIndex];
+	const int32 SectionIndex = Batch.FreeSections.Num() > 0 ? Batch.FreeSections.Pop(false) : Batches[BatchIndex]->GetNumSections();
+	if (Batch.SectionGenerations.Num() <= SectionIndex)
+	{
+		Batch.SectionGenerations.SetNumZeroed(SectionIndex + 1);
+	}
+	Batch.NumSections++;
+	NumBatchedSections++;
+
+	Batches[BatchIndex]->SetBatchedSection(SectionIndex, Section, Material);
+	return { BatchIndex, SectionIndex, Batch.SectionGenerations[SectionIndex] };
+}
+
+void UDeformMeshSubsystem::RemoveSection(FDeformMeshBatchSlot& Slot)
+{
+	if (IsValidSlot(Slot))
+	{
+		FlushSectionTransforms();
+
+		FBatch& Batch = BatchStates[Slot.BatchIndex];
+		Batch.SectionGenerations[Slot.SectionIndex]++;
+		Batch.NumSections--;
+		NumBatchedSections--;
+		if (Batch.NumSections == 0)
+		{
+			//Shrink the empty batch, it stays registered for the next sections with the same mesh and material
+			Batches[Slot.BatchIndex]->ClearAllMeshSections();
+			Batch.FreeSections.Empty();
+		}
+		else
+		{
+			Batches[Slot.BatchIndex]->ClearMeshSection(Slot.SectionIndex);
+			Batch.FreeSections.Add(Slot.SectionIndex);
+		}
+	}
+	Slot = FDeformMeshBatchSlot();
+}
+
+void UDeformMeshSubsystem::UpdateSectionTransform(const FDeformMeshBatchSlot& Slot, const FMatrix& WorldTransform)
+{
+	if (IsValidSlot(Slot))
+	{
+		FBatch& Batch = BatchStates[Slot.BatchIndex];
+		if (Batch.PendingSections.Num() == 0)
+		{
+			DirtyBatches.Add(Slot.BatchIndex);
+		}
+		Batch.PendingSections.Add(Slot.SectionIndex);
+		Batch.PendingTransforms.Add(WorldTransform);
+	}
+}
+
+void UDeformMeshSubsystem::SetSectionLattice(const FDeformMeshBatchSlot& Slot, TArrayView<const FVector3f> ControlPointOffsets)
+{
+	if (IsValidSlot(Slot))
+	{
+		Batches[Slot.BatchIndex]->SetMeshSectionLattice(Slot.SectionIndex, ControlPointOffsets);
+	}
+}
+
+void UDeformMeshSubsystem::SetSectionVisible(const FDeformMeshBatchSlot& Slot, bool bNewVisibility)
+{
+	if (IsValidSlot(Slot))
+	{
+		Batches[Slot.BatchIndex]->SetMeshSectionVisible(Slot.SectionIndex, bNewVisibility);
+	}
+}
+
+void UDeformMeshSubsystem::FlushSectionTransforms()
+{
+	for (const int32 BatchIndex : DirtyBatches)
+	{
+		FBatch& Batch = BatchStates[BatchIndex];
+		UDeformMeshComponent* BatchComponent = Batches[BatchIndex];
+
+		//Same conversion as UpdateMeshSectionTransforms, from the composed matrices instead of FTransforms so the component's scale and rotation combine exactly
+		TArray<FMatrix44f> Matrices;
+		TArray<FBox> Boxes;
+		Matrices.Reserve(Batch.PendingSections.Num());
+		Boxes.Reserve(Batch.PendingSections.Num());
+		for (int32 PendingIndex = 0; PendingIndex < Batch.PendingSections.Num(); PendingIndex++)
+		{
+			const FMatrix& WorldTransform = Batch.PendingTransforms[PendingIndex];
+			Matrices.Add(FMatrix44f(WorldTransform.GetTransposed()));
+			Boxes.Add(BatchComponent->DeformMeshSections[Batch.PendingSections[PendingIndex]].GetMeshBox().TransformBy(WorldTransform));
+		}
+
+		BatchComponent->ApplySectionTransforms(MoveTemp(Batch.PendingSections), MoveTemp(Matrices), Boxes);
+		Batch.PendingSections.Reset();
+		Batch.PendingTransforms.Reset();
+	}
+	DirtyBatches.Reset();
+}
+
+int32 UDeformMeshSubsystem::GetNumBatches() const
+{
+	return Batches.Num();
+}
+
+int32 UDeformMeshSubsystem::GetNumBatchedSections() const
+{
+	return NumBatchedSections;
+}
+
+void UDeformMeshSubsystem::Deinitialize()
+{
+	//The batched components that unregister after this get invalid slots, and don't touch the batches anymore
+	for (UDeformMeshComponent* Batch : Batches)
+	{
+		if (Batch != nullptr)
+		{
+			Batch->DestroyComponent();
+		}
+	}
+	Batches.Empty();
+	BatchStates.Empty();
+	BatchesByKey.Empty();
+	DirtyBatches.Empty();
+	NumBatchedSections = 0;
+
+	Super::Deinitialize();
+}
+
+void UDeformMeshSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	FlushSectionTransforms();
+}
+
+TStatId UDeformMeshSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UDeformMeshSubsystem, STATGROUP_Tickables);
+}
+
+int32 UDeformMeshSubsystem::CreateBatch()
+{
+	//The batches have no owner actor, they're registered with the world directly like the components of a preview scene
+	//They stay at the origin, the sections carry their world transforms
+	//The draw settings are set here rather than left to the defaults, so changing a default doesn't change how the batches draw (see the class comment)
+	UDeformMeshComponent* Batch = NewObject<UDeformMeshComponent>(this, NAME_None, RF_Transient);
+	Batch->bUseInstancedDrawing = true;
+	Batch->bUseStaticDrawPath = false;
+	Batch->bUseGPUSceneInstances = false;
+	Batch->bUseDeformCache = false;
+	Batch->bUseSectionCollision = false;
+	Batch->bUseBatching = false;
+	Batch->TransformFormat = EDeformMeshTransformFormat::Full;
+	Batch->ForcedLodModel = 0;
+	Batch->MinLOD = 0;
+	Batch->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Batch->RegisterComponentWithWorld(GetWorld());
+
+	BatchStates.AddDefaulted();
+	return Batches.Add(Batch);
+}
+
+bool UDeformMeshSubsystem::IsValidSlot(const FDeformMeshBatchSlot& Slot) const
+{
+	if (!Batches.IsValidIndex(Slot.BatchIndex))
+	{
+		return false;
+	}
+	const FBatch& Batch = BatchStates[Slot.BatchIndex];
+	return Batch.SectionGenerations.IsValidIndex(Slot.SectionIndex) && Batch.SectionGenerations[Slot.SectionIndex] == Slot.Generation;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+#if !UE_BUILD_SHIPPING
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Test Checks
+/*
+ * The checks of the DeformMesh.Test*, DeformMesh.Stress* and DeformMesh.Benchmark* console commands, logged in the category of each command
+ * A failed check is counted and logged as an error, only the first MaxLoggedErrors are logged so a broken invariant doesn't flood the log
+ * Report logs the result line that every command ends with: "<Name> passed, <Details>, <N> errors", or FAILED
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshTestChecks
+{
+public:
+	FDeformMeshTestChecks(const FLogCategoryBase& InCategory, const TCHAR* InName)
+		: Category(InCategory)
+		, Name(InName)
+		, NumErrors(0)
+	{}
+
+	/* Counts the check as an error if the condition is false, the message is formatted like UE_LOG. Returns the condition */
+	template <typename FmtType, typename... Types>
+	bool Check(bool bCondition, const FmtType& Fmt, Types... Args)
+	{
+		if (!bCondition && NumErrors++ < MaxLoggedErrors)
+		{
+			Log(ELogVerbosity::Error, FString::Printf(TEXT("%s: %s"), Name, *FString::Printf(Fmt, Args...)));
+		}
+		return bCondition;
+	}
+
+	int32 GetNumErrors() const
+	{
+		return NumErrors;
+	}
+
+	bool HasPassed() const
+	{
+		return NumErrors == 0;
+	}
+
+	/* Logs whether every check passed, with the details of the run between the name and the error count. Returns whether it passed */
+	bool Report(const FString& Details = FString()) const
+	{
+		Log(ELogVerbosity::Display, FString::Printf(TEXT("%s %s%s%s, %d errors"), Name, HasPassed() ? TEXT("passed") : TEXT("FAILED"), Details.IsEmpty() ? TEXT("") : TEXT(", "), *Details, NumErrors));
+		return HasPassed();
+	}
+
+	static constexpr int32 MaxLoggedErrors = 20;
+
+private:
+	void Log(ELogVerbosity::Type Verbosity, const FString& Message) const
+	{
+		if (!Category.IsSuppressed(Verbosity))
+		{
+			FMsg::Logf(__FILE__, __LINE__, Category.GetCategoryName(), Verbosity, TEXT("%s"), *Message);
+		}
+	}
+
+	const FLogCategoryBase& Category;
+	const TCHAR* Name;
+	int32 NumErrors;
+};
+#endif
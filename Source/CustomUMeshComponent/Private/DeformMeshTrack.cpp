@@ -0,0 +1,404 @@
+#include "DeformMeshTrack.h"
+#include "Async/MappedFileHandle.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "HAL/PlatformFileManager.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+static_assert(sizeof(FDeformMeshTrack::FHeader) == 32, "The track header is read and written as it is");
+static_assert(sizeof(FDeformMeshTrackChunkBounds) == 28, "The chunk bounds are read and written as they are");
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Track Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+void FDeformMeshTrack::Encode(int32 NumSections, float FrameRate, int32 FramesPerChunk, TArrayView<const FTransform3f> Frames, TArray<uint8>& OutData)
+{
+	check(NumSections > 0 && FrameRate > 0.0f && FramesPerChunk > 0);
+	check(Frames.Num() > 0 && Frames.Num() % NumSections == 0);
+
+	FHeader NewHeader;
+	NewHeader.Magic = Magic;
+	NewHeader.Version = Version;
+	NewHeader.NumSections = NumSections;
+	NewHeader.NumFrames = Frames.Num() / NumSections;
+	NewHeader.FrameRate = FrameRate;
+	NewHeader.FramesPerChunk = FramesPerChunk;
+	NewHeader.NumChunks = FMath::DivideAndRoundUp<uint32>(NewHeader.NumFrames, FramesPerChunk);
+	NewHeader.Reserved = 0;
+
+	const int64 FramesOffset = Align(sizeof(FHeader) + NewHeader.NumChunks * sizeof(FDeformMeshTrackChunkBounds), 16);
+	const int64 FrameSize = (int64)NumSections * FDeformMeshTransformCodec::QuantizedStride;
+	OutData.Reset();
+	const int64 DataSize = FramesOffset + NewHeader.NumFrames * FrameSize;
+	checkf(DataSize <= MAX_int32, TEXT("Deform tracks are encoded in memory, they can't be bigger than 2GB"));
+	OutData.AddZeroed((int32)DataSize);
+	FMemory::Memcpy(OutData.GetData(), &NewHeader, sizeof(FHeader));
+
+	FDeformMeshTrackChunkBounds* Bounds = (FDeformMeshTrackChunkBounds*)(OutData.GetData() + sizeof(FHeader));
+	for (uint32 ChunkIndex = 0; ChunkIndex < NewHeader.NumChunks; ChunkIndex++)
+	{
+		FDeformMeshTrackChunkBounds ChunkBounds;
+		ChunkBounds.TranslationMin = FVector3f(UE_BIG_NUMBER);
+		ChunkBounds.TranslationMax = FVector3f(-UE_BIG_NUMBER);
+		ChunkBounds.MaxScale = 0.0f;
+
+		const uint32 EndFrame = FMath::Min((ChunkIndex + 1) * FramesPerChunk, NewHeader.NumFrames);
+		for (uint32 Frame = ChunkIndex * FramesPerChunk; Frame < EndFrame; Frame++)
+		{
+			uint8* Keys = OutData.GetData() + FramesOffset + Frame * FrameSize;
+			for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+			{
+				const FTransform3f& Transform = Frames[Frame * NumSections + SectionIndex];
+				FDeformMeshTransformCodec::EncodeQuantized(Transform, Keys + SectionIndex * FDeformMeshTransformCodec::QuantizedStride);
+
+				ChunkBounds.TranslationMin = ChunkBounds.TranslationMin.ComponentMin(Transform.GetTranslation());
+				ChunkBounds.TranslationMax = ChunkBounds.TranslationMax.ComponentMax(Transform.GetTranslation());
+				ChunkBounds.MaxScale = FMath::Max(ChunkBounds.MaxScale, Transform.GetScale3D().GetAbsMax());
+			}
+		}
+		//The scale is stored as halves, it can round up
+		ChunkBounds.MaxScale *= 1.0f + 1.0f / 1024.0f;
+		FMemory::Memcpy(&Bounds[ChunkIndex], &ChunkBounds, sizeof(FDeformMeshTrackChunkBounds));
+	}
+}
+
+TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> FDeformMeshTrack::OpenFile(const FString& Filename)
+{
+	IMappedFileHandle* MappedFile = FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Filename);
+	if (MappedFile == nullptr)
+	{
+		//Not every platform can map files, the track is read whole instead
+		TArray<uint8> FileData;
+		if (!FFileHelper::LoadFileToArray(FileData, *Filename, FILEREAD_Silent))
+		{
+			return nullptr;
+		}
+		return CreateFromMemory(MoveTemp(FileData));
+	}
+
+	TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> Track = MakeShareable(new FDeformMeshTrack());
+	Track->MappedFile.Reset(MappedFile);
+
+	//The header and the bounds are copied, their region is only mapped while they're read
+	const int64 FileSize = MappedFile->GetFileSize();
+	if (FileSize < (int64)sizeof(FHeader))
+	{
+		return nullptr;
+	}
+	TUniquePtr<IMappedFileRegion> HeaderRegion(MappedFile->MapRegion(0, FMath::Min<int64>(FileSize, 64 * 1024)));
+	if (!HeaderRegion.IsValid())
+	{
+		return nullptr;
+	}
+	FHeader FileHeader;
+	FMemory::Memcpy(&FileHeader, HeaderRegion->GetMappedPtr(), sizeof(FHeader));
+	if (!Track->InitHeader(FileHeader, FileSize))
+	{
+		return nullptr;
+	}
+	if (HeaderRegion->GetMappedSize() < Track->FramesOffset)
+	{
+		HeaderRegion.Reset(MappedFile->MapRegion(0, Track->FramesOffset));
+		if (!HeaderRegion.IsValid())
+		{
+			return nullptr;
+		}
+	}
+	FMemory::Memcpy(Track->ChunkBounds.GetData(), HeaderRegion->GetMappedPtr() + sizeof(FHeader), Track->ChunkBounds.Num() * sizeof(FDeformMeshTrackChunkBounds));
+	return Track;
+}
+
+TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> FDeformMeshTrack::CreateFromMemory(TArray<uint8>&& InData)
+{
+	if (InData.Num() < (int32)sizeof(FHeader))
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> Track = MakeShareable(new FDeformMeshTrack());
+	Track->Data = MoveTemp(InData);
+	FHeader DataHeader;
+	FMemory::Memcpy(&DataHeader, Track->Data.GetData(), sizeof(FHeader));
+	if (!Track->InitHeader(DataHeader, Track->Data.Num()))
+	{
+		return nullptr;
+	}
+	FMemory::Memcpy(Track->ChunkBounds.GetData(), Track->Data.GetData() + sizeof(FHeader), Track->ChunkBounds.Num() * sizeof(FDeformMeshTrackChunkBounds));
+	return Track;
+}
+
+FDeformMeshTrack::~FDeformMeshTrack()
+{
+	//Defined here where IMappedFileHandle is complete. The readers hold a reference to the track, so their regions are all unmapped by now
+}
+
+bool FDeformMeshTrack::InitHeader(const FHeader& InHeader, int64 DataSize)
+{
+	if (InHeader.Magic != Magic || InHeader.Version != Version || InHeader.NumSections == 0 || InHeader.NumFrames == 0 || InHeader.FrameRate <= 0.0f
+		|| InHeader.FramesPerChunk == 0 || InHeader.NumChunks != FMath::DivideAndRoundUp(InHeader.NumFrames, InHeader.FramesPerChunk))
+	{
+		return false;
+	}
+
+	Header = InHeader;
+	FramesOffset = Align(sizeof(FHeader) + Header.NumChunks * sizeof(FDeformMeshTrackChunkBounds), 16);
+	if (DataSize < FramesOffset + Header.NumFrames * GetFrameSize())
+	{
+		return false;
+	}
+
+	ChunkBounds.SetNumUninitialized(Header.NumChunks);
+	return true;
+}
+
+int32 FDeformMeshTrack::GetChunkIndex(double Time) const
+{
+	const int32 Frame = FMath::Clamp(FMath::FloorToInt(Time * Header.FrameRate), 0, (int32)Header.NumFrames - 1);
+	return Frame / Header.FramesPerChunk;
+}
+
+int64 FDeformMeshTrack::GetChunkOffset(int32 ChunkIndex) const
+{
+	return FramesOffset + (int64)ChunkIndex * Header.FramesPerChunk * GetFrameSize();
+}
+
+int64 FDeformMeshTrack::GetChunkSize(int32 ChunkIndex) const
+{
+	const int64 FirstFrame = (int64)ChunkIndex * Header.FramesPerChunk;
+	return FMath::Min<int64>(Header.FramesPerChunk, Header.NumFrames - FirstFrame) * GetFrameSize();
+}
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Track Reader Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+FDeformMeshTrackReader::FDeformMeshTrackReader(TSharedRef<FDeformMeshTrack, ESPMode::ThreadSafe> InTrack)
+	: Track(InTrack)
+{
+}
+
+FDeformMeshTrackReader::~FDeformMeshTrackReader()
+{
+	FScopeLock Lock(&Track->MappingLock);
+	for (FMappedChunk& Chunk : Chunks)
+	{
+		Chunk.Region.Reset();
+	}
+}
+
+void FDeformMeshTrackReader::Evaluate(double Time, TArrayView<FMatrix44f> OutTransforms)
+{
+	const FDeformMeshTrack::FHeader& Header = Track->Header;
+	check(OutTransforms.Num() <= (int32)Header.NumSections);
+
+	double FrameTime = FMath::Clamp(Time * Header.FrameRate, 0.0, (double)(Header.NumFrames - 1));
+	//A time computed as Frame / FrameRate can round to just below its frame, it plays that frame instead of a blend with the previous one
+	const double NearestFrame = FMath::RoundToDouble(FrameTime);
+	if (FMath::IsNearlyEqual(FrameTime, NearestFrame, 1e-6))
+	{
+		FrameTime = NearestFrame;
+	}
+	const int32 Frame = FMath::Min(FMath::FloorToInt(FrameTime), (int32)Header.NumFrames - 1);
+	const int32 NextFrame = FMath::Min(Frame + 1, (int32)Header.NumFrames - 1);
+	const float Alpha = (float)(FrameTime - Frame);
+
+	const uint8* Keys = GetFrame(Frame);
+	const uint8* NextKeys = GetFrame(NextFrame);
+
+	//Read the next chunk ahead while this one is played, it's in the other slot so the keys above stay mapped
+	const int32 AheadChunk = Frame / Header.FramesPerChunk + 1;
+	if (AheadChunk < (int32)Header.NumChunks && Chunks[AheadChunk & 1].ChunkIndex != AheadChunk)
+	{
+		MapChunk(AheadChunk, true);
+	}
+
+	const int32 Num = OutTransforms.Num();
+	const int32 NumTasks = FMath::DivideAndRoundUp(Num, SectionsPerTask);
+	ParallelFor(NumTasks, [&](int32 TaskIndex)
+		{
+			const int32 Start = TaskIndex * SectionsPerTask;
+			const int32 End = FMath::Min(Start + SectionsPerTask, Num);
+			for (int32 SectionIndex = Start; SectionIndex < End; SectionIndex++)
+			{
+				FTransform3f Transform = FDeformMeshTransformCodec::DecodeQuantized(Keys + SectionIndex * FDeformMeshTransformCodec::QuantizedStride);
+				if (Alpha > 0.0f)
+				{
+					const FTransform3f NextTransform = FDeformMeshTransformCodec::DecodeQuantized(NextKeys + SectionIndex * FDeformMeshTransformCodec::QuantizedStride);
+					FTransform3f Blended;
+					Blended.Blend(Transform, NextTransform, Alpha);
+					Transform = Blended;
+				}
+				OutTransforms[SectionIndex] = Transform.ToMatrixWithScale().GetTransposed();
+			}
+		},
+		NumTasks > 1 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+}
+
+const uint8* FDeformMeshTrackReader::GetFrame(int32 Frame)
+{
+	const int32 FramesPerChunk = Track->Header.FramesPerChunk;
+	const int32 ChunkIndex = Frame / FramesPerChunk;
+	FMappedChunk* Chunk = &Chunks[ChunkIndex & 1];
+	if (Chunk->ChunkIndex != ChunkIndex)
+	{
+		Chunk = &MapChunk(ChunkIndex, false);
+	}
+	return Chunk->Data + (Frame % FramesPerChunk) * Track->GetFrameSize();
+}
+
+FDeformMeshTrackReader::FMappedChunk& FDeformMeshTrackReader::MapChunk(int32 ChunkIndex, bool bPreload)
+{
+	FMappedChunk& Chunk = Chunks[ChunkIndex & 1];
+	Chunk.ChunkIndex = ChunkIndex;
+
+	if (!Track->MappedFile.IsValid())
+	{
+		Chunk.Data = Track->Data.GetData() + Track->GetChunkOffset(ChunkIndex);
+		return Chunk;
+	}
+
+	FScopeLock Lock(&Track->MappingLock);
+	Chunk.Region.Reset();
+	Chunk.Region.Reset(Track->MappedFile->MapRegion(Track->GetChunkOffset(ChunkIndex), Track->GetChunkSize(ChunkIndex), bPreload));
+	//The file was checked when it was opened, a region can still fail to map when the address space is exhausted
+	checkf(Chunk.Region.IsValid(), TEXT("Failed to map chunk %d of a deform track"), ChunkIndex);
+	Chunk.Data = Chunk.Region->GetMappedPtr();
+	return Chunk;
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshTrack, Log, All);
+
+/*
+ * Encodes a random track, checks the decoded transforms against the source ones, and times the evaluation from memory and from a mapped file
+ * The frames are read back through the matrices of the reader, so the bounds of the Quantized format get a little slack for the float error of the decomposition, the translation must still be exact
+ * Usage: DeformMesh.BenchmarkTrack [NumSections=5000] [NumFrames=600]
+*/
+static void BenchmarkTrack(const TArray<FString>& Args)
+{
+	const int32 NumSections = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 5000;
+	const int32 NumFrames = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 2) : 600;
+	constexpr float FrameRate = 30.0f;
+	constexpr int32 FramesPerChunk = 32;
+	FRandomStream Random(0xDEF1);
+
+	//Each section moves and spins at its own speed, like the debris of a destruction sequence
+	TArray<FTransform3f> Frames;
+	Frames.SetNumUninitialized(NumSections * NumFrames);
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		const FVector3f Start = FVector3f(Random.GetUnitVector() * Random.FRandRange(0.0f, 5000.0f));
+		const FVector3f Velocity = FVector3f(Random.GetUnitVector() * Random.FRandRange(0.0f, 1000.0f));
+		const FVector3f Axis = FVector3f(Random.GetUnitVector());
+		const float AngularSpeed = Random.FRandRange(-PI, PI);
+		const FVector3f Scale(Random.FRandRange(0.5f, 2.0f), Random.FRandRange(0.5f, 2.0f), Random.FRandRange(0.5f, 2.0f));
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			const float Time = Frame / FrameRate;
+			Frames[Frame * NumSections + SectionIndex] = FTransform3f(FQuat4f(Axis, AngularSpeed * Time), Start + Velocity * Time, Scale);
+		}
+	}
+
+	TArray<uint8> Data;
+	double StartTime = FPlatformTime::Seconds();
+	FDeformMeshTrack::Encode(NumSections, FrameRate, FramesPerChunk, Frames, Data);
+	const double EncodeTime = FPlatformTime::Seconds() - StartTime;
+	const int64 DataSize = Data.Num();
+
+	TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> MemoryTrack = FDeformMeshTrack::CreateFromMemory(TArray<uint8>(Data));
+	if (!MemoryTrack.IsValid())
+	{
+		UE_LOG(LogDeformMeshTrack, Error, TEXT("The encoded track can't be read back"));
+		return;
+	}
+
+	//Round trip against the bounds of the Quantized format (see FDeformMeshTransformCodec): exact translation, rotation within 1.6e-4 radians, scale within 2^-11
+	constexpr double MaxRotationError = 1.6e-4 + 1e-5;
+	constexpr double MaxScaleError = 1.0 / 2048.0 + 1e-6;
+	FDeformMeshTestChecks Checks(LogDeformMeshTrack, TEXT("Deform track"));
+	TArray<FMatrix44f> Transforms;
+	Transforms.SetNumUninitialized(NumSections);
+	float MaxPointError = 0.0f;
+	{
+		FDeformMeshTrackReader Reader(MemoryTrack.ToSharedRef());
+		const FVector3f TestPoints[3] = { FVector3f(100.0f, 0.0f, 0.0f), FVector3f(0.0f, 100.0f, 0.0f), FVector3f(0.0f, 0.0f, 100.0f) };
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			Reader.Evaluate(Frame / (double)FrameRate, Transforms);
+			for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+			{
+				const FMatrix44f Decoded = Transforms[SectionIndex].GetTransposed();
+				const FTransform3f& Source = Frames[Frame * NumSections + SectionIndex];
+				for (const FVector3f& Point : TestPoints)
+				{
+					MaxPointError = FMath::Max(MaxPointError, (Decoded.TransformPosition(Point) - Source.TransformPosition(Point)).Size() / Source.GetScale3D().GetAbsMax());
+				}
+
+				Checks.Check(Decoded.GetOrigin() == Source.GetTranslation(), TEXT("frame %d, section %d, the translation isn't exact"), Frame, SectionIndex);
+
+				const FVector3f Scale = Source.GetScale3D();
+				const FVector3f DecodedScale = Decoded.GetScaleVector(0.0f);
+				for (int32 Axis = 0; Axis < 3; Axis++)
+				{
+					Checks.Check(FMath::Abs((double)DecodedScale[Axis] - Scale[Axis]) <= MaxScaleError * Scale[Axis], TEXT("frame %d, section %d, the scale is off by more than 2^-11"), Frame, SectionIndex);
+				}
+
+				//The quaternions are compared in double on the same hemisphere, two unit quaternions at a distance D are rotations 4 asin(D / 2) apart
+				FMatrix44f RotationMatrix = Decoded;
+				RotationMatrix.RemoveScaling(0.0f);
+				const FQuat DecodedRotation = FQuat(FQuat4f(RotationMatrix)).GetNormalized();
+				const FQuat SourceRotation = FQuat(Source.GetRotation()).GetNormalized();
+				const double Sign = (DecodedRotation | SourceRotation) < 0.0 ? -1.0 : 1.0;
+				const double Distance = FMath::Sqrt(FMath::Square(DecodedRotation.X - Sign * SourceRotation.X) + FMath::Square(DecodedRotation.Y - Sign * SourceRotation.Y)
+					+ FMath::Square(DecodedRotation.Z - Sign * SourceRotation.Z) + FMath::Square(DecodedRotation.W - Sign * SourceRotation.W));
+				Checks.Check(4.0 * FMath::Asin(FMath::Min(Distance * 0.5, 1.0)) <= MaxRotationError, TEXT("frame %d, section %d, the rotation is off by more than 1.6e-4 radians"), Frame, SectionIndex);
+			}
+		}
+	}
+
+	//Playback: half a frame between evaluations, so every other evaluation interpolates
+	auto TimePlayback = [&Transforms, NumFrames, FrameRate](const TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe>& Track)
+	{
+		FDeformMeshTrackReader Reader(Track.ToSharedRef());
+		const double PlaybackStart = FPlatformTime::Seconds();
+		for (int32 Step = 0; Step < 2 * (NumFrames - 1); Step++)
+		{
+			Reader.Evaluate(Step * 0.5 / FrameRate, Transforms);
+		}
+		return FPlatformTime::Seconds() - PlaybackStart;
+	};
+	const double MemoryPlaybackTime = TimePlayback(MemoryTrack);
+
+	const FString Filename = FPaths::CreateTempFilename(*FPaths::ProjectIntermediateDir(), TEXT("DeformMeshTrack"), TEXT(".dmtrack"));
+	double MappedPlaybackTime = 0.0;
+	bool bMapped = false;
+	if (FFileHelper::SaveArrayToFile(Data, *Filename))
+	{
+		Data.Empty();
+		TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> FileTrack = FDeformMeshTrack::OpenFile(Filename);
+		if (FileTrack.IsValid())
+		{
+			bMapped = FileTrack->IsMemoryMapped();
+			MappedPlaybackTime = TimePlayback(FileTrack);
+		}
+		FileTrack.Reset();
+		IFileManager::Get().Delete(*Filename);
+	}
+
+	const int32 NumEvaluations = 2 * (NumFrames - 1);
+	UE_LOG(LogDeformMeshTrack, Display, TEXT("Deform track, %d sections, %d frames: %.1f MB (%.1f MB as FTransforms), encoded in %.1f ms, max error %.4f units at 100 units"),
+		NumSections, NumFrames, DataSize / (1024.0 * 1024.0), Frames.Num() * sizeof(FTransform3f) / (1024.0 * 1024.0), EncodeTime * 1000.0, MaxPointError);
+	UE_LOG(LogDeformMeshTrack, Display, TEXT("Deform track playback: %.3f ms per frame from memory, %.3f ms per frame from the file (%s), %.0f sections/s"),
+		MemoryPlaybackTime * 1000.0 / NumEvaluations, MappedPlaybackTime * 1000.0 / NumEvaluations, bMapped ? TEXT("mapped") : TEXT("read whole"),
+		(double)NumSections * NumEvaluations / FMath::Max(MemoryPlaybackTime, UE_SMALL_NUMBER));
+	Checks.Report(FString::Printf(TEXT("%d sections, %d frames"), NumSections, NumFrames));
+}
+
+static FAutoConsoleCommand BenchmarkTrackCommand(
+	TEXT("DeformMesh.BenchmarkTrack"),
+	TEXT("Checks the deform track round trip and times its playback. Usage: DeformMesh.BenchmarkTrack [NumSections=5000] [NumFrames=600]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkTrack));
+#endif
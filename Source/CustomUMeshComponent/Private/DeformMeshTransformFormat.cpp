@@ -0,0 +1,268 @@
+#include "DeformMeshTransformFormat.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+//Number of bits of each of the 3 quaternion components stored by the quantized format
+static constexpr uint32 QuatComponentBits = 15;
+static constexpr uint32 QuatComponentMax = (1u << QuatComponentBits) - 1;
+
+/* The 3 smallest components of a unit quaternion are in [-1/sqrt(2), 1/sqrt(2)], they're remapped to [0, QuatComponentMax] */
+static uint32 QuantizeQuatComponent(float Value)
+{
+	const float Normalized = FMath::Clamp(Value * UE_SQRT_2 * 0.5f + 0.5f, 0.0f, 1.0f);
+	return (uint32)FMath::RoundToInt(Normalized * QuatComponentMax);
+}
+
+static float DequantizeQuatComponent(uint32 Value)
+{
+	return ((float)Value / QuatComponentMax * 2.0f - 1.0f) * UE_INV_SQRT_2;
+}
+
+uint32 FDeformMeshTransformCodec::GetStride(EDeformMeshTransformFormat Format)
+{
+	switch (Format)
+	{
+	case EDeformMeshTransformFormat::Affine3x4:
+		return 3 * sizeof(FVector4f);
+	case EDeformMeshTransformFormat::Quantized:
+		return QuantizedStride;
+	default:
+		return sizeof(FMatrix44f);
+	}
+}
+
+void FDeformMeshTransformCodec::Encode(EDeformMeshTransformFormat Format, const FMatrix44f& Transform, uint8* Dest)
+{
+	switch (Format)
+	{
+	case EDeformMeshTransformFormat::Affine3x4:
+		//The transform is stored transposed, so the last row is (0, 0, 0, 1) for an affine transform and we can drop it
+		FMemory::Memcpy(Dest, &Transform.M[0][0], 3 * sizeof(FVector4f));
+		break;
+
+	case EDeformMeshTransformFormat::Quantized:
+		EncodeQuantized(FTransform3f(Transform.GetTransposed()), Dest);
+		break;
+
+	default:
+		FMemory::Memcpy(Dest, &Transform, sizeof(FMatrix44f));
+		break;
+	}
+}
+
+FMatrix44f FDeformMeshTransformCodec::Decode(EDeformMeshTransformFormat Format, const uint8* Src)
+{
+	FMatrix44f Transform;
+	switch (Format)
+	{
+	case EDeformMeshTransformFormat::Affine3x4:
+		FMemory::Memcpy(&Transform.M[0][0], Src, 3 * sizeof(FVector4f));
+		Transform.M[3][0] = 0.0f;
+		Transform.M[3][1] = 0.0f;
+		Transform.M[3][2] = 0.0f;
+		Transform.M[3][3] = 1.0f;
+		break;
+
+	case EDeformMeshTransformFormat::Quantized:
+		Transform = DecodeQuantized(Src).ToMatrixWithScale().GetTransposed();
+		break;
+
+	default:
+		FMemory::Memcpy(&Transform, Src, sizeof(FMatrix44f));
+		break;
+	}
+	return Transform;
+}
+
+void FDeformMeshTransformCodec::EncodeQuantized(const FTransform3f& Transform, uint8* Dest)
+{
+	const FVector3f Translation = Transform.GetTranslation();
+	const FVector3f Scale = Transform.GetScale3D();
+	FQuat4f Rotation = Transform.GetRotation();
+	Rotation.Normalize();
+
+	//Smallest three: we drop the largest component, and flip the quaternion so that it's positive, q and -q being the same rotation
+	const float Components[4] = { Rotation.X, Rotation.Y, Rotation.Z, Rotation.W };
+	uint32 Largest = 0;
+	for (uint32 Index = 1; Index < 4; Index++)
+	{
+		if (FMath::Abs(Components[Index]) > FMath::Abs(Components[Largest]))
+		{
+			Largest = Index;
+		}
+	}
+	const float Sign = Components[Largest] < 0.0f ? -1.0f : 1.0f;
+
+	uint32 Quantized[3];
+	for (uint32 Index = 0, SmallIndex = 0; Index < 4; Index++)
+	{
+		if (Index != Largest)
+		{
+			Quantized[SmallIndex++] = QuantizeQuatComponent(Components[Index] * Sign);
+		}
+	}
+
+	uint32 Words[6];
+	FMemory::Memcpy(&Words[0], &Translation.X, sizeof(float));
+	FMemory::Memcpy(&Words[1], &Translation.Y, sizeof(float));
+	FMemory::Memcpy(&Words[2], &Translation.Z, sizeof(float));
+	Words[3] = Largest | (Quantized[0] << 2) | (Quantized[1] << (2 + QuatComponentBits));
+	Words[4] = Quantized[2] | ((uint32)FFloat16(Scale.X).Encoded << 16);
+	Words[5] = (uint32)FFloat16(Scale.Y).Encoded | ((uint32)FFloat16(Scale.Z).Encoded << 16);
+	FMemory::Memcpy(Dest, Words, sizeof(Words));
+}
+
+FTransform3f FDeformMeshTransformCodec::DecodeQuantized(const uint8* Src)
+{
+	uint32 Words[6];
+	FMemory::Memcpy(Words, Src, sizeof(Words));
+
+	FVector3f Translation;
+	FMemory::Memcpy(&Translation.X, &Words[0], sizeof(float));
+	FMemory::Memcpy(&Translation.Y, &Words[1], sizeof(float));
+	FMemory::Memcpy(&Translation.Z, &Words[2], sizeof(float));
+
+	const uint32 Largest = Words[3] & 3;
+	const float Small[3] = {
+		DequantizeQuatComponent((Words[3] >> 2) & QuatComponentMax),
+		DequantizeQuatComponent((Words[3] >> (2 + QuatComponentBits)) & QuatComponentMax),
+		DequantizeQuatComponent(Words[4] & QuatComponentMax)
+	};
+
+	float Components[4];
+	float SumSquares = 0.0f;
+	for (uint32 Index = 0, SmallIndex = 0; Index < 4; Index++)
+	{
+		if (Index != Largest)
+		{
+			Components[Index] = Small[SmallIndex++];
+			SumSquares += FMath::Square(Components[Index]);
+		}
+	}
+	Components[Largest] = FMath::Sqrt(FMath::Max(1.0f - SumSquares, 0.0f));
+
+	FFloat16 ScaleX, ScaleY, ScaleZ;
+	ScaleX.Encoded = (uint16)(Words[4] >> 16);
+	ScaleY.Encoded = (uint16)(Words[5] & 0xFFFF);
+	ScaleZ.Encoded = (uint16)(Words[5] >> 16);
+
+	const FQuat4f Rotation(Components[0], Components[1], Components[2], Components[3]);
+	const FVector3f Scale(ScaleX.GetFloat(), ScaleY.GetFloat(), ScaleZ.GetFloat());
+	return FTransform3f(Rotation, Translation, Scale);
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshTransformFormat, Log, All);
+
+/*
+ * Encodes and decodes random transforms, and a few exact rotations, with every format and checks the round trip against the error bounds of FDeformMeshTransformCodec
+ * The quaternions are compared in double, a float dot product close to 1 isn't precise enough for angles of 1e-4 radians
+ * Usage: DeformMesh.TestTransformFormat [NumTransforms=10000]
+*/
+static void TestTransformFormat(const TArray<FString>& Args)
+{
+	const int32 NumTransforms = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10000;
+	constexpr double MaxComponentError = 2.2e-5;
+	constexpr double MaxRotationError = 1.6e-4;
+	constexpr double MaxScaleError = 1.0 / 2048.0;
+
+	FDeformMeshTestChecks Checks(LogDeformMeshTransformFormat, TEXT("Transform format"));
+
+	TArray<FTransform3f> Transforms;
+	const FVector3f Axes[3] = { FVector3f::XAxisVector, FVector3f::YAxisVector, FVector3f::ZAxisVector };
+	for (const FVector3f& Axis : Axes)
+	{
+		for (int32 QuarterTurns = 0; QuarterTurns < 4; QuarterTurns++)
+		{
+			Transforms.Add(FTransform3f(FQuat4f(Axis, QuarterTurns * (float)UE_HALF_PI), FVector3f(1.0f, -2.0f, 3.0f), FVector3f::OneVector));
+		}
+	}
+	FRandomStream Random(0xDEF8);
+	while (Transforms.Num() < NumTransforms)
+	{
+		const FVector3f Scale(Random.FRandRange(0.01f, 100.0f), Random.FRandRange(0.01f, 100.0f), Random.FRandRange(0.01f, 100.0f));
+		Transforms.Add(FTransform3f(FQuat4f(FVector3f(Random.GetUnitVector()), Random.FRandRange(-PI, PI)), FVector3f(Random.GetUnitVector() * Random.FRandRange(0.0f, 100000.0f)), Scale));
+	}
+
+	uint8 Encoded[sizeof(FMatrix44f)];
+	for (int32 TransformIndex = 0; TransformIndex < Transforms.Num(); TransformIndex++)
+	{
+		const FTransform3f& Transform = Transforms[TransformIndex];
+		const FMatrix44f Matrix = Transform.ToMatrixWithScale().GetTransposed();
+
+		//Full and Affine3x4 give back the same bits
+		for (const EDeformMeshTransformFormat Format : { EDeformMeshTransformFormat::Full, EDeformMeshTransformFormat::Affine3x4 })
+		{
+			FDeformMeshTransformCodec::Encode(Format, Matrix, Encoded);
+			const FMatrix44f Decoded = FDeformMeshTransformCodec::Decode(Format, Encoded);
+			Checks.Check(FMemory::Memcmp(&Decoded, &Matrix, sizeof(FMatrix44f)) == 0, TEXT("transform %d, the %s format isn't exact"), TransformIndex, Format == EDeformMeshTransformFormat::Full ? TEXT("Full") : TEXT("Affine3x4"));
+		}
+
+		FDeformMeshTransformCodec::EncodeQuantized(Transform, Encoded);
+		const FTransform3f Decoded = FDeformMeshTransformCodec::DecodeQuantized(Encoded);
+
+		const FVector3f Translation = Transform.GetTranslation();
+		const FVector3f DecodedTranslation = Decoded.GetTranslation();
+		Checks.Check(FMemory::Memcmp(&Translation, &DecodedTranslation, sizeof(FVector3f)) == 0, TEXT("transform %d, the quantized translation isn't exact"), TransformIndex);
+
+		//The components are compared on the same side as the encoder, which flips the quaternion to make the largest component positive
+		FQuat4f Rotation = Transform.GetRotation();
+		Rotation.Normalize();
+		const double Components[4] = { Rotation.X, Rotation.Y, Rotation.Z, Rotation.W };
+		const FQuat4f DecodedRotation = Decoded.GetRotation();
+		const double DecodedComponents[4] = { DecodedRotation.X, DecodedRotation.Y, DecodedRotation.Z, DecodedRotation.W };
+		int32 Largest = 0;
+		for (int32 Index = 1; Index < 4; Index++)
+		{
+			Largest = FMath::Abs(Components[Index]) > FMath::Abs(Components[Largest]) ? Index : Largest;
+		}
+		const double Sign = Components[Largest] < 0.0 ? -1.0 : 1.0;
+		double Length = 0.0;
+		double DecodedLength = 0.0;
+		for (int32 Index = 0; Index < 4; Index++)
+		{
+			Length += FMath::Square(Components[Index]);
+			DecodedLength += FMath::Square(DecodedComponents[Index]);
+			Checks.Check(Index == Largest || FMath::Abs(DecodedComponents[Index] - Components[Index] * Sign) <= MaxComponentError, TEXT("transform %d, a quantized quaternion component is off by more than 2.2e-5"), TransformIndex);
+		}
+		double Distance = 0.0;
+		for (int32 Index = 0; Index < 4; Index++)
+		{
+			Distance += FMath::Square(DecodedComponents[Index] / FMath::Sqrt(DecodedLength) - Components[Index] * Sign / FMath::Sqrt(Length));
+		}
+		//Two unit quaternions at a distance D are 2 asin(D / 2) apart on the sphere, and the rotations twice that
+		Checks.Check(4.0 * FMath::Asin(FMath::Min(FMath::Sqrt(Distance) * 0.5, 1.0)) < MaxRotationError, TEXT("transform %d, the quantized rotation is off by more than 1.6e-4 radians"), TransformIndex);
+
+		const FVector3f Scale = Transform.GetScale3D();
+		const FVector3f DecodedScale = Decoded.GetScale3D();
+		for (int32 Axis = 0; Axis < 3; Axis++)
+		{
+			Checks.Check(FMath::Abs((double)DecodedScale[Axis] - Scale[Axis]) <= MaxScaleError * FMath::Abs(Scale[Axis]), TEXT("transform %d, the quantized scale is off by more than 2^-11"), TransformIndex);
+		}
+
+		//Going through the matrix only adds the float error of the decomposition to the bounds above
+		FDeformMeshTransformCodec::Encode(EDeformMeshTransformFormat::Quantized, Matrix, Encoded);
+		const FMatrix44f DecodedMatrix = FDeformMeshTransformCodec::Decode(EDeformMeshTransformFormat::Quantized, Encoded);
+		const float MaxScale = Scale.GetAbsMax();
+		bool bMatrixInBounds = FMath::IsNearlyEqual(DecodedMatrix.M[0][3], Matrix.M[0][3], 1e-6f * FMath::Max(FMath::Abs(Matrix.M[0][3]), 1.0f))
+			&& FMath::IsNearlyEqual(DecodedMatrix.M[1][3], Matrix.M[1][3], 1e-6f * FMath::Max(FMath::Abs(Matrix.M[1][3]), 1.0f))
+			&& FMath::IsNearlyEqual(DecodedMatrix.M[2][3], Matrix.M[2][3], 1e-6f * FMath::Max(FMath::Abs(Matrix.M[2][3]), 1.0f));
+		for (int32 Row = 0; Row < 3; Row++)
+		{
+			for (int32 Column = 0; Column < 3; Column++)
+			{
+				bMatrixInBounds &= FMath::IsNearlyEqual(DecodedMatrix.M[Row][Column], Matrix.M[Row][Column], (float)(MaxRotationError + MaxScaleError + 1e-5) * MaxScale);
+			}
+		}
+		Checks.Check(bMatrixInBounds, TEXT("transform %d, the Quantized format of the matrix is off by more than the bounds"), TransformIndex);
+	}
+
+	Checks.Report(FString::Printf(TEXT("%d transforms"), Transforms.Num()));
+}
+
+static FAutoConsoleCommand TestTransformFormatCommand(
+	TEXT("DeformMesh.TestTransformFormat"),
+	TEXT("Checks the round trip of the transform formats against their documented error bounds. Usage: DeformMesh.TestTransformFormat [NumTransforms=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&TestTransformFormat));
+#endif
@@ -0,0 +1,232 @@
+#include "DeformMeshTransformMailbox.h"
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Transform Mailbox Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+FDeformMeshTransformMailbox::FDeformMeshTransformMailbox()
+	: Middle(1)
+	, bDrainRequested(false)
+	, Back(0)
+	, WriteSerial(0)
+	, bBackDirty(false)
+	, Front(2)
+{
+}
+
+void FDeformMeshTransformMailbox::Write(int32 SectionIndex, const FMatrix44f& Transform)
+{
+	check(SectionIndex >= 0);
+	while (BackEntryIndices.Num() <= SectionIndex)
+	{
+		BackEntryIndices.Add(INDEX_NONE);
+	}
+
+	int32& EntryIndex = BackEntryIndices[SectionIndex];
+	if (EntryIndex == INDEX_NONE)
+	{
+		EntryIndex = Slots[Back].Entries.Add({ SectionIndex, WriteSerial, Transform });
+	}
+	else
+	{
+		FDeformMeshMailboxEntry& Entry = Slots[Back].Entries[EntryIndex];
+		Entry.Serial = WriteSerial;
+		Entry.Transform = Transform;
+	}
+	bBackDirty = true;
+}
+
+bool FDeformMeshTransformMailbox::Publish()
+{
+	if (!bBackDirty)
+	{
+		return false;
+	}
+
+	//Release the writes to the back slot, and get back the slot that was in the middle
+	const uint32 Published = Back;
+	const uint32 OldMiddle = Middle.exchange(Published | FreshFlag);
+	Back = OldMiddle & SlotMask;
+
+	for (const FDeformMeshMailboxEntry& Entry : Slots[Published].Entries)
+	{
+		BackEntryIndices[Entry.SectionIndex] = INDEX_NONE;
+	}
+
+	if (OldMiddle & FreshFlag)
+	{
+		//The render thread skipped that frame, it keeps its entries and gets the newer ones of the published frame, which the render thread only reads
+		for (int32 EntryIndex = 0; EntryIndex < Slots[Back].Entries.Num(); EntryIndex++)
+		{
+			BackEntryIndices[Slots[Back].Entries[EntryIndex].SectionIndex] = EntryIndex;
+		}
+		MergeIntoBack(Slots[Published].Entries);
+		//Sections only the skipped frame had still have to be published
+		bBackDirty = Slots[Back].Entries.Num() > Slots[Published].Entries.Num();
+	}
+	else
+	{
+		//The render thread gave this slot back when it took its current frame, it's done with it
+		Slots[Back].Entries.Reset();
+		bBackDirty = false;
+	}
+
+	WriteSerial++;
+	return true;
+}
+
+void FDeformMeshTransformMailbox::MergeIntoBack(TArrayView<const FDeformMeshMailboxEntry> NewEntries)
+{
+	TArray<FDeformMeshMailboxEntry>& BackEntries = Slots[Back].Entries;
+	for (const FDeformMeshMailboxEntry& NewEntry : NewEntries)
+	{
+		int32& EntryIndex = BackEntryIndices[NewEntry.SectionIndex];
+		if (EntryIndex == INDEX_NONE)
+		{
+			EntryIndex = BackEntries.Add(NewEntry);
+		}
+		else
+		{
+			BackEntries[EntryIndex] = NewEntry;
+		}
+	}
+}
+
+bool FDeformMeshTransformMailbox::RequestDrain()
+{
+	return !bDrainRequested.exchange(true);
+}
+
+TArrayView<const FDeformMeshMailboxEntry> FDeformMeshTransformMailbox::Acquire()
+{
+	//Clear the request first, a frame published after this is either taken below or gets a new request
+	bDrainRequested.store(false);
+	if ((Middle.load() & FreshFlag) == 0)
+	{
+		return TArrayView<const FDeformMeshMailboxEntry>();
+	}
+
+	//Give the current frame back to the game thread, and take the published one
+	const uint32 OldMiddle = Middle.exchange(Front);
+	Front = OldMiddle & SlotMask;
+	return Slots[Front].Entries;
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshMailbox, Log, All);
+
+/*
+ * Runs a game thread writer and a render thread reader on two threads as fast as they can go, the reader stays behind most of the time
+ * Every element of a written matrix is the number of the write, so a torn entry, an entry older than one already read, or a lost write is detected
+ * The threads only synchronize through the mailbox atomics, so this is meant to be run under a thread sanitizer too
+ * Usage: DeformMesh.StressTransformMailbox [NumFrames=200000] [NumSections=1024]
+*/
+static void StressTransformMailbox(const TArray<FString>& Args)
+{
+	const int32 NumFrames = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 200000;
+	const int32 NumSections = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 1024;
+
+	struct FReaderResult
+	{
+		int32 NumAcquired = 0;
+		int32 NumTorn = 0;
+		int32 NumOutOfOrder = 0;
+		TArray<float> ReadValues;
+	};
+
+	FDeformMeshTransformMailbox Mailbox;
+	std::atomic<bool> bWriterDone(false);
+
+	TFuture<FReaderResult> Reader = Async(EAsyncExecution::Thread, [&Mailbox, &bWriterDone, NumSections]()
+	{
+		FReaderResult Result;
+		Result.ReadValues.Init(-1.0f, NumSections);
+		TArray<uint32> ReadSerials;
+		ReadSerials.Init(0, NumSections);
+		while (true)
+		{
+			//Take the frames until the writer is done, then once more for its last frame
+			const bool bLastPass = bWriterDone.load();
+			TArrayView<const FDeformMeshMailboxEntry> Entries = Mailbox.Acquire();
+			Result.NumAcquired += Entries.Num() > 0 ? 1 : 0;
+			for (const FDeformMeshMailboxEntry& Entry : Entries)
+			{
+				const float Value = Entry.Transform.M[0][0];
+				for (int32 Element = 0; Element < 16; Element++)
+				{
+					Result.NumTorn += Entry.Transform.M[Element / 4][Element % 4] != Value ? 1 : 0;
+				}
+				Result.NumOutOfOrder += (Entry.Serial < ReadSerials[Entry.SectionIndex] || Value < Result.ReadValues[Entry.SectionIndex]) ? 1 : 0;
+				ReadSerials[Entry.SectionIndex] = Entry.Serial;
+				Result.ReadValues[Entry.SectionIndex] = Value;
+			}
+			if (bLastPass)
+			{
+				break;
+			}
+		}
+		return Result;
+	});
+
+	//Sparse frames of random sizes, a few frames write everything
+	FRandomStream Random(0xDEF2);
+	TArray<float> WrittenValues;
+	WrittenValues.Init(-1.0f, NumSections);
+	int32 NumPublished = 0;
+	int32 WriteCount = 0;
+	const double StartTime = FPlatformTime::Seconds();
+	//Floats count exactly up to 2^24, the run stops there
+	constexpr int32 MaxWrites = 1 << 24;
+	int32 Frame = 0;
+	for (; Frame < NumFrames && WriteCount + NumSections <= MaxWrites; Frame++)
+	{
+		const int32 NumWrites = Random.FRand() < 0.01f ? NumSections : Random.RandRange(1, FMath::Max(NumSections / 16, 1));
+		for (int32 WriteIndex = 0; WriteIndex < NumWrites; WriteIndex++)
+		{
+			const int32 SectionIndex = NumWrites == NumSections ? WriteIndex : Random.RandHelper(NumSections);
+			const float Value = (float)WriteCount++;
+			FMatrix44f Transform;
+			for (int32 Element = 0; Element < 16; Element++)
+			{
+				Transform.M[Element / 4][Element % 4] = Value;
+			}
+			Mailbox.Write(SectionIndex, Transform);
+			WrittenValues[SectionIndex] = Value;
+		}
+		NumPublished += Mailbox.Publish() ? 1 : 0;
+	}
+	//The last publish can leave the entries of a frame the reader skipped, like UDeformMeshComponent::SendTransformMailbox the writer publishes until nothing is left
+	while (Mailbox.HasUnpublishedWrites())
+	{
+		NumPublished += Mailbox.Publish() ? 1 : 0;
+	}
+	const double WriteTime = FPlatformTime::Seconds() - StartTime;
+	bWriterDone.store(true);
+
+	const FReaderResult Result = Reader.Get();
+
+	//After the last frame the reader must have the last write of every section
+	int32 NumLost = 0;
+	for (int32 SectionIndex = 0; SectionIndex < NumSections; SectionIndex++)
+	{
+		NumLost += Result.ReadValues[SectionIndex] != WrittenValues[SectionIndex] ? 1 : 0;
+	}
+
+	UE_LOG(LogDeformMeshMailbox, Display, TEXT("Transform mailbox, %d sections: %d frames published in %.1f ms (%.2f us per frame), %d taken by the reader"),
+		NumSections, NumPublished, WriteTime * 1000.0, WriteTime * 1000000.0 / FMath::Max(Frame, 1), Result.NumAcquired);
+
+	FDeformMeshTestChecks Checks(LogDeformMeshMailbox, TEXT("Transform mailbox"));
+	Checks.Check(Result.NumTorn == 0, TEXT("%d torn entries"), Result.NumTorn);
+	Checks.Check(Result.NumOutOfOrder == 0, TEXT("%d entries out of order"), Result.NumOutOfOrder);
+	Checks.Check(NumLost == 0, TEXT("%d sections without their last write"), NumLost);
+	Checks.Report(FString::Printf(TEXT("%d sections"), NumSections));
+}
+
+static FAutoConsoleCommand StressTransformMailboxCommand(
+	TEXT("DeformMesh.StressTransformMailbox"),
+	TEXT("Runs a writer and a reader of a transform mailbox on two threads and checks what the reader sees. Usage: DeformMesh.StressTransformMailbox [NumFrames=200000] [NumSections=1024]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&StressTransformMailbox));
+#endif
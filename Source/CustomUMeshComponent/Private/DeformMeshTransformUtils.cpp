@@ -0,0 +1,262 @@
+#include "DeformMeshTransformUtils.h"
+#include "Async/ParallelFor.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+#include "Math/RandomStream.h"
+
+/*
+ * SIMD kernel converting one transform
+ * The matrix terms are the same as FQuatRotationTranslationMatrix, we build the columns of the row-vector matrix directly since that's the transposed layout that the shader reads
+ * The box is transformed with the center/extent form: NewExtent = Sum(|Extent.i| * |Row.i|), which gives the same box as FBox::TransformBy
+*/
+static FORCEINLINE void ConvertTransform(const FTransform& Transform, const FBox& LocalBox, FMatrix44f& OutMatrix, FBox& OutBox)
+{
+	const FQuat4f Rotation(Transform.GetRotation());
+	const FVector3f Scale(Transform.GetScale3D());
+	const FVector3f Translation(Transform.GetTranslation());
+
+	const float X2 = Rotation.X + Rotation.X;
+	const float Y2 = Rotation.Y + Rotation.Y;
+	const float Z2 = Rotation.Z + Rotation.Z;
+	const float XX = Rotation.X * X2;
+	const float XY = Rotation.X * Y2;
+	const float XZ = Rotation.X * Z2;
+	const float YY = Rotation.Y * Y2;
+	const float YZ = Rotation.Y * Z2;
+	const float ZZ = Rotation.Z * Z2;
+	const float WX = Rotation.W * X2;
+	const float WY = Rotation.W * Y2;
+	const float WZ = Rotation.W * Z2;
+
+	//Row i of the rotation is scaled by Scale[i], so each column is multiplied by the scale vector
+	const VectorRegister4Float ScaleVec = MakeVectorRegisterFloat(Scale.X, Scale.Y, Scale.Z, 1.0f);
+	const VectorRegister4Float Column0 = VectorMultiply(MakeVectorRegisterFloat(1.0f - (YY + ZZ), XY - WZ, XZ + WY, Translation.X), ScaleVec);
+	const VectorRegister4Float Column1 = VectorMultiply(MakeVectorRegisterFloat(XY + WZ, 1.0f - (XX + ZZ), YZ - WX, Translation.Y), ScaleVec);
+	const VectorRegister4Float Column2 = VectorMultiply(MakeVectorRegisterFloat(XZ - WY, YZ + WX, 1.0f - (XX + YY), Translation.Z), ScaleVec);
+
+	VectorStore(Column0, &OutMatrix.M[0][0]);
+	VectorStore(Column1, &OutMatrix.M[1][0]);
+	VectorStore(Column2, &OutMatrix.M[2][0]);
+	VectorStore(MakeVectorRegisterFloat(0.0f, 0.0f, 0.0f, 1.0f), &OutMatrix.M[3][0]);
+
+	if (!LocalBox.IsValid)
+	{
+		OutBox = FBox(ForceInit);
+		return;
+	}
+
+	//The rows of the row-vector matrix
+	const VectorRegister4Float Row0 = VectorMultiply(MakeVectorRegisterFloat(1.0f - (YY + ZZ), XY + WZ, XZ - WY, 0.0f), VectorSetFloat1(Scale.X));
+	const VectorRegister4Float Row1 = VectorMultiply(MakeVectorRegisterFloat(XY - WZ, 1.0f - (XX + ZZ), YZ + WX, 0.0f), VectorSetFloat1(Scale.Y));
+	const VectorRegister4Float Row2 = VectorMultiply(MakeVectorRegisterFloat(XZ + WY, YZ - WX, 1.0f - (XX + YY), 0.0f), VectorSetFloat1(Scale.Z));
+	const VectorRegister4Float Row3 = MakeVectorRegisterFloat(Translation.X, Translation.Y, Translation.Z, 0.0f);
+
+	const FVector3f Center(LocalBox.GetCenter());
+	const FVector3f Extent(LocalBox.GetExtent());
+
+	VectorRegister4Float NewCenter = VectorMultiplyAdd(VectorSetFloat1(Center.X), Row0, Row3);
+	NewCenter = VectorMultiplyAdd(VectorSetFloat1(Center.Y), Row1, NewCenter);
+	NewCenter = VectorMultiplyAdd(VectorSetFloat1(Center.Z), Row2, NewCenter);
+
+	VectorRegister4Float NewExtent = VectorMultiply(VectorSetFloat1(Extent.X), VectorAbs(Row0));
+	NewExtent = VectorMultiplyAdd(VectorSetFloat1(Extent.Y), VectorAbs(Row1), NewExtent);
+	NewExtent = VectorMultiplyAdd(VectorSetFloat1(Extent.Z), VectorAbs(Row2), NewExtent);
+
+	alignas(16) float Min[4];
+	alignas(16) float Max[4];
+	VectorStoreAligned(VectorSubtract(NewCenter, NewExtent), Min);
+	VectorStoreAligned(VectorAdd(NewCenter, NewExtent), Max);
+	OutBox = FBox(FVector(Min[0], Min[1], Min[2]), FVector(Max[0], Max[1], Max[2]));
+}
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Transform Utils Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+void FDeformMeshTransformUtils::ConvertTransforms(TArrayView<const FTransform> Transforms, TArrayView<const FBox> LocalBoxes, TArrayView<FMatrix44f> OutMatrices, TArrayView<FBox> OutBoxes)
+{
+	const int32 Num = Transforms.Num();
+	check(LocalBoxes.Num() == Num && OutMatrices.Num() == Num && OutBoxes.Num() == Num);
+
+	//Each task converts a contiguous chunk, so the tasks never write to the same cache lines except at the chunk boundaries
+	const int32 NumChunks = FMath::DivideAndRoundUp(Num, ChunkSize);
+	ParallelFor(NumChunks, [&](int32 ChunkIndex)
+		{
+			const int32 Start = ChunkIndex * ChunkSize;
+			const int32 End = FMath::Min(Start + ChunkSize, Num);
+			for (int32 Index = Start; Index < End; Index++)
+			{
+				ConvertTransform(Transforms[Index], LocalBoxes[Index], OutMatrices[Index], OutBoxes[Index]);
+			}
+		},
+		NumChunks > 1 ? EParallelForFlags::None : EParallelForFlags::ForceSingleThread);
+}
+
+void FDeformMeshTransformUtils::ConvertTransformsScalar(TArrayView<const FTransform> Transforms, TArrayView<const FBox> LocalBoxes, TArrayView<FMatrix44f> OutMatrices, TArrayView<FBox> OutBoxes)
+{
+	const int32 Num = Transforms.Num();
+	check(LocalBoxes.Num() == Num && OutMatrices.Num() == Num && OutBoxes.Num() == Num);
+
+	for (int32 Index = 0; Index < Num; Index++)
+	{
+		OutMatrices[Index] = FMatrix44f(Transforms[Index].ToMatrixWithScale().GetTransposed());
+		OutBoxes[Index] = LocalBoxes[Index].TransformBy(Transforms[Index]);
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshTransformUtils, Log, All);
+
+/* Random transforms with mirrored and non uniform scales, and mesh boxes with a few invalid ones, like the boxes of cleared sections */
+static void MakeRandomTransforms(int32 Num, FRandomStream& Random, TArray<FTransform>& OutTransforms, TArray<FBox>& OutBoxes)
+{
+	OutTransforms.SetNumUninitialized(Num);
+	OutBoxes.SetNumUninitialized(Num);
+	for (int32 Index = 0; Index < Num; Index++)
+	{
+		const FVector Scale(Random.FRandRange(0.1f, 4.0f) * (Random.FRand() < 0.1f ? -1.0f : 1.0f), Random.FRandRange(0.1f, 4.0f), Random.FRandRange(0.1f, 4.0f));
+		OutTransforms[Index] = FTransform(FQuat(Random.GetUnitVector(), Random.FRandRange(-PI, PI)), Random.GetUnitVector() * Random.FRandRange(0.0f, 10000.0f), Scale);
+
+		const FVector Center = Random.GetUnitVector() * Random.FRandRange(0.0f, 100.0f);
+		const FVector Extent(Random.FRandRange(1.0f, 200.0f), Random.FRandRange(1.0f, 200.0f), Random.FRandRange(1.0f, 200.0f));
+		OutBoxes[Index] = Random.FRand() < 0.01f ? FBox(ForceInit) : FBox(Center - Extent, Center + Extent);
+	}
+}
+
+/*
+ * Checks the SIMD conversion against the scalar one on random transforms, on one chunk and on several chunks converted in parallel
+ * The scalar path computes in double and the kernel in float, so the tolerances are relative to the magnitude of the outputs:
+ * 1e-5 of the scale for the rotation and scale terms, 1e-6 of the translation for the translation, and 1e-5 of the largest coordinate for the boxes
+ * Usage: DeformMesh.TestTransformUtils [NumTransforms=10000]
+*/
+static void TestTransformUtils(const TArray<FString>& Args)
+{
+	const int32 NumTransforms = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 10000;
+	FRandomStream Random(0xDEF4);
+
+	TArray<FTransform> Transforms;
+	TArray<FBox> Boxes;
+	MakeRandomTransforms(NumTransforms, Random, Transforms, Boxes);
+
+	TArray<FMatrix44f> ScalarMatrices, Matrices;
+	TArray<FBox> ScalarBoxes, OutBoxes;
+	ScalarMatrices.SetNumUninitialized(NumTransforms);
+	Matrices.SetNumUninitialized(NumTransforms);
+	ScalarBoxes.SetNumUninitialized(NumTransforms);
+	OutBoxes.SetNumUninitialized(NumTransforms);
+	FDeformMeshTransformUtils::ConvertTransformsScalar(Transforms, Boxes, ScalarMatrices, ScalarBoxes);
+
+	FDeformMeshTestChecks Checks(LogDeformMeshTransformUtils, TEXT("Transform utils"));
+	float MaxMatrixError = 0.0f;
+	double MaxBoxError = 0.0;
+	auto Compare = [&](int32 Start, int32 Num)
+	{
+		for (int32 Index = Start; Index < Start + Num; Index++)
+		{
+			const double TranslationTolerance = FMath::Max(Transforms[Index].GetTranslation().GetAbsMax(), 1.0) * 1e-6;
+			const float ScaleTolerance = (float)Transforms[Index].GetScale3D().GetAbsMax() * 1e-5f;
+			float MatrixError = 0.0f;
+			bool bMatrixError = false;
+			for (int32 Row = 0; Row < 4; Row++)
+			{
+				for (int32 Column = 0; Column < 4; Column++)
+				{
+					const float Error = FMath::Abs(Matrices[Index].M[Row][Column] - ScalarMatrices[Index].M[Row][Column]);
+					bMatrixError |= Error > (Column == 3 ? (float)TranslationTolerance : ScaleTolerance);
+					MatrixError = FMath::Max(MatrixError, Error);
+				}
+			}
+			Checks.Check(!bMatrixError, TEXT("transform %d, the matrix is off by %g"), Index, MatrixError);
+			MaxMatrixError = FMath::Max(MaxMatrixError, MatrixError);
+
+			const FBox& Box = OutBoxes[Index];
+			const FBox& ScalarBox = ScalarBoxes[Index];
+			if (!Checks.Check(Box.IsValid == ScalarBox.IsValid, TEXT("transform %d, the box validity differs"), Index))
+			{
+				continue;
+			}
+			if (Box.IsValid)
+			{
+				const double BoxError = FMath::Max((Box.Min - ScalarBox.Min).GetAbsMax(), (Box.Max - ScalarBox.Max).GetAbsMax());
+				const double BoxTolerance = FMath::Max3(ScalarBox.Min.GetAbsMax(), ScalarBox.Max.GetAbsMax(), 1.0) * 1e-5;
+				Checks.Check(BoxError <= BoxTolerance, TEXT("transform %d, the box is off by %g"), Index, BoxError);
+				MaxBoxError = FMath::Max(MaxBoxError, BoxError);
+			}
+		}
+	};
+
+	//One chunk, converted on this thread
+	const int32 NumSingleChunk = FMath::Min(NumTransforms, FDeformMeshTransformUtils::ChunkSize);
+	FDeformMeshTransformUtils::ConvertTransforms(MakeArrayView(Transforms.GetData(), NumSingleChunk), MakeArrayView(Boxes.GetData(), NumSingleChunk), MakeArrayView(Matrices.GetData(), NumSingleChunk), MakeArrayView(OutBoxes.GetData(), NumSingleChunk));
+	Compare(0, NumSingleChunk);
+
+	//Everything, with a partial last chunk when the count isn't a multiple of the chunk size
+	FDeformMeshTransformUtils::ConvertTransforms(Transforms, Boxes, Matrices, OutBoxes);
+	Compare(0, NumTransforms);
+
+	Checks.Report(FString::Printf(TEXT("%d transforms, largest differences %g for the matrices and %g for the boxes"), NumTransforms, MaxMatrixError, MaxBoxError));
+}
+
+/*
+ * Times the scalar conversion, the SIMD kernel on the calling thread, and the SIMD kernel over parallel chunks
+ * Usage: DeformMesh.BenchmarkTransformUtils [NumTransforms=100000] [NumRuns=20]
+*/
+static void BenchmarkTransformUtils(const TArray<FString>& Args)
+{
+	const int32 NumTransforms = Args.Num() > 0 ? FMath::Max(FCString::Atoi(*Args[0]), 1) : 100000;
+	const int32 NumRuns = Args.Num() > 1 ? FMath::Max(FCString::Atoi(*Args[1]), 1) : 20;
+	FRandomStream Random(0xDEF5);
+
+	TArray<FTransform> Transforms;
+	TArray<FBox> Boxes;
+	MakeRandomTransforms(NumTransforms, Random, Transforms, Boxes);
+
+	TArray<FMatrix44f> Matrices;
+	TArray<FBox> OutBoxes;
+	Matrices.SetNumUninitialized(NumTransforms);
+	OutBoxes.SetNumUninitialized(NumTransforms);
+
+	//The best run of each, the first one also pages in the outputs
+	auto Time = [NumRuns](TFunctionRef<void()> Convert)
+	{
+		double BestTime = DBL_MAX;
+		for (int32 Run = 0; Run < NumRuns; Run++)
+		{
+			const double StartTime = FPlatformTime::Seconds();
+			Convert();
+			BestTime = FMath::Min(BestTime, FPlatformTime::Seconds() - StartTime);
+		}
+		return BestTime;
+	};
+
+	const double ScalarTime = Time([&]()
+		{
+			FDeformMeshTransformUtils::ConvertTransformsScalar(Transforms, Boxes, Matrices, OutBoxes);
+		});
+	const double SingleThreadTime = Time([&]()
+		{
+			//Chunk by chunk, each call is below the parallel threshold
+			for (int32 Start = 0; Start < NumTransforms; Start += FDeformMeshTransformUtils::ChunkSize)
+			{
+				const int32 Num = FMath::Min(FDeformMeshTransformUtils::ChunkSize, NumTransforms - Start);
+				FDeformMeshTransformUtils::ConvertTransforms(MakeArrayView(Transforms.GetData() + Start, Num), MakeArrayView(Boxes.GetData() + Start, Num), MakeArrayView(Matrices.GetData() + Start, Num), MakeArrayView(OutBoxes.GetData() + Start, Num));
+			}
+		});
+	const double ParallelTime = Time([&]()
+		{
+			FDeformMeshTransformUtils::ConvertTransforms(Transforms, Boxes, Matrices, OutBoxes);
+		});
+
+	UE_LOG(LogDeformMeshTransformUtils, Display, TEXT("Transform utils, %d transforms: scalar %.3f ms, SIMD %.3f ms (%.1fx), SIMD in parallel %.3f ms (%.1fx)"),
+		NumTransforms, ScalarTime * 1000.0, SingleThreadTime * 1000.0, ScalarTime / FMath::Max(SingleThreadTime, UE_SMALL_NUMBER), ParallelTime * 1000.0, ScalarTime / FMath::Max(ParallelTime, UE_SMALL_NUMBER));
+}
+
+static FAutoConsoleCommand TestTransformUtilsCommand(
+	TEXT("DeformMesh.TestTransformUtils"),
+	TEXT("Checks the SIMD conversion of the deform transforms against the scalar one. Usage: DeformMesh.TestTransformUtils [NumTransforms=10000]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&TestTransformUtils));
+
+static FAutoConsoleCommand BenchmarkTransformUtilsCommand(
+	TEXT("DeformMesh.BenchmarkTransformUtils"),
+	TEXT("Times the scalar and the SIMD conversions of the deform transforms. Usage: DeformMesh.BenchmarkTransformUtils [NumTransforms=100000] [NumRuns=20]"),
+	FConsoleCommandWithArgsDelegate::CreateStatic(&BenchmarkTransformUtils));
+#endif
@@ -0,0 +1,208 @@
+#include "DeformMeshVertexFactory.h"
+#include "DeformMeshComponent.h"
+#include "DeformMeshSceneProxy.h"
+#include "DeformMeshCache.h"
+#include "DeformMeshTransformFormat.h"
+#include "DeformMeshTransformUtils.h"
+#include "MeshDrawShaderBindings.h"
+#include "HAL/IConsoleManager.h"
+#include "DeformMeshTestUtils.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Vertex Factory Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+bool FDeformMeshVertexFactory::ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
+{
+	//Only surface materials can be used on a deform mesh, but the engine's special materials (default, wireframe..) are needed as fallbacks
+	return (Parameters.MaterialParameters.MaterialDomain == MD_Surface || Parameters.MaterialParameters.bIsSpecialEngineMaterial)
+		&& FLocalVertexFactory::ShouldCompilePermutation(Parameters);
+}
+
+void FDeformMeshVertexFactory::ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FLocalVertexFactory::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("DEFORM_MESH"), TEXT("1"));
+}
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Cached Vertex Factory Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+bool FDeformMeshCachedVertexFactory::ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters)
+{
+	return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5)
+		&& FDeformMeshVertexFactory::ShouldCompilePermutation(Parameters);
+}
+
+void FDeformMeshCachedVertexFactory::ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
+{
+	FDeformMeshVertexFactory::ModifyCompilationEnvironment(Parameters, OutEnvironment);
+	OutEnvironment.SetDefine(TEXT("DEFORM_MESH_CACHE"), TEXT("1"));
+}
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Vertex Factory Shader Parameters Methods' Definitions
+///////////////////////////////////////////////////////////////////////
+void FDeformMeshVertexFactoryShaderParameters::Bind(const FShaderParameterMap& ParameterMap)
+{
+	FLocalVertexFactoryShaderParametersBase::Bind(ParameterMap);
+	//The names must match the parameters declared in CustomLocalVertexFactory.ush and DeformMeshCommon.ush
+	TransformIndex.Bind(ParameterMap, TEXT("DMTransformIndex"), SPF_Optional);
+	TransformsSRV.Bind(ParameterMap, TEXT("DMTransforms"), SPF_Optional);
+	PreviousTransformsSRV.Bind(ParameterMap, TEXT("DMPreviousTransforms"), SPF_Optional);
+	TransformFormat.Bind(ParameterMap, TEXT("DMTransformFormat"), SPF_Optional);
+	Instanced.Bind(ParameterMap, TEXT("DMInstanced"), SPF_Optional);
+	InstanceTransformIndicesSRV.Bind(ParameterMap, TEXT("DMInstanceTransformIndices"), SPF_Optional);
+	LatticeSlotsSRV.Bind(ParameterMap, TEXT("DMLatticeSlots"), SPF_Optional);
+	LatticesSRV.Bind(ParameterMap, TEXT("DMLattices"), SPF_Optional);
+	CachePositionsSRV.Bind(ParameterMap, TEXT("DMCachePositions"), SPF_Optional);
+	CachePreviousPositionsSRV.Bind(ParameterMap, TEXT("DMCachePreviousPositions"), SPF_Optional);
+	CacheTangentsSRV.Bind(ParameterMap, TEXT("DMCacheTangents"), SPF_Optional);
+}
+
+uint32 FDeformMeshVertexFactoryShaderParameters::GetNumBoundDeformParameters() const
+{
+	const bool Bound[] = {
+		TransformIndex.IsBound(), TransformsSRV.IsBound(), PreviousTransformsSRV.IsBound(), TransformFormat.IsBound(), Instanced.IsBound(), InstanceTransformIndicesSRV.IsBound(),
+		LatticeSlotsSRV.IsBound(), LatticesSRV.IsBound(), CachePositionsSRV.IsBound(), CachePreviousPositionsSRV.IsBound(), CacheTangentsSRV.IsBound()
+	};
+	uint32 NumBound = 0;
+	for (const bool bBound : Bound)
+	{
+		NumBound += bBound ? 1 : 0;
+	}
+	return NumBound;
+}
+
+void FDeformMeshVertexFactoryShaderParameters::GetElementShaderBindings(
+	const FSceneInterface* Scene,
+	const FSceneView* View,
+	const FMeshMaterialShader* Shader,
+	const EVertexInputStreamType InputStreamType,
+	ERHIFeatureLevel::Type FeatureLevel,
+	const FVertexFactory* VertexFactory,
+	const FMeshBatchElement& BatchElement,
+	FMeshDrawSingleShaderBindings& ShaderBindings,
+	FVertexInputStreamArray& VertexStreams) const
+{
+	const FDeformMeshVertexFactory* DeformMeshVertexFactory = static_cast<const FDeformMeshVertexFactory*>(VertexFactory);
+
+	//Bind the local vertex factory parameters (LocalVF uniform buffer, vertex color override..)
+	GetElementShaderBindingsBase(Scene, View, Shader, InputStreamType, FeatureLevel, VertexFactory, BatchElement, DeformMeshVertexFactory->GetUniformBuffer(), ShaderBindings, VertexStreams);
+
+	//Bind the index of this section's transform and the SRV of the transforms structured buffer, both come from the batch element since the vertex factory is shared
+	check(!BatchElement.bUserDataIsColorVertexBuffer);
+	ShaderBindings.Add(TransformIndex, (uint32)BatchElement.UserIndex);
+
+	const FDeformMeshSceneProxy* SceneProxy = static_cast<const FDeformMeshSceneProxy*>(BatchElement.UserData);
+	check(SceneProxy);
+	ShaderBindings.Add(TransformsSRV, SceneProxy->GetDeformTransformsSRV());
+	ShaderBindings.Add(PreviousTransformsSRV, SceneProxy->GetPreviousDeformTransformsSRV());
+	ShaderBindings.Add(TransformFormat, (uint32)SceneProxy->GetTransformFormat());
+
+	//Instanced batches draw one section per instance, and find the transform index of each instance in the indices buffer
+	const uint32 bInstanced = BatchElement.NumInstances > 1 ? 1 : 0;
+	ShaderBindings.Add(Instanced, bInstanced);
+	ShaderBindings.Add(InstanceTransformIndicesSRV, SceneProxy->GetInstanceTransformIndicesSRV());
+
+	//The lattice of each section is found through its transform index
+	ShaderBindings.Add(LatticeSlotsSRV, SceneProxy->GetLatticeSlotsSRV());
+	ShaderBindings.Add(LatticesSRV, SceneProxy->GetLatticesSRV());
+
+	//The cached vertex factory reads the vertices deformed by the section's cache
+	if (VertexFactory->GetType() == &FDeformMeshCachedVertexFactory::StaticType)
+	{
+		const FDeformMeshSectionCache* Cache = SceneProxy->GetSectionCache(BatchElement.UserIndex);
+		check(Cache && BatchElement.NumInstances == 1);
+		ShaderBindings.Add(CachePositionsSRV, Cache->GetPositionsSRV());
+		ShaderBindings.Add(CachePreviousPositionsSRV, Cache->GetPreviousPositionsSRV());
+		ShaderBindings.Add(CacheTangentsSRV, Cache->GetTangentsSRV());
+	}
+}
+
+IMPLEMENT_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters);
+
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshVertexFactory, "/CustomShaders/CustomLocalVertexFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPositionOnly
+	| EVertexFactoryFlags::SupportsCachingMeshDrawCommands
+);
+
+IMPLEMENT_VERTEX_FACTORY_PARAMETER_TYPE(FDeformMeshCachedVertexFactory, SF_Vertex, FDeformMeshVertexFactoryShaderParameters);
+
+IMPLEMENT_VERTEX_FACTORY_TYPE(FDeformMeshCachedVertexFactory, "/CustomShaders/CustomLocalVertexFactory.ush",
+	EVertexFactoryFlags::UsedWithMaterials
+	| EVertexFactoryFlags::SupportsDynamicLighting
+	| EVertexFactoryFlags::SupportsPositionOnly
+	| EVertexFactoryFlags::SupportsCachingMeshDrawCommands
+);
+
+#if !UE_BUILD_SHIPPING
+DEFINE_LOG_CATEGORY_STATIC(LogDeformMeshVertexFactory, Log, All);
+
+/*
+ * Checks what the vertex factory and the shader must agree on, without compiling a shader:
+ * 1 The layout of the transforms buffer: the format values and the strides that LoadDeformTransform in DeformMeshCommon.ush uses, and the transposed matrix it reads
+ * 2 The parameter binding: every parameter of the shader is bound by name, and a shader that doesn't use some of them still binds the others
+ * Usage: DeformMesh.TestVertexFactory
+*/
+static void TestVertexFactory()
+{
+	FDeformMeshTestChecks Checks(LogDeformMeshVertexFactory, TEXT("Vertex factory"));
+
+	//The DM_TRANSFORM_FORMAT_* defines and the offsets of LoadDeformTransform, a ByteAddressBuffer is read by 4 bytes at least
+	Checks.Check((uint32)EDeformMeshTransformFormat::Full == 0 && (uint32)EDeformMeshTransformFormat::Affine3x4 == 1 && (uint32)EDeformMeshTransformFormat::Quantized == 2, TEXT("the format values don't match DM_TRANSFORM_FORMAT_*"));
+	Checks.Check(FDeformMeshTransformCodec::GetStride(EDeformMeshTransformFormat::Full) == 64, TEXT("the full stride isn't the 64 bytes read by the shader"));
+	Checks.Check(FDeformMeshTransformCodec::GetStride(EDeformMeshTransformFormat::Affine3x4) == 48, TEXT("the affine stride isn't the 48 bytes read by the shader"));
+	Checks.Check(FDeformMeshTransformCodec::GetStride(EDeformMeshTransformFormat::Quantized) == 24, TEXT("the quantized stride isn't the 24 bytes read by the shader"));
+
+	//The shader loads the 4 rows of the stored matrix and transposes them, so each of the first 3 rows ends with a component of the translation
+	const FTransform Transform(FQuat(FVector(1.0, 2.0, 3.0).GetSafeNormal(), 0.7), FVector(10.0, 20.0, 30.0), FVector(1.0, 2.0, 0.5));
+	const FBox LocalBox(FVector(-1.0), FVector(1.0));
+	FMatrix44f Stored;
+	FBox StoredBox;
+	FDeformMeshTransformUtils::ConvertTransformsScalar(MakeArrayView(&Transform, 1), MakeArrayView(&LocalBox, 1), MakeArrayView(&Stored, 1), MakeArrayView(&StoredBox, 1));
+	Checks.Check(Stored.M[0][3] == 10.0f && Stored.M[1][3] == 20.0f && Stored.M[2][3] == 30.0f, TEXT("the translation isn't in the last column of the stored matrix"));
+	Checks.Check(Stored.M[3][0] == 0.0f && Stored.M[3][1] == 0.0f && Stored.M[3][2] == 0.0f && Stored.M[3][3] == 1.0f, TEXT("the last row of the stored matrix isn't (0, 0, 0, 1), the affine format would drop data"));
+	const FVector MeshPoint(1.0, -2.0, 3.0);
+	Checks.Check(FMatrix(Stored.GetTransposed()).TransformPosition(MeshPoint).Equals(Transform.TransformPosition(MeshPoint), 0.001), TEXT("the transposed stored matrix doesn't deform like the transform"));
+
+	//A vertex shader of the cached vertex factory uses every parameter, the other ones don't have the cache parameters, the first 3 are uints
+	const TCHAR* const DeformParameters[] = { TEXT("DMTransformIndex"), TEXT("DMTransformFormat"), TEXT("DMInstanced"), TEXT("DMTransforms"), TEXT("DMPreviousTransforms"), TEXT("DMInstanceTransformIndices"), TEXT("DMLatticeSlots"), TEXT("DMLattices") };
+	const TCHAR* const CacheParameters[] = { TEXT("DMCachePositions"), TEXT("DMCachePreviousPositions"), TEXT("DMCacheTangents") };
+
+	FShaderParameterMap ParameterMap;
+	uint16 BaseIndex = 0;
+	for (int32 Index = 0; Index < UE_ARRAY_COUNT(DeformParameters); Index++)
+	{
+		const bool bLooseData = Index < 3;
+		ParameterMap.AddParameterAllocation(DeformParameters[Index], 0, BaseIndex, bLooseData ? sizeof(uint32) : 1, bLooseData ? EShaderParameterType::LooseData : EShaderParameterType::SRV);
+		BaseIndex += bLooseData ? sizeof(uint32) : 1;
+	}
+
+	FDeformMeshVertexFactoryShaderParameters Parameters;
+	Parameters.Bind(ParameterMap);
+	Checks.Check(Parameters.GetNumBoundDeformParameters() == UE_ARRAY_COUNT(DeformParameters), TEXT("a parameter of the deform vertex factory isn't bound"));
+
+	for (const TCHAR* CacheParameter : CacheParameters)
+	{
+		ParameterMap.AddParameterAllocation(CacheParameter, 0, BaseIndex++, 1, EShaderParameterType::SRV);
+	}
+	FDeformMeshVertexFactoryShaderParameters CachedParameters;
+	CachedParameters.Bind(ParameterMap);
+	Checks.Check(CachedParameters.GetNumBoundDeformParameters() == UE_ARRAY_COUNT(DeformParameters) + UE_ARRAY_COUNT(CacheParameters), TEXT("a parameter of the cached vertex factory isn't bound"));
+
+	//The depth passes use the position only stream, and the static path caches the draws
+	Checks.Check(FDeformMeshVertexFactory::StaticType.SupportsPositionOnly() && FDeformMeshCachedVertexFactory::StaticType.SupportsPositionOnly(), TEXT("the vertex factories don't support the position only stream"));
+	Checks.Check(FDeformMeshVertexFactory::StaticType.SupportsCachingMeshDrawCommands() && FDeformMeshCachedVertexFactory::StaticType.SupportsCachingMeshDrawCommands(), TEXT("the vertex factories don't support cached mesh draw commands"));
+
+	Checks.Report();
+}
+
+static FAutoConsoleCommand TestVertexFactoryCommand(
+	TEXT("DeformMesh.TestVertexFactory"),
+	TEXT("Checks the transforms buffer layout and the parameter binding of the deform mesh vertex factories. Usage: DeformMesh.TestVertexFactory"),
+	FConsoleCommandDelegate::CreateStatic(&TestVertexFactory));
+#endif
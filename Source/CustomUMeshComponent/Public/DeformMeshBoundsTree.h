@@ -0,0 +1,37 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Bounds Tree
+/*
+ * Keeps the union of the local boxes of all the sections, so updating one section's box costs O(log N) instead of rescanning every section
+ * It's a flat binary tree: the leaves (one per section) are stored at [NumLeaves, 2 * NumLeaves) and node i is the union of nodes 2i and 2i+1, node 1 is the root
+ * Invalid boxes (cleared sections) are ignored by the union, so a box that shrinks or goes away is removed from the bounds
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshBoundsTree
+{
+public:
+	FDeformMeshBoundsTree()
+		: NumLeaves(0)
+	{}
+
+	/* Rebuild the whole tree from the boxes of all the sections, O(N) */
+	void Reset(TArrayView<const FBox> LeafBoxes);
+
+	/* Replace the box of one section and update its ancestors, O(log N) */
+	void Update(int32 LeafIndex, const FBox& Box);
+
+	/* Number of sections in the tree */
+	inline int32 Num() const { return NumLeaves; }
+
+	/* The union of the boxes of all the sections, invalid if there are no valid boxes */
+	inline FBox GetBounds() const { return NumLeaves > 0 ? Nodes[1] : FBox(ForceInit); }
+
+	inline SIZE_T GetAllocatedSize() const { return Nodes.GetAllocatedSize(); }
+
+private:
+	int32 NumLeaves;
+	TArray<FBox> Nodes;
+};
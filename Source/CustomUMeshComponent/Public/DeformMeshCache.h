@@ -0,0 +1,116 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GlobalShader.h"
+#include "ShaderParameterStruct.h"
+#include "RenderResource.h"
+#include "RayTracingGeometry.h"
+#include "DeformMeshTransformFormat.h"
+
+struct FStaticMeshVertexBuffers;
+struct FRayTracingGeometryBuildParams;
+class FDeformMeshLODResources;
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Cache Compute Shader
+/*
+ * Deforms the vertices of one LOD of a section with its lattice and its deform transform, and writes them in the section's cache
+ * It runs the same deformation as the vertex factory (see DeformMeshCommon.ush), so a cached section looks exactly like an uncached one
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshCacheCS : public FGlobalShader
+{
+public:
+	DECLARE_GLOBAL_SHADER(FDeformMeshCacheCS);
+	SHADER_USE_PARAMETER_STRUCT(FDeformMeshCacheCS, FGlobalShader);
+
+	static constexpr uint32 ThreadGroupSize = 64;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER(uint32, TransformIndex)
+		SHADER_PARAMETER(uint32, NumVertices)
+		SHADER_PARAMETER(uint32, DMTransformFormat)
+		SHADER_PARAMETER_SRV(ByteAddressBuffer, DMTransforms)
+		SHADER_PARAMETER_SRV(StructuredBuffer<uint>, DMLatticeSlots)
+		SHADER_PARAMETER_SRV(StructuredBuffer<float4>, DMLattices)
+		SHADER_PARAMETER_SRV(Buffer<float>, SourcePositions)
+		SHADER_PARAMETER_SRV(Buffer<float4>, SourceTangents)
+		SHADER_PARAMETER_UAV(RWBuffer<float>, OutPositions)
+		SHADER_PARAMETER_UAV(RWBuffer<float4>, OutTangents)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters);
+	static void ModifyCompilationEnvironment(const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Section Cache
+/*
+ * The deformed vertices of one LOD of a section: positions, tangents, and the positions of the previous frame for the motion vectors
+ * They're written by FDeformMeshCacheCS when the section's transform or lattice changes, instead of being deformed again by every pass that draws the section
+ * The scene proxy owns one cache per cached section, everything here is render thread only
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshSectionCache
+{
+public:
+	/* The static mesh buffers of a LOD can only be read by the compute shader if they were created with SRVs */
+	static bool IsSupported(const FStaticMeshVertexBuffers& VertexBuffers);
+
+	FDeformMeshSectionCache(int32 InLODIndex, const FStaticMeshVertexBuffers& VertexBuffers, ERHIFeatureLevel::Type InFeatureLevel);
+	~FDeformMeshSectionCache();
+
+	/* Deforms the vertices with the transform and the lattice at TransformIndex in the scene proxy's buffers */
+	void Dispatch_RenderThread(FRHICommandListImmediate& RHICmdList, uint32 TransformIndex, EDeformMeshTransformFormat TransformFormat,
+		FRHIShaderResourceView* TransformsSRV, FRHIShaderResourceView* LatticeSlotsSRV, FRHIShaderResourceView* LatticesSRV);
+
+	/* Copies the positions to the previous positions if they were written since the last copy, called at the beginning of each frame */
+	void UpdatePreviousPositions_RenderThread(FRHICommandListImmediate& RHICmdList);
+
+	/* The LOD that the cache holds, the section is always drawn with it */
+	int32 GetLODIndex() const { return LODIndex; }
+
+	//Getters to the SRVs of the cache, used by the vertex factory when binding its shader parameters
+	FRHIShaderResourceView* GetPositionsSRV() const { return Positions.SRV; }
+	FRHIShaderResourceView* GetPreviousPositionsSRV() const { return PreviousPositions.SRV; }
+	FRHIShaderResourceView* GetTangentsSRV() const { return Tangents.SRV; }
+
+	/* GPU memory used by the cache */
+	SIZE_T GetGPUSize() const { return Positions.NumBytes + PreviousPositions.NumBytes + Tangents.NumBytes; }
+
+#if RHI_RAYTRACING
+	/* Creates the BLAS of the deformed positions, with one segment per range of the LOD, built from the positions that were just written */
+	void InitRayTracingGeometry_RenderThread(const FDeformMeshLODResources& LODResources);
+
+	/* Adds the refit of the BLAS if the positions were written since it was built, returns false if it's up to date */
+	bool AddRayTracingRefit(TArray<FRayTracingGeometryBuildParams, TInlineAllocator<16>>& OutBuildParams);
+
+	/* The BLAS of the deformed positions, or null if it wasn't created */
+	const FRayTracingGeometry* GetRayTracingGeometry() const { return RayTracingGeometry.RayTracingGeometryRHI.IsValid() ? &RayTracingGeometry : nullptr; }
+#endif
+
+private:
+	int32 LODIndex;
+	uint32 NumVertices;
+	ERHIFeatureLevel::Type FeatureLevel;
+
+	/* The vertex buffers of the static mesh LOD, the references keep them alive while the cache reads them */
+	FShaderResourceViewRHIRef SourcePositionsSRV;
+	FShaderResourceViewRHIRef SourceTangentsSRV;
+
+	/* 3 floats per vertex */
+	FRWBuffer Positions;
+	FRWBuffer PreviousPositions;
+	/* TangentX and TangentZ of each vertex */
+	FRWBuffer Tangents;
+
+	/* Set when the positions are written, until they're copied to the previous positions */
+	bool bPreviousPositionsStale;
+
+#if RHI_RAYTRACING
+	/* Reads the positions buffer as its vertex buffer, and the index buffer of the static mesh LOD */
+	FRayTracingGeometry RayTracingGeometry;
+	/* Set when the positions are written, until the BLAS is refit */
+	bool bRayTracingGeometryStale;
+#endif
+};
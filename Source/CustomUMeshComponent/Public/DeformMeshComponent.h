@@ -8,14 +8,41 @@
 #include "Components/MeshComponent.h"
 #include "PhysicsEngine/ConvexElem.h"
 #include "Engine/StaticMesh.h"
+#include "DeformMeshBoundsTree.h"
+#include "DeformMeshTransformFormat.h"
+#include "DeformMeshLattice.h"
+#include "DeformMeshSectionBVH.h"
+#include "DeformMeshSubsystem.h"
+#include "DeformMeshTrack.h"
+#include "DeformMeshTransformMailbox.h"
+#include "DeformMeshStats.h"
 #include "DeformMeshComponent.generated.h"
 
 //Forward declarations
 class FPrimitiveSceneProxy;
+class UDeformMeshComponent;
 
+/** Broadcast on the game thread once every section of the component can be drawn */
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnDeformMeshSectionsReady, UDeformMeshComponent*);
 
 
-/** Mesh section of the DeformMesh. A mesh section is a part of the mesh that is rendered with one material (1 material per section)*/
+
+/** How a section is drawn in the shadow depth passes */
+UENUM()
+enum class EDeformMeshShadowMode : uint8
+{
+	/** Like in the other passes, with the LOD of the section */
+	Full,
+	/** With ShadowLODBias coarser LODs, and not at all when the section is smaller than ShadowMinScreenSize on screen, see UDeformMeshComponent */
+	Simplified,
+	/** The section doesn't cast shadows */
+	None,
+};
+
+/**
+ * Mesh section of the DeformMesh. A mesh section is one static mesh deformed by one transform, it's drawn with all the materials of its static mesh
+ * The component material slot with the same index as the section overrides the first material of the static mesh, the other materials come from the static mesh
+ */
 USTRUCT()
 struct FDeformMeshSection
 {
@@ -30,7 +57,7 @@ public:
 	UPROPERTY()
 		FMatrix DeformTransform;
 
-	/** Local bounding box of section */
+	/** Local bounding box of section, the static mesh box deformed by the current deform transform */
 	UPROPERTY()
 		FBox SectionLocalBox;
 
@@ -38,9 +65,28 @@ public:
 	UPROPERTY()
 		bool bSectionVisible;
 
+	/** Offsets of the control points of the section's free form deformation lattice from their rest position (see FDeformMeshLattice), empty when the section has no lattice */
+	UPROPERTY()
+		TArray<FVector3f> LatticeOffsets;
+
+	/** How this section casts shadows */
+	UPROPERTY()
+		EDeformMeshShadowMode ShadowMode;
+
+	/** Whether the deform transform changes often enough for this section to be drawn every frame instead of using cached draws */
+	bool bHot;
+
+	/** Frame of the last deform transform update, and number of updates that came less than HotSectionIdleFrames apart, used to promote the section to hot */
+	uint64 LastTransformUpdateFrame;
+	int32 NumRecentTransformUpdates;
+
 	FDeformMeshSection()
 		: SectionLocalBox(ForceInit)
 		, bSectionVisible(true)
+		, ShadowMode(EDeformMeshShadowMode::Full)
+		, bHot(false)
+		, LastTransformUpdateFrame(0)
+		, NumRecentTransformUpdates(0)
 	{}
 
 	/** Reset this section, clear all mesh info. */
@@ -49,6 +95,22 @@ public:
 		StaticMesh = nullptr;
 		SectionLocalBox.Init();
 		bSectionVisible = true;
+		LatticeOffsets.Empty();
+		ShadowMode = EDeformMeshShadowMode::Full;
+		bHot = false;
+		LastTransformUpdateFrame = 0;
+		NumRecentTransformUpdates = 0;
+	}
+
+	/** Box of the static mesh deformed by the lattice, before the deform transform is applied, empty for a cleared section */
+	FBox GetMeshBox() const
+	{
+		if (StaticMesh == nullptr)
+		{
+			return FBox(ForceInit);
+		}
+		const FBox StaticMeshBox = StaticMesh->GetBoundingBox();
+		return LatticeOffsets.Num() > 0 ? FDeformMeshLattice::GetDeformedBox(StaticMeshBox, LatticeOffsets) : StaticMeshBox;
 	}
 };
 
@@ -60,13 +122,30 @@ class DEFORMMESH_API UDeformMeshComponent : public UMeshComponent
 {
 	GENERATED_BODY()
 public:
+
+	UDeformMeshComponent(const FObjectInitializer& ObjectInitializer = FObjectInitializer::Get());
 	
 	void CreateMeshSection(int32 SectionIndex, UStaticMesh* Mesh, const FTransform& DeformTransform);
 
+	/** Move a section, during the frame it moves in the section outputs velocity from its transform of the previous frame */
 	void UpdateMeshSectionTransform(int32 SectionIndex, const FTransform& DeformTransform);
 
+	/**
+	 *	Update the deform transforms of many sections at once, SectionIndices[i] gets Transforms[i]
+	 *	The bounds are recomputed once, and the matrices are written to the transform mailbox that the render thread drains once per frame
+	 *	so there's no need to call FinishTransformsUpdate after this
+	 */
+	void UpdateMeshSectionTransforms(TArrayView<const int32> SectionIndices, TArrayView<const FTransform> Transforms);
+
+	/** Send the transforms changed with UpdateMeshSectionTransform to the render thread now, instead of at the end of the frame */
 	void FinishTransformsUpdate();
 
+	/**
+	 *	Bend, twist or squash a section with a free form deformation lattice spanning the box of its static mesh, applied before its deform transform
+	 *	ControlPointOffsets holds FDeformMeshLattice::NumControlPoints offsets from the rest position of the control points, or nothing to remove the lattice
+	 */
+	void SetMeshSectionLattice(int32 SectionIndex, TArrayView<const FVector3f> ControlPointOffsets);
+
 	/** Clear a section of the DeformMesh. Other sections do not change index. */
 	void ClearMeshSection(int32 SectionIndex);
 
@@ -79,9 +158,24 @@ public:
 	/** Returns whether a particular section is currently visible */
 	bool IsMeshSectionVisible(int32 SectionIndex) const;
 
+	/** Control how a particular section casts shadows, ignored when the component is batched */
+	void SetMeshSectionShadowMode(int32 SectionIndex, EDeformMeshShadowMode NewShadowMode);
+
+	/** Returns how a particular section casts shadows */
+	EDeformMeshShadowMode GetMeshSectionShadowMode(int32 SectionIndex) const;
+
+	/**
+	 *	The shadow draws of the component during the last rendered frame, counted by the render thread so they lag a frame or two
+	 *	Only the sections drawn by GetDynamicMeshElements are counted per shadow view, the cached draws are drawn by the renderer and only reported as a number of sections
+	 */
+	FDeformMeshShadowDrawStats GetShadowDrawStats() const;
+
 	/** Returns number of sections currently created for this component */
 	int32 GetNumSections() const;
 
+	/** Returns the material used by a section for one material slot of its static mesh */
+	UMaterialInterface* GetSectionMaterial(int32 SectionIndex, int32 MaterialIndex) const;
+
 	/**
 	 *	Get pointer to internal data for one section of this Puzzle mesh component.
 	 *	Note that pointer will becomes invalid if sections are added or removed.
@@ -91,6 +185,174 @@ public:
 	/** Replace a section with new section geometry */
 	void SetDeformMeshSection(int32 SectionIndex, const FDeformMeshSection& Section);
 
+	/**
+	 *	Number of sections that aren't drawn yet because the render resources of their static mesh are still being initialized
+	 *	The render resources are initialized over the next frames on the render thread, so this is the count last reported by the render thread and it lags the section changes
+	 */
+	int32 GetNumPendingSections() const;
+
+	/** Broadcast after the render thread reports that no section is pending, following the creation of the render state or a section change */
+	FOnDeformMeshSectionsReady OnSectionsReady;
+
+	/** Switch between drawing each section on its own and drawing the sections sharing a static mesh and a material with one instanced batch */
+	void SetUseInstancedDrawing(bool bNewUseInstancedDrawing);
+
+	/**
+	 *	When enabled, the sections that use the same static mesh and the same material are drawn with one instanced mesh batch
+	 *	This cuts the number of draw calls when many sections are built from the same mesh
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseInstancedDrawing = false;
+
+	/** Force every section to draw with this LOD, 0 selects the LOD from the screen size of each section and N forces LOD N-1 (same convention as UStaticMeshComponent) */
+	void SetForcedLodModel(int32 NewForcedLodModel);
+
+	/** Prevent the sections from drawing LODs finer than this one */
+	void SetMinLOD(int32 NewMinLOD);
+
+	/**
+	 *	If 0, the LOD of each section is picked per view from its projected screen size, using the screen size thresholds of its static mesh
+	 *	Otherwise all the sections draw with LOD ForcedLodModel - 1
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 0))
+		int32 ForcedLodModel = 0;
+
+	/** The finest LOD that the sections are allowed to draw with, ignored when ForcedLodModel is set */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 0))
+		int32 MinLOD = 0;
+
+	/** Switch between caching the draws of the sections that rarely change and drawing every section every frame */
+	void SetUseStaticDrawPath(bool bNewUseStaticDrawPath);
+
+	/**
+	 *	When enabled, the sections are drawn through DrawStaticElements and their mesh draw commands are cached by the renderer
+	 *	The deform transforms live in a GPU buffer, so updating them doesn't invalidate the cached draws
+	 *	Sections whose transform is updated often are promoted to hot and drawn every frame with GetDynamicMeshElements, and demoted back once they stop changing
+	 *	The cached draws are culled and LOD'ed with the bounds of the whole component, the per section culling and LOD selection only apply to hot sections
+	 *	Off by default, so components keep drawing every section every frame with per section culling and LOD unless they opt in
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseStaticDrawPath = false;
+
+	/** A section becomes hot after this many transform updates, each one coming less than HotSectionIdleFrames after the previous one */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 1))
+		int32 HotSectionUpdateCount = 3;
+
+	/** A hot section goes back to the cached draws after this many frames without a transform update */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 1))
+		int32 HotSectionIdleFrames = 30;
+
+	/** Change how the sections in the Simplified shadow mode cast shadows */
+	void SetShadowLODBias(int32 NewShadowLODBias);
+	void SetShadowMinScreenSize(float NewShadowMinScreenSize);
+
+	/**
+	 *	The sections in the Simplified shadow mode are drawn in the shadow passes with this many coarser LODs than in the other passes
+	 *	The cached draws get extra batches that are only drawn in the shadow passes, a section with a deform cache only has one LOD and keeps it
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 0))
+		int32 ShadowLODBias = 1;
+
+	/**
+	 *	The sections in the Simplified shadow mode that are smaller than this on screen aren't drawn in the shadow passes, each cascade is culled on top of this by its own frustum
+	 *	The screen size is the one the LODs are selected with, this only applies to the sections drawn by GetDynamicMeshElements
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh, meta = (ClampMin = 0))
+		float ShadowMinScreenSize = 0.01f;
+
+	/** Switch between drawing the sections without a lattice as instances of the GPU scene and drawing them with the deform vertex factory */
+	void SetUseGPUSceneInstances(bool bNewUseGPUSceneInstances);
+
+	/**
+	 *	When enabled, and when the platform uses the GPU scene, each section without a lattice is an instance in the instance data of the component's primitive,
+	 *	with its deform transform as the instance's local transform. These sections are drawn with the static mesh's own vertex factory through cached draws,
+	 *	and they get the GPU instance culling of the renderer. Moving a section only rewrites its instance, the draws are never rebuilt and the sections are never hot
+	 *	The sections with a lattice keep the other draw paths. Adding a section past the last one that the scene proxy was created with recreates the render state,
+	 *	and a section mirrored by its deform transform is drawn with the face culling of the component
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseGPUSceneInstances = false;
+
+	/** Change how the deform transforms are stored on the GPU */
+	void SetTransformFormat(EDeformMeshTransformFormat NewTransformFormat);
+
+	/**
+	 *	How the deform transforms are stored in the GPU buffer, smaller formats cut the bytes uploaded per transform update
+	 *	Full is 64 bytes and exact, Affine3x4 is 48 bytes and exact for affine transforms
+	 *	Quantized is 24 bytes, it loses shear and is only suited to translation, rotation and scale transforms (see FDeformMeshTransformCodec for the error bounds)
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		EDeformMeshTransformFormat TransformFormat = EDeformMeshTransformFormat::Full;
+
+	/** Switch between deforming the lattice sections once per update in a compute pass and deforming them in every pass that draws them */
+	void SetUseDeformCache(bool bNewUseDeformCache);
+
+	/**
+	 *	When enabled, the sections with a lattice are deformed by a compute pass when their transform or their lattice changes, and the deformed vertices are kept in a GPU cache
+	 *	Every pass that draws them (depth, base pass, shadows, velocity) then reads the cached vertices instead of evaluating the lattice again
+	 *	The cache keeps the positions of the previous frame too, so the motion vectors of these sections follow their deformation
+	 *	A cached section is always drawn with one LOD: ForcedLodModel if it's set, its finest allowed LOD otherwise. This needs a platform that supports compute shaders
+	 *	Ray tracing only sees the lattice through the cache: without it, the sections with a lattice are left out of the ray tracing scene
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseDeformCache = false;
+
+	/** Switch the collision bodies of the sections on or off, the physics state is recreated */
+	void SetUseSectionCollision(bool bNewUseSectionCollision);
+
+	/**
+	 *	When enabled, each section gets a physics body with the simple collision of its static mesh, placed by the section's deform transform
+	 *	Traces, sweeps and overlaps against the component then hit the sections where they're drawn, with the section index as the hit Item
+	 *	The bodies follow the deform transforms as they're updated, and the shear of a deform transform is lost
+	 *	The sections with a lattice get no body, since it would have the undeformed shape, so they're only hit by LineTraceComponent, with their deformed box
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseSectionCollision = false;
+
+	/**
+	 *	Find the closest section crossed by a world space segment, OutHit.Item is the index of the section
+	 *	The sections are looked up with a BVH over their local boxes, which is refit when the deform transforms change and rebuilt when sections are added or removed
+	 *	A section is tested with its collision body when it has one (see bUseSectionCollision), and with the box of its static mesh, deformed by its lattice and placed by its deform transform, otherwise
+	 *	Params are honoured like a physics trace would: the ignored component or owner, bTraceComplex for the bodies, and bReturnPhysicalMaterial
+	 *	This doesn't need the physics scene, it works on the game thread state of the sections
+	 */
+	bool LineTraceSections(const FVector& Start, const FVector& End, FHitResult& OutHit, const FCollisionQueryParams& Params = FCollisionQueryParams::DefaultQueryParam) const;
+
+	/** Switch between drawing the sections with this component's own scene proxy and handing them to the batches of the world's UDeformMeshSubsystem */
+	void SetUseBatching(bool bNewUseBatching);
+
+	/**
+	 *	When enabled, the component doesn't create a scene proxy, its sections are drawn by the batch components of the world's UDeformMeshSubsystem
+	 *	A batch holds the sections of many components that share a static mesh and a material, and draws them with one scene proxy and one transforms buffer
+	 *	The component becomes a handle: it keeps its sections, bounds and collision, and moving it or updating its sections updates them in their batch
+	 *	The batched transforms reach the batches at the end of the frame's tick. The batches draw with the default settings of this class and instanced drawing,
+	 *	the drawing settings of this component are ignored and OnSectionsReady isn't broadcast
+	 */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		bool bUseBatching = false;
+
+	/**
+	 *	Play a deform track file (see FDeformMeshTrack), section i of the track drives the deform transform of section i of the component
+	 *	The game thread only advances the clock in TickComponent, the render thread decodes the frame of the current time straight into the transforms buffer, streaming the file chunk by chunk
+	 *	While the track plays, the component bounds come from the bounds stored in the track, and the game thread transforms, section boxes and collision keep the values they had before it started
+	 *	Returns false if the file isn't a valid track, or if the component is batched
+	 */
+	bool PlayDeformTrack(const FString& Filename, bool bLoop = false);
+	bool PlayDeformTrack(TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> Track, bool bLoop = false);
+
+	/** Stop the track, the sections stay where it left them, and their transforms are copied back to the game thread */
+	void StopDeformTrack();
+
+	/** Move the clock of the track that is playing, the time is clamped to the track */
+	void SetDeformTrackTime(double NewTime);
+
+	double GetDeformTrackTime() const;
+	bool IsPlayingDeformTrack() const;
+
+	/** Speed of the deform track clock, 0 pauses the track */
+	UPROPERTY(EditAnywhere, Category = DeformMesh)
+		float DeformTrackPlayRate = 1.0f;
+
 
 	
 	//~ Begin UPrimitiveComponent Interface.
@@ -100,12 +362,20 @@ public:
 	* Any PrimitiveComponent has a scene proxy, which is the component's proxy in the render thread
 	* Just like anything else on the game thread, we CAN'T just use it directly to issue render commands and create render resources
 	* Instead, we create a proxy, and we delegate the render threads tasks to it.
-	* PS: There's other methods (Collision related) from this interface that i'm not implementing, beacuse I'm only interested in the rendering
+	* PS: The collision methods are further down, the component has no body setup of its own, so the collision is made of one body per section
 	*/
 	virtual FPrimitiveSceneProxy* CreateSceneProxy() override;
 	//~ End UPrimitiveComponent Interface.
 
 
+	//~ Begin UPrimitiveComponent Interface.
+	/* Index is the section index, the same as the Item of the hit results */
+	virtual FBodyInstance* GetBodyInstance(FName BoneName = NAME_None, bool bGetWelded = true, int32 Index = INDEX_NONE) const override;
+	/* Traces the sections through the section BVH when bUseSectionCollision is enabled */
+	virtual bool LineTraceComponent(FHitResult& OutHit, const FVector Start, const FVector End, const FCollisionQueryParams& Params) override;
+	//~ End UPrimitiveComponent Interface.
+
+
 	//~ Begin UMeshComponent Interface.
 	/* MeshComponent is an abstract base for any component that is an instance of a renderable collection of triangles. (UE4 docs)
 	*/
@@ -113,6 +383,41 @@ public:
 	//~ End UMeshComponent Interface.
 
 
+	//~ Begin UActorComponent Interface.
+	/* Only ticks while some sections are hot, to send them back to the cached draws once they stop changing */
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	//~ End UActorComponent Interface.
+
+
+	//~ Begin UPrimitiveComponent Interface.
+	/* Adds the materials that the sections take from their static meshes to the ones of the component slots, so they're part of the material relevance */
+	virtual void GetUsedMaterials(TArray<UMaterialInterface*>& OutMaterials, bool bGetDebugMaterials = false) const override;
+	//~ End UPrimitiveComponent Interface.
+
+
+	//~ Begin UObject Interface.
+	/* Reports the memory used by the game thread sections, the render thread memory is reported by the scene proxy */
+	virtual void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
+	//~ End UObject Interface.
+
+
+protected:
+
+	//~ Begin UActorComponent Interface.
+	/* Batched components add their sections to the batches with their render state, instead of creating a scene proxy */
+	virtual void CreateRenderState_Concurrent(FRegisterComponentContext* Context) override;
+	virtual void DestroyRenderState_Concurrent() override;
+	/* The batches are game thread objects, so the render state of batched components is recreated on the game thread */
+	virtual bool RequiresGameThreadEndOfFrameRecreate() const override;
+	/* The physics state is the bodies of the sections, it's only created when bUseSectionCollision is enabled */
+	virtual bool ShouldCreatePhysicsState() const override;
+	virtual void OnCreatePhysicsState() override;
+	virtual void OnDestroyPhysicsState() override;
+	/* Publishes the transforms written to the mailbox during the frame */
+	virtual void SendRenderDynamicData_Concurrent() override;
+	//~ End UActorComponent Interface.
+
+
 private:
 
 	//~ Begin USceneComponent Interface.
@@ -123,12 +428,77 @@ private:
 	* But we need to manage the bounds of our component by implementing this method
 	*/
 	virtual FBoxSphereBounds CalcBounds(const FTransform& LocalToWorld) const override;
+	/* The section bodies are in world space, so they're moved with the component */
+	virtual void OnUpdateTransform(EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport = ETeleportType::None) override;
+	/* The batched sections are hidden with the component */
+	virtual void OnVisibilityChanged() override;
 	//~ Begin USceneComponent Interface.
 
 
-	/** Update LocalBounds member from the local box of each section */
+	/** Update LocalBounds member from the local box of each section, rebuilding the bounds tree in O(N) */
 	void UpdateLocalBounds();
 
+	/** Update LocalBounds member after the local box of these sections changed, in O(log N) per section */
+	void UpdateSectionsLocalBounds(TArrayView<const int32> SectionIndices);
+
+	/** Box reached by the sections driven by the track during the frames of a chunk and of the next one */
+	FBox GetDeformTrackBox(int32 ChunkIndex) const;
+
+	/** Set LocalBounds from the root of the bounds tree, and send the new bounds to the render thread if they changed */
+	void SetLocalBoundsFromTree();
+
+	/** Set the game thread state of these sections from their new transforms, and send the transforms to the scene proxy, the batch or the bodies of the sections */
+	void ApplySectionTransforms(TArray<int32>&& UpdatedIndices, TArray<FMatrix44f>&& UpdatedMatrices, TArrayView<const FBox> DeformedBoxes);
+
+	/**
+	 *	Publish the frame written to the transform mailbox and make sure the scene proxy drains it
+	 *	Returns the serial of the next mailbox frame, a render command sent right after this is ordered between the two frames
+	 */
+	uint32 SendTransformMailbox();
+
+	/** Count the transform updates of these sections, and promote the ones that are updated often to hot */
+	void TrackSectionTransformUpdates(TArrayView<const int32> SectionIndices);
+
+	/** Send the hot state of these sections to the render thread */
+	void SendSectionsHotState(TArrayView<const int32> SectionIndices, bool bHot);
+
+	/** Add, replace or remove a section of the scene proxy after it changed on the game thread, the proxy is only recreated if the section brings a new material */
+	void UpdateSectionRenderState(int32 SectionIndex);
+
+	/** Whether the scene proxy's material relevance already accounts for all the materials of this section */
+	bool AreSectionMaterialsInSceneProxy(int32 SectionIndex) const;
+
+	/** World transform of a section's mesh, the deform transform followed by the component transform */
+	FMatrix GetSectionWorldMatrix(int32 SectionIndex) const;
+	FTransform GetSectionWorldTransform(int32 SectionIndex) const;
+
+	/** The subsystem drawing the sections of this component, null when the component has its own scene proxy */
+	UDeformMeshSubsystem* GetBatchSubsystem() const;
+
+	/** Add a section to its batch, or move it to another batch after it changed, or remove it when it was cleared */
+	void UpdateSectionBatchSlot(UDeformMeshSubsystem* Subsystem, int32 SectionIndex);
+
+	/** Queue the world transforms of these batched sections */
+	void UpdateBatchedSectionTransforms(TArrayView<const int32> SectionIndices);
+
+	/** Remove all the sections from their batches */
+	void RemoveSectionsFromBatches();
+
+	/** Called by the subsystem on its batch components, sets the section with a material for its first slot */
+	void SetBatchedSection(int32 SectionIndex, const FDeformMeshSection& Section, UMaterialInterface* Material);
+
+	/** Replace the collision body of a section after its static mesh changed, does nothing when the physics state isn't created */
+	void RecreateSectionBody(int32 SectionIndex);
+
+	/** Move the collision bodies of these sections to their current world transform */
+	void UpdateSectionBodies(TArrayView<const int32> SectionIndices);
+
+	/** Release the collision bodies of all the sections */
+	void DestroySectionBodies();
+
+	/** Called on the game thread by the scene proxy with its number of pending sections */
+	void SetNumPendingSections(int32 NewNumPendingSections);
+
 	/** Array of sections of mesh */
 	UPROPERTY()
 		TArray<FDeformMeshSection> DeformMeshSections;
@@ -137,7 +507,44 @@ private:
 	UPROPERTY()
 		FBoxSphereBounds LocalBounds;
 
+	/** Union of the local boxes of the sections, maintained incrementally when the deform transforms change */
+	FDeformMeshBoundsTree SectionBoundsTree;
+
+	/** Component space BVH over the local boxes of the sections for LineTraceSections, built by the first trace and refit with the bounds tree */
+	mutable FDeformMeshSectionBVH SectionBVH;
+
+	/** The collision body of each section, null for the sections without a static mesh or without a body setup */
+	TArray<FBodyInstance*> SectionBodies;
+
+	/** Where each section is drawn when the component is batched, empty otherwise */
+	TArray<FDeformMeshBatchSlot> BatchSlots;
+
+	/** Carries the transform updates to the scene proxy, created with each scene proxy */
+	TSharedPtr<FDeformMeshTransformMailbox, ESPMode::ThreadSafe> TransformMailbox;
+
+	/** Counted by the scene proxy, see GetShadowDrawStats, created with each scene proxy */
+	TSharedPtr<FDeformMeshShadowDrawCounts, ESPMode::ThreadSafe> ShadowDrawCounts;
+
+	/** The deform track that is playing, its clock, and whether it loops */
+	TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> DeformTrack;
+	double DeformTrackTime = 0.0;
+	bool bLoopDeformTrack = false;
+
+	/** The chunk of the track that LocalBounds accounts for, and the largest distance from the pivot to the mesh box of the sections it drives */
+	int32 DeformTrackBoundsChunk = INDEX_NONE;
+	float DeformTrackMeshRadius = 0.0f;
+
+	/** The sections that are currently hot, checked every tick to demote the ones that stopped changing */
+	TArray<int32> HotSectionIndices;
+
+	/** The materials used when the scene proxy was created */
+	TSet<const UMaterialInterface*> SceneProxyMaterials;
+
+	/** See GetNumPendingSections */
+	int32 NumPendingSections = 0;
+
 	friend class FDeformMeshSceneProxy;
+	friend class UDeformMeshSubsystem;
 };
 
 
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Dirty Ranges
+/*
+ * The scene proxy flags the deform transforms that changed since the last upload in a bit array
+ * Before uploading, the flagged transforms are merged into contiguous ranges so each range is written with one copy
+*/
+///////////////////////////////////////////////////////////////////////
+
+/* A range of consecutive transforms to upload */
+struct FDeformMeshDirtyRange
+{
+	int32 First;
+	int32 Num;
+};
+
+struct DEFORMMESH_API FDeformMeshDirtyRanges
+{
+	/*
+	 * Builds the ranges covering all the set bits of Dirty, in increasing order
+	 * Two runs of set bits separated by at most MaxGap clear bits are merged, the clear entries in between are uploaded again, which is cheaper than one more copy
+	*/
+	static void Build(const TBitArray<>& Dirty, int32 MaxGap, TArray<FDeformMeshDirtyRange, TInlineAllocator<16>>& OutRanges);
+};
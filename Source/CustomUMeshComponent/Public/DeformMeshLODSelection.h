@@ -0,0 +1,21 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh LOD Selection
+/*
+ * Picks the LOD used to draw a section from its projected screen size, the same way static meshes do
+ * LOD i is used while the section is smaller than the screen size of LOD i but not smaller than the screen size of LOD i + 1
+ * The scene proxy computes the screen size of each section and asks here for its LOD
+*/
+///////////////////////////////////////////////////////////////////////
+struct DEFORMMESH_API FDeformMeshLODSelection
+{
+	/*
+	 * Returns the LOD to draw for a given screen size
+	 * LODScreenSizes are the screen size thresholds of the static mesh LODs, in decreasing order
+	 * MinLOD is the finest LOD that can be used, ForcedLOD overrides the selection when it isn't INDEX_NONE, both are clamped to the available LODs
+	*/
+	static int32 SelectLOD(TArrayView<const float> LODScreenSizes, float ScreenSize, int32 MinLOD, int32 ForcedLOD);
+};
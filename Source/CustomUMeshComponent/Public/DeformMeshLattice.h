@@ -0,0 +1,40 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Lattice
+/*
+ * A free form deformation lattice of 4x4x4 control points spanning the box of a section's static mesh
+ * Each vertex is moved by the cubic Bernstein (Bezier) blend of the control points' offsets, before the section's deform transform is applied
+ * With every offset at zero the lattice doesn't move the mesh, so the offsets are all that we store
+ * The vertex factory evaluates the lattice per vertex (see ApplyDeformLattice in DeformMeshCommon.ush), this is the CPU reference of the same evaluation
+*/
+///////////////////////////////////////////////////////////////////////
+struct DEFORMMESH_API FDeformMeshLattice
+{
+	/* Control points along each axis, the lattice is cubic along each axis */
+	static constexpr int32 Resolution = 4;
+	static constexpr int32 NumControlPoints = Resolution * Resolution * Resolution;
+
+	/* Number of float4 per lattice in the GPU buffer: the min corner of the box, the inverse of the box size, then the offsets */
+	static constexpr int32 GPUStride = 2 + NumControlPoints;
+
+	/* Index of a control point in the offsets array, X varies fastest */
+	static int32 GetControlPointIndex(int32 X, int32 Y, int32 Z)
+	{
+		return X + Resolution * (Y + Resolution * Z);
+	}
+
+	/* Position of a control point when the lattice doesn't deform the mesh, the offsets are relative to it */
+	static FVector GetRestControlPoint(const FBox& MeshBox, int32 X, int32 Y, int32 Z);
+
+	/* Deformed position of a point of the mesh, the points outside of the mesh box are moved like the closest point of the box */
+	static FVector Evaluate(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets, const FVector& Position);
+
+	/* Box holding the mesh deformed by the lattice, the Bernstein weights being positive and summing to 1 the mesh stays in the convex hull of the control points */
+	static FBox GetDeformedBox(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets);
+
+	/* Writes the GPUStride float4 of a lattice, as read by the vertex factory */
+	static void WriteGPUData(const FBox& MeshBox, TArrayView<const FVector3f> ControlPointOffsets, FVector4f* Dest);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+/* Which ray tracing geometry a section is traced with */
+enum class EDeformMeshRayTracingMode : uint8
+{
+	/* The BLAS of the static mesh LOD, with the deform transform folded into the instance transform, nothing is ever rebuilt */
+	Rigid,
+	/* The BLAS of the section's deform cache, built from the deformed positions and refit when the cache is written */
+	Cached
+};
+
+/* What the gathering needs to know about one section of the scene proxy */
+struct FDeformMeshRayTracingSection
+{
+	/* The deform transform, transposed like in the transforms buffer */
+	FMatrix44f DeformTransform;
+	int32 LODIndex = 0;
+	bool bVisible = false;
+	/* Whether the static mesh LOD has a ray tracing geometry that matches the ranges of the LOD, and the section can be traced with it: false for a section with a lattice */
+	bool bHasStaticGeometry = false;
+	/* Whether the section has a deform cache with its own ray tracing geometry */
+	bool bHasCachedGeometry = false;
+};
+
+/* One ray tracing instance to add for a section */
+struct FDeformMeshRayTracingInstanceDesc
+{
+	int32 SectionIndex;
+	int32 LODIndex;
+	EDeformMeshRayTracingMode Mode;
+	/* Transform of the instance in the top level acceleration structure */
+	FMatrix InstanceToWorld;
+	/* Local to world of the section, used to shade its hits, it includes the deform transform in both modes */
+	FMatrix ShadingLocalToWorld;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Ray Tracing
+/*
+ * Picks the ray tracing instances of the sections of a scene proxy
+ * A rigid section is an instance of the static mesh BLAS, the deform transform moves the instance instead of the vertices
+ * A section with a deform cache has its vertices deformed already, so its own BLAS is placed with the primitive transform only
+ * A section with a lattice and no deform cache isn't traced: the static mesh BLAS doesn't have the lattice, its hits would be in the wrong place
+ * Hidden sections and sections scaled to nothing aren't traced
+ * The scene proxy fills the sections and turns the instances into FRayTracingInstances
+*/
+///////////////////////////////////////////////////////////////////////
+struct DEFORMMESH_API FDeformMeshRayTracing
+{
+	static void GatherInstances(TArrayView<const FDeformMeshRayTracingSection> Sections, const FMatrix& LocalToWorld, TArray<FDeformMeshRayTracingInstanceDesc>& OutInstances);
+};
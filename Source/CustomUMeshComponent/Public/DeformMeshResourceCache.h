@@ -0,0 +1,235 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "EngineDefines.h"
+#include "DeformMeshVertexFactory.h"
+#if WITH_EDITOR
+#include "ComponentRecreateRenderStateContext.h"
+#endif
+
+class UStaticMesh;
+class FStaticMeshRenderData;
+class FRawStaticIndexBuffer;
+class FRayTracingGeometry;
+struct FStaticMeshVertexBuffers;
+
+/* A range of the index buffer drawn with one material of the static mesh, copied from its FStaticMeshSection */
+struct FDeformMeshLODSection
+{
+	/* Index of the static mesh material slot used by this range */
+	int32 MaterialIndex;
+	uint32 FirstIndex;
+	uint32 NumTriangles;
+	uint32 MinVertexIndex;
+	uint32 MaxVertexIndex;
+	bool bCastShadow;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh LOD Resources
+/*
+ * The render data of one LOD of a static mesh: the vertex factories bound to the LOD's vertex buffers, and the LOD's index buffer
+ * The index buffer is split in one range per material, all the ranges are drawn with the same vertex factory
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshLODResources
+{
+public:
+	FDeformMeshLODResources(ERHIFeatureLevel::Type InFeatureLevel)
+		: VertexFactory(InFeatureLevel)
+		, CachedVertexFactory(InFeatureLevel)
+		, VertexBuffers(nullptr)
+		, IndexBuffer(nullptr)
+		, NumIndices(0)
+		, MaxVertexIndex(0)
+		, StaticVertexFactory(nullptr)
+#if RHI_RAYTRACING
+		, RayTracingGeometry(nullptr)
+#endif
+	{}
+
+	/* Vertex factory bound to the static mesh vertex buffers of this LOD */
+	FDeformMeshVertexFactory VertexFactory;
+	/* Same bindings, used by the sections that read their vertices from a deform cache (see FDeformMeshSectionCache). Only initialized on SM5 */
+	FDeformMeshCachedVertexFactory CachedVertexFactory;
+	/* The vertex buffers of this LOD, owned by the static mesh render data, the vertex factory is bound to them once they're initialized */
+	const FStaticMeshVertexBuffers* VertexBuffers;
+	/* The index buffer of this LOD, owned by the static mesh render data */
+	const FRawStaticIndexBuffer* IndexBuffer;
+	/* Cached so we don't have to pointer chase the static mesh when rendering */
+	uint32 NumIndices;
+	uint32 MaxVertexIndex;
+	/* The ranges of the index buffer, one per material of the static mesh */
+	TArray<FDeformMeshLODSection, TInlineAllocator<1>> Sections;
+	/* The static mesh's own local vertex factory of this LOD, it knows nothing of the deform transforms: the sections drawn as GPU scene instances and the ray traced hits use it */
+	const FVertexFactory* StaticVertexFactory;
+#if RHI_RAYTRACING
+	/* The BLAS of this LOD, owned by the static mesh render data, the rigid sections are traced as instances of it */
+	const FRayTracingGeometry* RayTracingGeometry;
+#endif
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Render Resources
+/*
+ * The render data that every section built from the same static mesh can share
+ * We don't copy anything here, the vertex factories are bound directly to the static mesh's own vertex buffers,
+ * and the sections draw with the static mesh's own index buffers
+ * Since the deform transform of a section is fetched using the batch element (see FDeformMeshVertexFactoryShaderParameters), one vertex factory per LOD is enough for all the sections and all the components
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshRenderResources
+{
+public:
+	FDeformMeshRenderResources(ERHIFeatureLevel::Type InFeatureLevel)
+		: FirstLOD(0)
+		, FeatureLevel(InFeatureLevel)
+		, StaticMesh(nullptr)
+		, RenderData(nullptr)
+		, NumReferences(0)
+		, bInitialized(false)
+	{}
+
+	/* One entry per LOD of the static mesh, the LODs before FirstLOD aren't streamed in and are left empty */
+	TIndirectArray<FDeformMeshLODResources> LODs;
+	/* Screen size thresholds of the LODs, copied from the static mesh render data (see FDeformMeshLODSelection) */
+	TArray<float, TInlineAllocator<MAX_STATIC_MESH_LODS>> LODScreenSizes;
+	/* The finest LOD that can be drawn, it follows the LOD streaming of the static mesh at the beginning of each render thread frame. Render thread only */
+	int32 FirstLOD;
+
+	/* The resources of the LOD to draw, with LODIndex coming from FDeformMeshLODSelection */
+	const FDeformMeshLODResources& GetLOD(int32 LODIndex) const
+	{
+		return LODs[FMath::Clamp(LODIndex, FirstLOD, LODs.Num() - 1)];
+	}
+
+	/* Whether the vertex factory of every LOD is initialized, the sections using these resources aren't drawn until then. Render thread only */
+	bool IsInitialized() const
+	{
+		return bInitialized;
+	}
+
+private:
+	ERHIFeatureLevel::Type FeatureLevel;
+	/* The static mesh these resources were created from, only used as a key and never dereferenced */
+	const UStaticMesh* StaticMesh;
+	/* The render data that the buffers are bound to, if the static mesh is rebuilt we'll create a new entry instead of reusing this one */
+	const FStaticMeshRenderData* RenderData;
+	/* Number of sections using these resources, protected by the cache lock */
+	int32 NumReferences;
+	/* Set on the render thread by FDeformMeshResourceCache::InitPendingResources_RenderThread */
+	bool bInitialized;
+
+	friend class FDeformMeshResourceCache;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Resource Cache
+/*
+ * Refcounted cache of the render resources of each static mesh used by deform mesh sections, shared by all the components
+ * Resources are acquired on the game thread when a scene proxy is created, and released when the scene proxy is destroyed on the render thread
+ * New resources aren't initialized when they're acquired, they're queued and initialized at the beginning of the next render thread frames,
+ * a few vertex factories per frame, so creating many sections at once doesn't stall the render thread
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshResourceCache
+{
+public:
+	static FDeformMeshResourceCache& Get();
+
+	/* Returns the shared render resources of this static mesh, creating them if this is the first reference */
+	FDeformMeshRenderResources* Acquire(UStaticMesh* StaticMesh, ERHIFeatureLevel::Type FeatureLevel);
+
+	/* Drops a reference, the resources are released once the last section using them is gone */
+	void Release(FDeformMeshRenderResources* Resources);
+
+	/* Number of static meshes that currently have shared resources */
+	int32 GetNum() const;
+
+	/* CPU memory used by the cache and by all the shared resources */
+	SIZE_T GetAllocatedSize() const;
+
+	/* Start and stop initializing the queued resources at the beginning of each render thread frame, called by the module */
+	void Startup();
+	void Shutdown();
+
+	/* Broadcast on the render thread when resources finished initializing, the scene proxies waiting for them listen to it */
+	DECLARE_MULTICAST_DELEGATE_OneParam(FOnResourcesInitialized, const FDeformMeshRenderResources*);
+	FOnResourcesInitialized OnResourcesInitialized_RenderThread;
+
+	/* Broadcast on the render thread when LODs of the static mesh were streamed in or out, before the vertex factories of the streamed out LODs are released */
+	FOnResourcesInitialized OnResourcesFirstLODChanged_RenderThread;
+
+private:
+	/* Called at the beginning of each render thread frame */
+	void OnBeginFrame_RenderThread();
+
+	/* Initializes the vertex factories of the queued resources, up to MaxVertexFactoryInitsPerFrame */
+	void InitPendingResources_RenderThread();
+
+	/*
+	 * Moves FirstLOD of every resources to the first LOD that the static mesh has streamed in
+	 * The LODs streamed in are bound to their buffers, the LODs streamed out lose their bindings, so no vertex factory points to buffers that the streamer released
+	*/
+	void UpdateStreamedLODs_RenderThread();
+
+	/* Releases the vertex factory of each LOD and deletes the resources */
+	void ReleaseResources_RenderThread(FDeformMeshRenderResources* Resources);
+
+	/* Number of vertex factories initialized per frame, the resources that don't fit wait for the next frames */
+	static constexpr int32 MaxVertexFactoryInitsPerFrame = 8;
+
+	struct FKey
+	{
+		const UStaticMesh* StaticMesh;
+		ERHIFeatureLevel::Type FeatureLevel;
+
+		bool operator==(const FKey& Other) const
+		{
+			return StaticMesh == Other.StaticMesh && FeatureLevel == Other.FeatureLevel;
+		}
+
+		friend uint32 GetTypeHash(const FKey& Key)
+		{
+			return HashCombine(::GetTypeHash(Key.StaticMesh), ::GetTypeHash((uint32)Key.FeatureLevel));
+		}
+	};
+
+	mutable FCriticalSection CacheLock;
+	TMap<FKey, FDeformMeshRenderResources*> Entries;
+
+	/* The resources waiting for initialization, in the order they were acquired. Render thread only */
+	TArray<FDeformMeshRenderResources*> PendingResources;
+
+	/* All the resources that aren't released yet, including the ones replaced in Entries by a rebuilt static mesh. Render thread only */
+	TArray<FDeformMeshRenderResources*> LiveResources;
+
+	FDelegateHandle BeginFrameHandle;
+
+#if WITH_EDITOR
+	/*
+	 * Game thread: a static mesh releases its render data when it's rebuilt or one of its properties is edited, the buffers the resources are bound to go with it
+	 * The static mesh only recreates the render state of the static mesh components, so the deform mesh components using it are recreated here:
+	 * their proxies release the old resources before the render data is freed, and the new proxies create resources from the new render data
+	*/
+	void WatchStaticMesh(UStaticMesh* StaticMesh);
+	void BeginStaticMeshChange(UStaticMesh* StaticMesh);
+	void EndStaticMeshChange(UStaticMesh* StaticMesh);
+
+	struct FStaticMeshChange
+	{
+		/* A build can happen inside a property edit, the components are recreated when the outermost change ends */
+		int32 Depth = 0;
+		TArray<TUniquePtr<FComponentRecreateRenderStateContext>> RecreateContexts;
+	};
+
+	/* The static meshes that had resources created for them, and whose builds we listen to. Game thread only */
+	TSet<TWeakObjectPtr<UStaticMesh>> WatchedStaticMeshes;
+	/* The static meshes being rebuilt or edited. Game thread only */
+	TMap<TWeakObjectPtr<UStaticMesh>, FStaticMeshChange> StaticMeshChanges;
+
+	FDelegateHandle PreObjectPropertyChangedHandle;
+	FDelegateHandle ObjectPropertyChangedHandle;
+#endif
+};
@@ -16,85 +16,71 @@
 #include "MeshMaterialShader.h"
 #include "ShaderParameters.h"
 #include "RHIUtilities.h"
+#include "RenderUtils.h"
+#include "Async/Async.h"
+#include "Misc/CoreDelegates.h"
 
 #include "MeshMaterialShader.h"
-
-/* Helper function that initializes a render resource if it's not initialized, or updates it otherwise*/
-static inline void InitOrUpdateResource(FRenderResource* Resource)
-{
-	if (!Resource->IsInitialized())
-	{
-		Resource->InitResource();
-	}
-	else
-	{
-		Resource->UpdateRHI();
-	}
-}
-
-/*
- * Helper function that initializes the vertex buffers of the vertex factory's Data member from the static mesh vertex buffers
- * We're using this so we can initialize only the data that we're interested in.
-*/
-static void InitVertexFactoryData(FLocalVertexFactory* VertexFactory, FStaticMeshVertexBuffers* VertexBuffers)
-{
-	VertexBuffers->StaticMeshVertexBuffer.SetVertexTangents(0, FVector3f(1, 0, 0), FVector3f(0, 1, 0), FVector3f(0, 0, 1));
-	VertexBuffers->StaticMeshVertexBuffer.SetVertexUV(0, 0, FVector2f(0, 0));
-	int NumTexCoords = 1;
-	int LightMapIndex = 0;
-
-	ENQUEUE_RENDER_COMMAND(StaticMeshVertexBuffersLegacyInit)(
-		[VertexFactory, VertexBuffers, LightMapIndex](FRHICommandListImmediate& RHICmdList)
-		{
-			//Initialize or update the RHI vertex buffers
-			InitOrUpdateResource(&VertexBuffers->PositionVertexBuffer);
-			InitOrUpdateResource(&VertexBuffers->StaticMeshVertexBuffer);
-			InitOrUpdateResource(&VertexBuffers->ColorVertexBuffer);
-
-			//Use the RHI vertex buffers to create the needed Vertex stream components in an FDataType instance, and then set it as the data of the vertex factory
-			FLocalVertexFactory::FDataType Data;
-			VertexBuffers->PositionVertexBuffer.BindPositionVertexBuffer(VertexFactory, Data);
-			VertexBuffers->StaticMeshVertexBuffer.BindTangentVertexBuffer(VertexFactory, Data);
-			VertexBuffers->StaticMeshVertexBuffer.BindPackedTexCoordVertexBuffer(VertexFactory, Data);
-			VertexBuffers->StaticMeshVertexBuffer.BindLightMapVertexBuffer(VertexFactory, Data, LightMapIndex);
-			VertexBuffers->ColorVertexBuffer.BindColorVertexBuffer(VertexFactory, Data);
-			VertexFactory->SetData(Data);
-
-			//Initalize the vertex factory using the data that we just set, this will call the InitRHI() method that we implemented in out vertex factory
-			InitOrUpdateResource(VertexFactory);
-		});
-}
+#include "DeformMeshVertexFactory.h"
+#include "DeformMeshResourceCache.h"
+#include "DeformMeshSectionGroups.h"
+#include "DeformMeshStats.h"
+#include "DeformMeshLODSelection.h"
+#include "DeformMeshDirtyRanges.h"
+#include "DeformMeshTransformFormat.h"
+#include "DeformMeshTransformMailbox.h"
+#include "DeformMeshLattice.h"
+#include "DeformMeshRayTracing.h"
+#include "RayTracingInstance.h"
+#include "DeformMeshTrack.h"
+#include "DeformMeshCache.h"
 
 
 ///////////////////////////////////////////////////////////////////////
 // The Deform Mesh Component Mesh Section Proxy
 /*
  * Stores the render thread data that it is needed to render one mesh section
- 1 Vertex Data: Each mesh section creates an instance of the vertex factory(vertex streams and declarations), also each mesh section owns an index buffer
- 2 Material : Contains a pointer to the material that will be used to render this section
- 3 Other Data: Visibility, and the maximum vertex index.
+ 1 Vertex Data: The vertex factories and the index buffers of every LOD are shared by all the sections using the same static mesh, each mesh section holds a reference to them (see FDeformMeshResourceCache)
+ 2 Materials : Contains a pointer to each material of the section's static mesh, indexed like the static mesh material slots
+ 3 Lattice   : The control point offsets of the section's free form deformation lattice, if it has one, and its slot in the lattices buffer
+ 4 Cache     : The vertices deformed by the deform cache compute pass, only for the sections with a lattice when the component uses the deform cache
+ 5 Other Data: Visibility, whether the section is hot, how it casts shadows, and the bounds used to cull the section against each view.
 */
 ///////////////////////////////////////////////////////////////////////
 class FDeformMeshSectionProxy
 {
 public:
 	////////////////////////////////////////////////////////
-	/* Material applied to this section */
-	UMaterialInterface* Material;
-	/* Index buffer for this section */
-	FRawStaticIndexBuffer IndexBuffer;
-	/* Vertex factory instance for this section */
-	FLocalVertexFactory VertexFactory;
+	/* Materials applied to this section, one per material slot of the static mesh */
+	TArray<UMaterialInterface*, TInlineAllocator<1>> Materials;
+	/* Shared render resources of the section's static mesh: vertex factory, index buffer and the info needed to draw them, for each LOD */
+	FDeformMeshRenderResources* RenderResources;
 	/* Whether this section is currently visible */
 	bool bSectionVisible;
-	/* Max vertix index is an info that is needed when rendering the mesh, so we cache it here so we don't have to pointer chase it later*/
-	uint32 MaxVertexIndex;
+	/* Whether this section's transform changes often, hot sections are drawn with GetDynamicMeshElements instead of the cached draws */
+	bool bHot;
+	/* How this section is drawn in the shadow passes */
+	EDeformMeshShadowMode ShadowMode;
+	/* Offsets of the lattice control points, empty when the section has no lattice */
+	TArray<FVector3f> LatticeOffsets;
+	/* Box of the static mesh, the lattice spans it */
+	FBox LatticeBox;
+	/* Local box of the static mesh deformed by the lattice, before the deform transform */
+	FBox MeshBox;
+	/* World box of the deformed section, updated when the deform transform or the primitive transform changes */
+	FBox WorldBox;
+	/* The deformed vertices of the section, owned by the section, null when the section is deformed by the vertex factory */
+	FDeformMeshSectionCache* Cache;
 
-	/* For each section, we'll create a vertex factory to store the per-instance mesh data*/
-	FDeformMeshSectionProxy(ERHIFeatureLevel::Type InFeatureLevel)
-		: Material(NULL)
-		, VertexFactory(InFeatureLevel, "FDeformMeshSectionProxy")
+	FDeformMeshSectionProxy()
+		: RenderResources(nullptr)
 		, bSectionVisible(true)
+		, bHot(false)
+		, ShadowMode(EDeformMeshShadowMode::Full)
+		, LatticeBox(ForceInit)
+		, MeshBox(ForceInit)
+		, WorldBox(ForceInit)
+		, Cache(nullptr)
 	{}
 };
 
@@ -115,95 +101,182 @@ public:
 	}
 
 	/* On construction of the Scene proxy, we'll copy all the needed data from the game thread mesh sections to create the needed render thread mesh sections' proxies*/
+	/* The vertex and index buffers aren't copied, each section references the shared render resources of its static mesh*/
 	/* We'll also create the structured buffer that will contain the deform transforms of all the sections*/
 	FDeformMeshSceneProxy(UDeformMeshComponent* Component)
 		: FPrimitiveSceneProxy(Component)
+		, SectionsLocalToWorld(ForceInitToZero)
 		, MaterialRelevance(Component->GetMaterialRelevance(GetScene().GetFeatureLevel()))
+		, TransformMailbox(Component->TransformMailbox)
+		, ShadowDrawCounts(Component->ShadowDrawCounts)
+		, TransformsCapacity(0)
+		, TransformFormat(Component->TransformFormat)
+		, NumDirtyTransforms(0)
+		, NumMovedTransforms(0)
+		, bInstancedDrawing(Component->bUseInstancedDrawing)
+		, bGPUSceneInstances(Component->bUseGPUSceneInstances && UseGPUScene(GetScene().GetShaderPlatform(), GetScene().GetFeatureLevel()))
+		, bStaticDrawPath(Component->bUseStaticDrawPath || bGPUSceneInstances)
+		, bDeformCache(Component->bUseDeformCache && GetScene().GetFeatureLevel() >= ERHIFeatureLevel::SM5)
+		, NumHotSections(0)
+		, ForcedLOD(Component->ForcedLodModel > 0 ? Component->ForcedLodModel - 1 : INDEX_NONE)
+		, MinLOD(Component->MinLOD)
+		, ShadowLODBias(FMath::Max(Component->ShadowLODBias, 0))
+		, ShadowMinScreenSize(Component->ShadowMinScreenSize)
+		, OwnerComponent(Component)
+		, NumPendingSections(INDEX_NONE)
+		, LatticesCapacity(0)
 	{
 		// Copy each section
 		const uint16 NumSections = Component->DeformMeshSections.Num();
 
 		//Initialize the array of trnasforms and the array of mesh sections proxies
 		DeformTransforms.AddZeroed(NumSections);
+		TransformSerials.AddZeroed(NumSections);
 		Sections.AddZeroed(NumSections);
+		DirtyTransforms.Init(false, NumSections);
+		MovedTransforms.Init(false, NumSections);
+		LatticeSlots.Init(INDEX_NONE, NumSections);
 
 		for (uint16 SectionIdx = 0; SectionIdx < NumSections; SectionIdx++)
 		{
-			const FDeformMeshSection& SrcSection = Component->DeformMeshSections[SectionIdx];
+			//Cleared sections don't have a static mesh, we keep a null entry for them so the other sections keep their index
+			FDeformMeshSectionProxy* NewSection = CreateSectionProxy(Component, SectionIdx, GetScene().GetFeatureLevel());
+			if (NewSection != nullptr)
 			{
-				//Create a new mesh section proxy
-				FDeformMeshSectionProxy* NewSection = new FDeformMeshSectionProxy(GetScene().GetFeatureLevel());
+				//Fill the array of transforms with the transform matrix from each section
+				DeformTransforms[SectionIdx] = FMatrix44f(Component->DeformMeshSections[SectionIdx].DeformTransform);
+				NumHotSections += NewSection->bHot ? 1 : 0;
 
-				//Get the needed data from the static mesh of the mesh section
-				//We're assuming that there's only one LOD
-				auto& LODResource = SrcSection.StaticMesh->GetRenderData()->LODResources[0];
+				// Save ref to new section
+				Sections[SectionIdx] = NewSection;
+			}
+		}
 
-				FLocalVertexFactory* VertexFactory = &NewSection->VertexFactory;
-				InitVertexFactoryData(VertexFactory, &(LODResource.VertexBuffers));
+		//The sections start without motion
+		PreviousDeformTransforms = DeformTransforms;
 
-				//Copy the indices from the static mesh index buffer and use it to initialize the mesh section proxy's index buffer
-				{
-					TArray<uint32> tmp_indices;
-					LODResource.IndexBuffer.GetCopy(tmp_indices);
-					NewSection->IndexBuffer.AppendIndices(tmp_indices.GetData(), tmp_indices.Num());
-					//Initialize the render resource
-					BeginInitResource(&NewSection->IndexBuffer);
-				}
+		//Every section gets an instance, even the ones drawn by the other paths, so the instance of a section is its section index
+		//The primitive always has one instance at least, the GPU scene doesn't know primitives without any
+		if (bGPUSceneInstances)
+		{
+			bSupportsInstanceDataBuffer = true;
+			bHasPerInstanceLocalBounds = true;
+			bHasPerInstanceDynamicData = true;
+			const int32 NumInstances = FMath::Max<int32>(NumSections, 1);
+			InstanceSceneData.SetNum(NumInstances);
+			InstanceDynamicData.SetNum(NumInstances);
+			InstanceLocalBounds.SetNum(NumInstances);
+			for (int32 SectionIndex = 0; SectionIndex < NumInstances; SectionIndex++)
+			{
+				WriteSectionInstance(SectionIndex);
+			}
+		}
 
-				//Fill the array of transforms with the transform matrix from each section
-				DeformTransforms[SectionIdx] = SrcSection.DeformTransform;
+		//A track that was playing when the proxy was recreated keeps driving the sections, from the time the component is at
+		if (Component->DeformTrack.IsValid())
+		{
+			TrackReader = MakeUnique<FDeformMeshTrackReader>(Component->DeformTrack.ToSharedRef());
+			TrackTime = Component->DeformTrackTime;
+		}
+	}
 
-				//Set the max vertex index for this mesh section
-				NewSection->MaxVertexIndex = LODResource.VertexBuffers.PositionVertexBuffer.GetNumVertices() - 1;
+	/*
+	 * Creates the render thread proxy of one section of the component, or returns null if the section was cleared
+	 * This is called on the game thread, by the constructor and when a section is added or replaced without recreating the scene proxy
+	*/
+	static FDeformMeshSectionProxy* CreateSectionProxy(const UDeformMeshComponent* Component, int32 SectionIndex, ERHIFeatureLevel::Type FeatureLevel)
+	{
+		const FDeformMeshSection& SrcSection = Component->DeformMeshSections[SectionIndex];
+		if (SrcSection.StaticMesh == nullptr)
+		{
+			return nullptr;
+		}
 
-				//Get the material of this section
-				NewSection->Material = Component->GetMaterial(SectionIdx);
+		//Create a new mesh section proxy
+		FDeformMeshSectionProxy* NewSection = new FDeformMeshSectionProxy();
 
-				if (NewSection->Material == NULL)
-				{
-					NewSection->Material = UMaterial::GetDefaultMaterial(MD_Surface);
-				}
+		//Get the render resources of the static mesh, they're created by the first section that uses this mesh and shared by the others
+		NewSection->RenderResources = FDeformMeshResourceCache::Get().Acquire(SrcSection.StaticMesh, FeatureLevel);
 
-				// Copy visibility info
-				NewSection->bSectionVisible = SrcSection.bSectionVisible;
+		//Get the materials of this section, one per material slot of the static mesh
+		const int32 NumMaterials = FMath::Max(SrcSection.StaticMesh->GetStaticMaterials().Num(), 1);
+		for (int32 MaterialIndex = 0; MaterialIndex < NumMaterials; MaterialIndex++)
+		{
+			UMaterialInterface* Material = Component->GetSectionMaterial(SectionIndex, MaterialIndex);
 
-				// Save ref to new section
-				Sections[SectionIdx] = NewSection;
+			if (Material == NULL)
+			{
+				Material = UMaterial::GetDefaultMaterial(MD_Surface);
 			}
+			NewSection->Materials.Add(Material);
 		}
 
-		//Create the structured buffer only if we have at least one section
-		//if(NumSections > 0)
-		//{
-		//	///////////////////////////////////////////////////////////////
-		//	//// CREATING THE STRUCTURED BUFFER FOR THE DEFORM TRANSFORMS OF ALL THE SECTIONS
-		//	//We'll use one structured buffer for all the mesh sections of the component
+		// Copy visibility info
+		NewSection->bSectionVisible = SrcSection.bSectionVisible;
+		NewSection->bHot = SrcSection.bHot;
+		NewSection->ShadowMode = SrcSection.ShadowMode;
+
+		//The lattice slot is given on the render thread (see AssignSectionLattice_RenderThread)
+		NewSection->LatticeOffsets = SrcSection.LatticeOffsets;
+		NewSection->LatticeBox = SrcSection.StaticMesh->GetBoundingBox();
+
+		//The world box is computed once the proxy knows its transform (see OnTransformChanged)
+		NewSection->MeshBox = SrcSection.GetMeshBox();
+
+		return NewSection;
+	}
+
+	/* Called on the render thread once the proxy is added to the scene, this is where we create the render resources that aren't owned by a section*/
+	virtual void CreateRenderThreadResources() override
+	{
+		//The lattices buffer is always created since the shader always reads it, it has room for at least one lattice
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			AssignSectionLattice_RenderThread(SectionIndex);
+		}
+		CreateLatticesBuffer_RenderThread(FMath::Max(GetNumLatticeSlots(), 1));
 
-		//	//We first create a resource array to use it in the create info for initializing the structured buffer on creation
-		//	TResourceArray<FMatrix>* ResourceArray = new TResourceArray<FMatrix>(true);
-		//	FRHIResourceCreateInfo CreateInfo(TEXT("DeformMesh_TransformsSB"));
-		//	ResourceArray->Append(DeformTransforms);
-		//	CreateInfo.ResourceArray = ResourceArray;
+		//Create the structured buffer only if we have at least one section
+		if (DeformTransforms.Num() > 0)
+		{
+			CreateTransformsBuffers_RenderThread(DeformTransforms.Num());
+			for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+			{
+				UpdateSectionCache_RenderThread(SectionIndex);
+			}
+			UpdateSectionGroups_RenderThread();
+		}
+		EvaluateTrack_RenderThread(TrackTime);
 
-		//	DeformTransformsSB = RHICreateStructuredBuffer(sizeof(FMatrix), NumSections * sizeof(FMatrix), BUF_ShaderResource, CreateInfo);
-		//	bDeformTransformsDirty = false;
-		//	///////////////////////////////////////////////////////////////
-		//	//// CREATING AN SRV FOR THE STRUCTUED BUFFER SO WA CAN USE IT AS A SHADER RESOURCE PARAMETER AND BIND IT TO THE VERTEX FACTORY
-		//	DeformTransformsSRV = RHICreateShaderResourceView(DeformTransformsSB);
+		//The previous transforms, and the previous positions of the caches, are updated at the beginning of each frame
+		BeginFrameHandle = FCoreDelegates::OnBeginFrameRT.AddRaw(this, &FDeformMeshSceneProxy::OnBeginFrame_RenderThread);
+		FirstLODChangedHandle = FDeformMeshResourceCache::Get().OnResourcesFirstLODChanged_RenderThread.AddRaw(this, &FDeformMeshSceneProxy::OnResourcesFirstLODChanged_RenderThread);
 
-		//	///////////////////////////////////////////////////////////////
-		//}
+		UpdatePendingSections_RenderThread(true);
 	}
 
 	virtual ~FDeformMeshSceneProxy()
 	{
-		//For each section , release the render resources
+		if (ResourcesInitializedHandle.IsValid())
+		{
+			FDeformMeshResourceCache::Get().OnResourcesInitialized_RenderThread.Remove(ResourcesInitializedHandle);
+		}
+		if (FirstLODChangedHandle.IsValid())
+		{
+			FDeformMeshResourceCache::Get().OnResourcesFirstLODChanged_RenderThread.Remove(FirstLODChangedHandle);
+		}
+		if (BeginFrameHandle.IsValid())
+		{
+			FCoreDelegates::OnBeginFrameRT.Remove(BeginFrameHandle);
+		}
+
+		//For each section, drop its reference to the shared render resources
 		for (FDeformMeshSectionProxy* Section : Sections)
 		{
 			if (Section != nullptr)
 			{
-				Section->IndexBuffer.ReleaseResource();
-				Section->VertexFactory.ReleaseResource();
+				FDeformMeshResourceCache::Get().Release(Section->RenderResources);
+				delete Section->Cache;
 				delete Section;
 			}
 		}
@@ -211,33 +284,336 @@ public:
 		//Release the structured buffer and the SRV
 		DeformTransformsSB.SafeRelease();
 		DeformTransformsSRV.SafeRelease();
+		PreviousDeformTransformsSB.SafeRelease();
+		PreviousDeformTransformsSRV.SafeRelease();
+		InstanceTransformIndicesSB.SafeRelease();
+		InstanceTransformIndicesSRV.SafeRelease();
+		LatticeSlotsSB.SafeRelease();
+		LatticeSlotsSRV.SafeRelease();
+		LatticesSB.SafeRelease();
+		LatticesSRV.SafeRelease();
+	}
+
+	/*
+	 * Adds, replaces or removes (when NewSection is null) one section, without recreating the scene proxy
+	 * The proxy takes ownership of NewSection, which was created on the game thread with CreateSectionProxy
+	 * The transforms buffer grows geometrically, so adding sections one by one doesn't recreate it every time
+	 * MailboxSerial is the frame the mailbox was writing when the command was sent, the mailbox entries of that frame and later ones were written for the new section
+	*/
+	void SetSection_RenderThread(int32 SectionIndex, FDeformMeshSectionProxy* NewSection, const FMatrix44f& Transform, uint32 MailboxSerial)
+	{
+		check(IsInRenderingThread());
+
+		if (SectionIndex >= Sections.Num())
+		{
+			if (NewSection == nullptr)
+			{
+				return;
+			}
+			Sections.SetNumZeroed(SectionIndex + 1);
+			DeformTransforms.SetNumZeroed(SectionIndex + 1);
+			TransformSerials.SetNumZeroed(SectionIndex + 1);
+			PreviousDeformTransforms.SetNumZeroed(SectionIndex + 1);
+			DirtyTransforms.Add(false, SectionIndex + 1 - DirtyTransforms.Num());
+			MovedTransforms.Add(false, SectionIndex + 1 - MovedTransforms.Num());
+			while (LatticeSlots.Num() <= SectionIndex)
+			{
+				LatticeSlots.Add(INDEX_NONE);
+			}
+		}
+
+		ReleaseSection_RenderThread(SectionIndex);
+
+		if (NewSection != nullptr)
+		{
+			Sections[SectionIndex] = NewSection;
+			//The mailbox can be drained before this command runs, the transforms written after the command was sent are newer than the one it carries
+			FDeformMeshMailboxEntry Orphan;
+			if (OrphanTransforms.RemoveAndCopyValue(SectionIndex, Orphan) && Orphan.Serial >= MailboxSerial && Orphan.Serial >= TransformSerials[SectionIndex])
+			{
+				DeformTransforms[SectionIndex] = Orphan.Transform;
+				TransformSerials[SectionIndex] = Orphan.Serial;
+			}
+			else if (TransformSerials[SectionIndex] < MailboxSerial)
+			{
+				DeformTransforms[SectionIndex] = Transform;
+				TransformSerials[SectionIndex] = MailboxSerial;
+			}
+			//A new section doesn't move during its first frame
+			PreviousDeformTransforms[SectionIndex] = Transform;
+			NumHotSections += NewSection->bHot ? 1 : 0;
+			UpdateSectionWorldBox(SectionIndex);
+			AssignSectionLattice_RenderThread(SectionIndex);
+		}
+		if (bGPUSceneInstances)
+		{
+			WriteSectionInstance(SectionIndex);
+			UpdateGPUSceneInstances_RenderThread(1);
+		}
+
+		if (DeformTransforms.Num() > TransformsCapacity)
+		{
+			//The cached draws hold the SRV of the old buffer
+			CreateTransformsBuffers_RenderThread(FMath::Max(DeformTransforms.Num(), TransformsCapacity * 2));
+		}
+		else if (NewSection != nullptr)
+		{
+			MarkTransformDirty(SectionIndex);
+			UpdateDeformTransformsSB_RenderThread();
+			UploadPreviousTransforms_RenderThread(SectionIndex, 1);
+		}
+		UpdateLatticeBuffers_RenderThread(NewSection != nullptr ? LatticeSlots[SectionIndex] : INDEX_NONE);
+		if (NewSection != nullptr)
+		{
+			UpdateSectionCache_RenderThread(SectionIndex);
+		}
+
+		UpdateSectionGroups_RenderThread();
+		UpdateCachedDraws_RenderThread();
+		UpdatePendingSections_RenderThread(true);
 	}
 
+	/* Removes all the sections, without recreating the scene proxy, the buffers are kept for the sections that will be added next*/
+	void ClearSections_RenderThread(uint32 MailboxSerial)
+	{
+		check(IsInRenderingThread());
+
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			//Transforms written after the command was sent are for the sections added after it, keep them for these
+			if (Sections[SectionIndex] != nullptr && TransformSerials[SectionIndex] >= MailboxSerial)
+			{
+				OrphanTransforms.Add(SectionIndex, { SectionIndex, TransformSerials[SectionIndex], DeformTransforms[SectionIndex] });
+			}
+			ReleaseSection_RenderThread(SectionIndex);
+		}
+		Sections.Reset();
+		DeformTransforms.Reset();
+		TransformSerials.Reset();
+		PreviousDeformTransforms.Reset();
+		DirtyTransforms.Empty();
+		NumDirtyTransforms = 0;
+		MovedTransforms.Empty();
+		NumMovedTransforms = 0;
+		LatticeSlots.Reset();
+		Lattices.Reset();
+		FreeLatticeSlots.Reset();
+
+		UpdateSectionGroups_RenderThread();
+		UpdateCachedDraws_RenderThread();
+		UpdatePendingSections_RenderThread(true);
+	}
 
-	/* Update the transforms structured buffer using the array of deform transform, this will update the array on the GPU*/
+	/*
+	 * Update the transforms structured buffer using the array of deform transform, this will update the array on the GPU
+	 * Only the transforms flagged as dirty are written, grouped in ranges, unless so many of them changed that one copy of the whole array is cheaper
+	 * The cached sections whose transform changed are deformed again once the transforms are uploaded
+	*/
 	void UpdateDeformTransformsSB_RenderThread()
 	{
 		check(IsInRenderingThread());
 		//Update the structured buffer only if it needs update
-		if (bDeformTransformsDirty && DeformTransformsSB)
+		if (NumDirtyTransforms > 0 && DeformTransformsSB)
+		{
+			const uint32 Stride = FDeformMeshTransformCodec::GetStride(TransformFormat);
+			uint32 BytesUploaded = 0;
+			//Scattered dirty transforms give many small copies, each with its own lock, past MaxDirtyRanges one copy of the whole array is cheaper
+			TArray<FDeformMeshDirtyRange, TInlineAllocator<16>> DirtyRanges;
+			bool bFullUpload = NumDirtyTransforms > DeformTransforms.Num() * FullUploadDirtyRatio;
+			if (!bFullUpload)
+			{
+				FDeformMeshDirtyRanges::Build(DirtyTransforms, DirtyRangeMaxGap, DirtyRanges);
+				bFullUpload = DirtyRanges.Num() > MaxDirtyRanges;
+			}
+			if (bFullUpload)
+			{
+				void* StructuredBufferData = RHILockBuffer(DeformTransformsSB, 0, DeformTransforms.Num() * Stride, RLM_WriteOnly);
+				EncodeTransforms(DeformTransforms, 0, DeformTransforms.Num(), (uint8*)StructuredBufferData);
+				RHIUnlockBuffer(DeformTransformsSB);
+				BytesUploaded = DeformTransforms.Num() * Stride;
+			}
+			else
+			{
+				for (const FDeformMeshDirtyRange& Range : DirtyRanges)
+				{
+					void* StructuredBufferData = RHILockBuffer(DeformTransformsSB, Range.First * Stride, Range.Num * Stride, RLM_WriteOnly);
+					EncodeTransforms(DeformTransforms, Range.First, Range.Num, (uint8*)StructuredBufferData);
+					RHIUnlockBuffer(DeformTransformsSB);
+					BytesUploaded += Range.Num * Stride;
+				}
+			}
+
+			int32 NumInstancesWritten = 0;
+			for (TConstSetBitIterator<> It(DirtyTransforms); It; ++It)
+			{
+				if (Sections[It.GetIndex()] != nullptr && Sections[It.GetIndex()]->Cache != nullptr)
+				{
+					DispatchSectionCache_RenderThread(It.GetIndex());
+				}
+				//The lattice sections keep their instance up to date too, for when they lose their lattice
+				if (bGPUSceneInstances && Sections[It.GetIndex()] != nullptr)
+				{
+					WriteSectionInstance(It.GetIndex());
+					NumInstancesWritten++;
+				}
+			}
+			RefitRayTracingGeometries_RenderThread();
+			UpdateGPUSceneInstances_RenderThread(NumInstancesWritten);
+
+			DirtyTransforms.SetRange(0, DirtyTransforms.Num(), false);
+			NumDirtyTransforms = 0;
+			INC_DWORD_STAT_BY(STAT_DeformMesh_TransformBytesUploaded, BytesUploaded);
+		}
+	}
+
+	/* Update the deform transforms of many sections, this will just update their entries in the CPU array*/
+	void UpdateDeformTransforms_RenderThread(TArrayView<const int32> SectionIndices, TArrayView<const FMatrix44f> Transforms)
+	{
+		check(IsInRenderingThread());
+		check(SectionIndices.Num() == Transforms.Num());
+		for (int32 UpdateIndex = 0; UpdateIndex < SectionIndices.Num(); UpdateIndex++)
+		{
+			const int32 SectionIndex = SectionIndices[UpdateIndex];
+			if (Sections.IsValidIndex(SectionIndex) &&
+				Sections[SectionIndex] != nullptr)
+			{
+				DeformTransforms[SectionIndex] = Transforms[UpdateIndex];
+				UpdateSectionWorldBox(SectionIndex);
+				//Mark as dirty
+				MarkTransformDirty(SectionIndex);
+				MarkTransformMoved(SectionIndex);
+			}
+		}
+	}
+
+	/*
+	 * Applies the latest frame of the transform mailbox, and uploads the transforms that changed
+	 * An entry older than the transform a section already has was written for the section it replaced, and is dropped
+	 * An entry for a section that doesn't exist yet is kept until the command adding the section runs
+	*/
+	void DrainTransformMailbox_RenderThread()
+	{
+		check(IsInRenderingThread());
+		for (const FDeformMeshMailboxEntry& Entry : TransformMailbox->Acquire())
+		{
+			const int32 SectionIndex = Entry.SectionIndex;
+			if (Sections.IsValidIndex(SectionIndex) &&
+				Sections[SectionIndex] != nullptr)
+			{
+				if (Entry.Serial >= TransformSerials[SectionIndex])
+				{
+					DeformTransforms[SectionIndex] = Entry.Transform;
+					TransformSerials[SectionIndex] = Entry.Serial;
+					UpdateSectionWorldBox(SectionIndex);
+					//Mark as dirty
+					MarkTransformDirty(SectionIndex);
+					MarkTransformMoved(SectionIndex);
+				}
+			}
+			else
+			{
+				const FDeformMeshMailboxEntry* Orphan = OrphanTransforms.Find(SectionIndex);
+				if (Orphan == nullptr || Orphan->Serial <= Entry.Serial)
+				{
+					OrphanTransforms.Add(SectionIndex, Entry);
+				}
+			}
+		}
+		UpdateDeformTransformsSB_RenderThread();
+	}
+
+	/* Start playing a deform track from Time, or stop the track that is playing when Track is null. The sections keep their last transforms when it stops */
+	void SetTrack_RenderThread(TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> Track, double Time)
+	{
+		check(IsInRenderingThread());
+		TrackReader.Reset();
+		if (Track.IsValid())
+		{
+			TrackReader = MakeUnique<FDeformMeshTrackReader>(Track.ToSharedRef());
+			EvaluateTrack_RenderThread(Time);
+		}
+	}
+
+	/* Decode the frame of the track at Time straight into the transforms of the sections it drives, and upload them, section i of the track drives section i */
+	void EvaluateTrack_RenderThread(double Time)
+	{
+		check(IsInRenderingThread());
+		TrackTime = Time;
+		if (!TrackReader.IsValid() || !DeformTransformsSB)
+		{
+			return;
+		}
+
+		const int32 NumTrackSections = FMath::Min(TrackReader->GetTrack().GetNumSections(), Sections.Num());
+		if (TrackSectionIndices.Num() != NumTrackSections)
+		{
+			TrackSectionIndices.SetNumUninitialized(NumTrackSections);
+			for (int32 SectionIndex = 0; SectionIndex < NumTrackSections; SectionIndex++)
+			{
+				TrackSectionIndices[SectionIndex] = SectionIndex;
+			}
+			TrackTransforms.SetNumUninitialized(NumTrackSections);
+		}
+
+		TrackReader->Evaluate(Time, TrackTransforms);
+		UpdateDeformTransforms_RenderThread(TrackSectionIndices, TrackTransforms);
+		UpdateDeformTransformsSB_RenderThread();
+	}
+
+	/*
+	 * The primitive moved, so the world boxes of all the sections moved too
+	 * This is also called when only the bounds changed, which happens on most section updates, the world boxes of the updated sections are already refreshed by UpdateSectionWorldBox then
+	*/
+	virtual void OnTransformChanged() override
+	{
+		if (GetLocalToWorld().Equals(SectionsLocalToWorld, 0.0))
+		{
+			return;
+		}
+		SectionsLocalToWorld = GetLocalToWorld();
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
 		{
-			void* StructuredBufferData = RHILockBuffer(DeformTransformsSB, 0, DeformTransforms.Num() * sizeof(FMatrix), RLM_WriteOnly);
-			FMemory::Memcpy(StructuredBufferData, DeformTransforms.GetData(), DeformTransforms.Num() * sizeof(FMatrix));
-			RHIUnlockBuffer(DeformTransformsSB);
-			bDeformTransformsDirty = false;
+			if (Sections[SectionIndex] != nullptr)
+			{
+				UpdateSectionWorldBox(SectionIndex);
+			}
 		}
 	}
 
-	/* Update the deform transform that is being used to deform this mesh section, this will just update this section's entry in the CPU array*/
-	void UpdateDeformTransform_RenderThread(int32 SectionIndex, FMatrix Transform)
+	/* Replace the lattice of a section, an empty array of offsets removes it, MeshBox is the static mesh box deformed by the new lattice*/
+	void SetSectionLattice_RenderThread(int32 SectionIndex, const TArray<FVector3f>& LatticeOffsets, const FBox& MeshBox)
 	{
 		check(IsInRenderingThread());
+
 		if (SectionIndex < Sections.Num() &&
 			Sections[SectionIndex] != nullptr)
 		{
-			DeformTransforms[SectionIndex] = Transform;
-			//Mark as dirty
-			bDeformTransformsDirty = true;
+			FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			Section->LatticeOffsets = LatticeOffsets;
+			Section->MeshBox = MeshBox;
+			UpdateSectionWorldBox(SectionIndex);
+
+			AssignSectionLattice_RenderThread(SectionIndex);
+			UpdateLatticeBuffers_RenderThread(LatticeSlots[SectionIndex]);
+
+			//The instance bounds are the mesh box
+			if (bGPUSceneInstances)
+			{
+				WriteSectionInstance(SectionIndex);
+				UpdateGPUSceneInstances_RenderThread(1);
+			}
+
+			//Adding or removing the lattice can move the section in or out of the deform cache, and in or out of the GPU scene instances
+			if (UpdateSectionCache_RenderThread(SectionIndex) || bGPUSceneInstances)
+			{
+				UpdateSectionGroups_RenderThread();
+				UpdateCachedDraws_RenderThread();
+			}
+			//The cache keeps the positions of the previous frame, so a lattice change of a cached section has velocity
+			else if (Section->Cache != nullptr)
+			{
+				bAlwaysHasVelocity = true;
+			}
 		}
 	}
 
@@ -250,12 +626,119 @@ public:
 			Sections[SectionIndex] != nullptr)
 		{
 			Sections[SectionIndex]->bSectionVisible = bNewVisibility;
+
+			//Hidden sections aren't part of any instanced batch, and don't cast shadows
+			UpdateSectionGroups_RenderThread();
+
+			//Hidden sections aren't cached either
+			if (IsSectionCached(Sections[SectionIndex]))
+			{
+				UpdateCachedDraws_RenderThread();
+			}
+		}
+	}
+
+	/* Move sections between the cached draws and the dynamic path*/
+	void SetSectionsHot_RenderThread(TArrayView<const int32> SectionIndices, bool bHot)
+	{
+		check(IsInRenderingThread());
+
+		bool bChanged = false;
+		for (const int32 SectionIndex : SectionIndices)
+		{
+			if (Sections.IsValidIndex(SectionIndex) &&
+				Sections[SectionIndex] != nullptr &&
+				Sections[SectionIndex]->bHot != bHot)
+			{
+				Sections[SectionIndex]->bHot = bHot;
+				NumHotSections += bHot ? 1 : -1;
+				bChanged = true;
+			}
+		}
+
+		if (bChanged && bStaticDrawPath)
+		{
+			UpdateSectionGroups_RenderThread();
+			UpdateCachedDraws_RenderThread();
+		}
+	}
+
+	/* Change how a section casts shadows, its cached batches and its instanced group depend on it */
+	void SetSectionShadowMode_RenderThread(int32 SectionIndex, EDeformMeshShadowMode NewShadowMode)
+	{
+		check(IsInRenderingThread());
+
+		if (SectionIndex < Sections.Num() &&
+			Sections[SectionIndex] != nullptr &&
+			Sections[SectionIndex]->ShadowMode != NewShadowMode)
+		{
+			Sections[SectionIndex]->ShadowMode = NewShadowMode;
+			UpdateSectionGroups_RenderThread();
+			if (IsSectionCached(Sections[SectionIndex]))
+			{
+				UpdateCachedDraws_RenderThread();
+			}
+		}
+	}
+
+	/*
+	 * Group the visible sections by (mesh, material, shadow mode) for the instanced draw path, and upload the transform indices of each group's instances
+	 * The cached sections and the dynamic ones are grouped separately, the instances of the cached groups are stored after the dynamic ones
+	 * This is called whenever the drawn sections change, so the shadow casters are counted here too
+	*/
+	void UpdateSectionGroups_RenderThread()
+	{
+		check(IsInRenderingThread());
+		UpdateShadowCasters_RenderThread();
+		if (bGPUSceneInstances)
+		{
+			UpdateInstanceRuns_RenderThread();
+		}
+		if (!bInstancedDrawing || !InstanceTransformIndicesSB)
+		{
+			return;
+		}
+
+		TArray<FDeformMeshSectionGroupKey, TInlineAllocator<64>> DynamicKeys;
+		TArray<FDeformMeshSectionGroupKey, TInlineAllocator<64>> CachedKeys;
+		DynamicKeys.SetNum(Sections.Num());
+		CachedKeys.SetNum(Sections.Num());
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			if (Section != nullptr)
+			{
+				//The other materials come from the static mesh, so the first one is enough to tell apart the sections of a mesh
+				//A section with a deform cache draws its own vertices, it's keyed by itself so it's always alone in its group
+				const bool bCached = IsSectionCached(Section);
+				const void* Mesh = Section->Cache != nullptr ? (const void*)Section : (const void*)Section->RenderResources;
+				DynamicKeys[SectionIndex] = FDeformMeshSectionGroupKey(Mesh, Section->Materials[0], IsSectionDrawn(Section) && !bCached, (uint8)Section->ShadowMode);
+				CachedKeys[SectionIndex] = FDeformMeshSectionGroupKey(Mesh, Section->Materials[0], IsSectionDrawn(Section) && bCached, (uint8)Section->ShadowMode);
+			}
+		}
+
+		TArray<uint32> CachedInstanceTransformIndices;
+		FDeformMeshSectionGroups::Build(DynamicKeys, SectionGroups, InstanceTransformIndices);
+		FDeformMeshSectionGroups::Build(CachedKeys, CachedSectionGroups, CachedInstanceTransformIndices);
+		for (FDeformMeshSectionGroup& Group : CachedSectionGroups)
+		{
+			Group.FirstInstance += InstanceTransformIndices.Num();
+		}
+		InstanceTransformIndices.Append(CachedInstanceTransformIndices);
+
+		if (InstanceTransformIndices.Num() > 0)
+		{
+			void* IndicesData = RHILockBuffer(InstanceTransformIndicesSB, 0, InstanceTransformIndices.Num() * sizeof(uint32), RLM_WriteOnly);
+			FMemory::Memcpy(IndicesData, InstanceTransformIndices.GetData(), InstanceTransformIndices.Num() * sizeof(uint32));
+			RHIUnlockBuffer(InstanceTransformIndicesSB);
 		}
 	}
 
 	/* Given the scene views and the visibility map, we add to the collector the relevant dynamic meshes that need to be rendered by this component*/
 	virtual void GetDynamicMeshElements(const TArray<const FSceneView*>& Views, const FSceneViewFamily& ViewFamily, uint32 VisibilityMap, FMeshElementCollector& Collector) const override
 	{
+		SCOPE_CYCLE_COUNTER(STAT_DeformMesh_GetDynamicMeshElements);
+
 		// Set up wireframe material (if needed)
 		const bool bWireframe = AllowDebugViewmodes() && ViewFamily.EngineShowFlags.Wireframe;
 
@@ -270,111 +753,1285 @@ public:
 			Collector.RegisterOneFrameMaterialProxy(WireframeMaterialInstance);
 		}
 
-		// Iterate over sections
-		for (const FDeformMeshSectionProxy* Section : Sections)
+		uint32 NumSectionsCulled = 0;
+		uint32 NumSectionsSubmitted = 0;
+		uint32 NumShadowViews = 0;
+		uint32 NumShadowSectionsSubmitted = 0;
+		uint32 NumShadowSectionsSkipped = 0;
+
+		//The primitive uniform buffer is the same for every batch of every view, it's created with the first batch and shared by the others
+		FDynamicPrimitiveUniformBuffer* PrimitiveUniformBuffer = nullptr;
+
+		//Rich views (wireframe..) don't use the cached draws, so the cached sections are drawn here too
+		const bool bDrawCachedSections = IsRichView(ViewFamily);
+
+		// For each view..
+		for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
 		{
-			if (Section != nullptr && Section->bSectionVisible)
+			//Check if our mesh is visible from this view
+			if (!(VisibilityMap & (1 << ViewIndex)))
 			{
-				//Get the section's materil, or the wireframe material if we're rendering in wireframe mode
-				FMaterialRenderProxy* MaterialProxy = bWireframe ? WireframeMaterialInstance : Section->Material->GetRenderProxy();
+				continue;
+			}
+			const FSceneView* View = Views[ViewIndex];
 
-				// For each view..
-				for (int32 ViewIndex = 0; ViewIndex < Views.Num(); ViewIndex++)
+			//The shadow depth passes gather the sections with a view that has the culling frustum of the shadow
+			const bool bShadowView = View->GetDynamicMeshElementsShadowCullFrustum() != nullptr;
+			NumShadowViews += bShadowView ? 1 : 0;
+
+			if (bInstancedDrawing)
+			{
+				// One instanced batch per group of sections sharing the same mesh and material
+				const int32 NumGroups = bDrawCachedSections ? SectionGroups.Num() + CachedSectionGroups.Num() : SectionGroups.Num();
+				for (int32 GroupIndex = 0; GroupIndex < NumGroups; GroupIndex++)
 				{
-					//Check if our mesh is visible from this view
-					if (VisibilityMap & (1 << ViewIndex))
+					const FDeformMeshSectionGroup& Group = GroupIndex < SectionGroups.Num() ? SectionGroups[GroupIndex] : CachedSectionGroups[GroupIndex - SectionGroups.Num()];
+
+					//The instances of a group are drawn together, so we only cull the groups that don't have any section in the view
+					//They also share one LOD, the one needed by the biggest section on screen
+					bool bGroupVisible = false;
+					float GroupScreenSize = 0.0f;
+					for (int32 InstanceIndex = Group.FirstInstance; InstanceIndex < Group.FirstInstance + Group.NumInstances; InstanceIndex++)
 					{
-						const FSceneView* View = Views[ViewIndex];
-						// Allocate a mesh batch and get a ref to the first element
-						FMeshBatch& Mesh = Collector.AllocateMesh();
-						FMeshBatchElement& BatchElement = Mesh.Elements[0];
-						//Fill this batch element with the mesh section's render data
-						BatchElement.IndexBuffer = &Section->IndexBuffer;
-						Mesh.bWireframe = bWireframe;
-						Mesh.VertexFactory = &Section->VertexFactory;
-						Mesh.MaterialRenderProxy = MaterialProxy;
-
-						//The LocalVertexFactory uses a uniform buffer to pass primitve data like the local to world transform for this frame and for the previous one
-						//Most of this data can be fetched using the helper function below
-						bool bHasPrecomputedVolumetricLightmap;
-						FMatrix PreviousLocalToWorld;
-						int32 SingleCaptureIndex;
-						bool bOutputVelocity;
-						GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
-						//Alloate a temporary primitive uniform buffer, fill it with the data and set it in the batch element
-						FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
-						DynamicPrimitiveUniformBuffer.Set(GetLocalToWorld(), PreviousLocalToWorld, GetBounds(), GetLocalBounds(), true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
-						BatchElement.PrimitiveUniformBufferResource = &DynamicPrimitiveUniformBuffer.UniformBuffer;
-						BatchElement.PrimitiveIdMode = PrimID_DynamicPrimitiveShaderData;
-
-						//Additional data 
-						BatchElement.FirstIndex = 0;
-						BatchElement.NumPrimitives = Section->IndexBuffer.GetNumIndices() / 3;
-						BatchElement.MinVertexIndex = 0;
-						BatchElement.MaxVertexIndex = Section->MaxVertexIndex;
-						Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
-						Mesh.Type = PT_TriangleList;
-						Mesh.DepthPriorityGroup = SDPG_World;
-						Mesh.bCanApplyViewModeOverrides = false;
-
-						//Add the batch to the collector
-						Collector.AddMesh(ViewIndex, Mesh);
+						const FDeformMeshSectionProxy* Instance = Sections[InstanceTransformIndices[InstanceIndex]];
+						if (IsBoxInView(View, Instance->WorldBox))
+						{
+							bGroupVisible = true;
+							GroupScreenSize = FMath::Max(GroupScreenSize, GetSectionScreenSize(View, Instance));
+						}
+					}
+					if (!bGroupVisible)
+					{
+						NumSectionsCulled += Group.NumInstances;
+						NumShadowSectionsSkipped += bShadowView ? Group.NumInstances : 0;
+						continue;
+					}
+
+					//The sections of a group share their shadow mode
+					const FDeformMeshSectionProxy* Section = Sections[Group.FirstSection];
+					int32 LODIndex = SelectSectionLOD(Section, GroupScreenSize);
+					if (bShadowView && !SelectShadowLOD(Section, GroupScreenSize, LODIndex))
+					{
+						NumShadowSectionsSkipped += Group.NumInstances;
+						continue;
+					}
+					NumSectionsSubmitted += Group.NumInstances;
+					NumShadowSectionsSubmitted += bShadowView ? Group.NumInstances : 0;
+
+					//A group of one section is drawn like a non instanced section, using its section index directly
+					const int32 UserIndex = Group.NumInstances > 1 ? Group.FirstInstance : Group.FirstSection;
+					AddSectionMeshBatches(ViewIndex, Section, LODIndex, WireframeMaterialInstance, UserIndex, Group.NumInstances, PrimitiveUniformBuffer, Collector);
+				}
+			}
+			else
+			{
+				// Iterate over sections
+				for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+				{
+					const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+					if (Section != nullptr && IsSectionDrawn(Section) && (bDrawCachedSections || !IsSectionCached(Section)))
+					{
+						//Skip the sections that are outside of this view
+						if (!IsBoxInView(View, Section->WorldBox))
+						{
+							NumSectionsCulled++;
+							NumShadowSectionsSkipped += bShadowView ? 1 : 0;
+							continue;
+						}
+
+						const float ScreenSize = GetSectionScreenSize(View, Section);
+						int32 LODIndex = SelectSectionLOD(Section, ScreenSize);
+						if (bShadowView && !SelectShadowLOD(Section, ScreenSize, LODIndex))
+						{
+							NumShadowSectionsSkipped++;
+							continue;
+						}
+						NumSectionsSubmitted++;
+						NumShadowSectionsSubmitted += bShadowView ? 1 : 0;
+
+						AddSectionMeshBatches(ViewIndex, Section, LODIndex, WireframeMaterialInstance, SectionIndex, 1, PrimitiveUniformBuffer, Collector);
 					}
 				}
 			}
 		}
-	}
 
-	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const
-	{
-		FPrimitiveViewRelevance Result;
-		Result.bDrawRelevance = IsShown(View);
-		Result.bShadowRelevance = IsShadowCast(View);
-		Result.bDynamicRelevance = true;
-		Result.bRenderInMainPass = ShouldRenderInMainPass();
-		Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
-		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
-		Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
-		MaterialRelevance.SetPrimitiveViewRelevance(Result);
-		Result.bVelocityRelevance = IsMovable() && Result.bOpaque && Result.bRenderInMainPass;
-		return Result;
-	}
+		INC_DWORD_STAT_BY(STAT_DeformMesh_SectionsCulled, NumSectionsCulled);
+		INC_DWORD_STAT_BY(STAT_DeformMesh_SectionsSubmitted, NumSectionsSubmitted);
+		INC_DWORD_STAT_BY(STAT_DeformMesh_ShadowSectionsSubmitted, NumShadowSectionsSubmitted);
+		INC_DWORD_STAT_BY(STAT_DeformMesh_ShadowSectionsSkipped, NumShadowSectionsSkipped);
 
-	virtual bool CanBeOccluded() const override
-	{
-		return !MaterialRelevance.bDisableDepthTest;
+		//Several shadow views can be gathered at the same time
+		if (NumShadowViews > 0)
+		{
+			ShadowDrawCounts->NumShadowViews += NumShadowViews;
+			ShadowDrawCounts->NumSectionsDrawn += NumShadowSectionsSubmitted;
+			ShadowDrawCounts->NumSectionsSkipped += NumShadowSectionsSkipped;
+		}
 	}
 
-	virtual uint32 GetMemoryFootprint(void) const
+	/* Called by the renderer when the proxy is added to the scene, and again after UpdateCachedDraws_RenderThread, the mesh draw commands of these batches are cached*/
+	/* The batches read the deform transforms from the structured buffer, so updating a transform doesn't invalidate them*/
+	virtual void DrawStaticElements(FStaticPrimitiveDrawInterface* PDI) override
+	{
+		if (!bStaticDrawPath)
+		{
+			return;
+		}
+
+		//The cached sections are all GPU scene instances then
+		if (bGPUSceneInstances)
+		{
+			for (int32 GroupIndex = 0; GroupIndex < InstanceGroups.Num(); GroupIndex++)
+			{
+				DrawStaticSection(PDI, Sections[InstanceGroups[GroupIndex].FirstSection], 0, 1, &InstanceGroupRuns[GroupIndex]);
+			}
+			return;
+		}
+
+		if (bInstancedDrawing)
+		{
+			for (const FDeformMeshSectionGroup& Group : CachedSectionGroups)
+			{
+				//A group of one section is drawn like a non instanced section, using its section index directly
+				const int32 UserIndex = Group.NumInstances > 1 ? Group.FirstInstance : Group.FirstSection;
+				DrawStaticSection(PDI, Sections[Group.FirstSection], UserIndex, Group.NumInstances);
+			}
+		}
+		else
+		{
+			for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+			{
+				const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+				if (Section != nullptr && IsSectionDrawn(Section) && IsSectionCached(Section))
+				{
+					DrawStaticSection(PDI, Section, SectionIndex, 1);
+				}
+			}
+		}
+	}
+
+	virtual FPrimitiveViewRelevance GetViewRelevance(const FSceneView* View) const
+	{
+		FPrimitiveViewRelevance Result;
+		Result.bDrawRelevance = IsShown(View);
+		Result.bShadowRelevance = IsShadowCast(View) && bHasShadowSections;
+		//The cached draws are used unless this is a rich view, the hot sections are always drawn dynamically
+		Result.bStaticRelevance = bStaticDrawPath && !IsRichView(*View->Family);
+		Result.bDynamicRelevance = !Result.bStaticRelevance || NumHotSections > 0 || bHasDynamicSections;
+		Result.bRenderInMainPass = ShouldRenderInMainPass();
+		Result.bUsesLightingChannels = GetLightingChannelMask() != GetDefaultLightingChannelMask();
+		Result.bRenderCustomDepth = ShouldRenderCustomDepth();
+		Result.bTranslucentSelfShadow = bCastVolumetricTranslucentShadow;
+		MaterialRelevance.SetPrimitiveViewRelevance(Result);
+		//The sections can move while the component doesn't
+		Result.bVelocityRelevance = (IsMovable() || AlwaysHasVelocity()) && Result.bOpaque && Result.bRenderInMainPass;
+		return Result;
+	}
+
+	virtual bool CanBeOccluded() const override
+	{
+		return !MaterialRelevance.bDisableDepthTest;
+	}
+
+#if RHI_RAYTRACING
+	/* The sections move without the primitive, so they're gathered every frame instead of being cached in the ray tracing scene */
+	virtual bool IsRayTracingRelevant() const override { return true; }
+	virtual bool IsRayTracingStaticRelevant() const override { return false; }
+
+	/*
+	 * Adds one ray tracing instance per visible section, FDeformMeshRayTracing picks the geometry and the transform of each one
+	 * The hits are shaded with the vertex factory of the static mesh, through a primitive uniform buffer holding the local to world of the section
+	*/
+	virtual void GetDynamicRayTracingInstances(FRayTracingMaterialGatheringContext& Context, TArray<FRayTracingInstance>& OutRayTracingInstances) override
+	{
+		SCOPE_CYCLE_COUNTER(STAT_DeformMesh_GetDynamicRayTracingInstances);
+
+		RayTracingSections.SetNum(Sections.Num(), false);
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			FDeformMeshRayTracingSection& RayTracingSection = RayTracingSections[SectionIndex];
+			RayTracingSection = FDeformMeshRayTracingSection();
+			if (Section == nullptr || !IsSectionDrawn(Section))
+			{
+				continue;
+			}
+
+			//The rigid sections use the LOD of the main view, a cached section only has the LOD of its cache
+			RayTracingSection.DeformTransform = DeformTransforms[SectionIndex];
+			RayTracingSection.LODIndex = Section->Cache != nullptr ? Section->Cache->GetLODIndex() : SelectSectionLOD(Section, GetSectionScreenSize(Context.ReferenceView, Section));
+			RayTracingSection.bVisible = true;
+			//The lattice is only evaluated by the vertex factory and the deform cache, a section with a lattice can't use the undeformed static mesh BLAS
+			RayTracingSection.bHasStaticGeometry = Section->LatticeOffsets.Num() == 0 && HasStaticRayTracingGeometry(Section->RenderResources->GetLOD(RayTracingSection.LODIndex));
+			RayTracingSection.bHasCachedGeometry = Section->Cache != nullptr && Section->Cache->GetRayTracingGeometry() != nullptr;
+		}
+		FDeformMeshRayTracing::GatherInstances(RayTracingSections, GetLocalToWorld(), RayTracingInstanceDescs);
+
+		//Most of this data can be fetched using the helper function below, it's the same for all the sections
+		bool bHasPrecomputedVolumetricLightmap;
+		FMatrix PreviousLocalToWorld;
+		int32 SingleCaptureIndex;
+		bool bOutputVelocity;
+		GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+		bOutputVelocity |= AlwaysHasVelocity();
+
+		for (const FDeformMeshRayTracingInstanceDesc& InstanceDesc : RayTracingInstanceDescs)
+		{
+			const FDeformMeshSectionProxy* Section = Sections[InstanceDesc.SectionIndex];
+			const FDeformMeshLODResources& LODResources = Section->RenderResources->GetLOD(InstanceDesc.LODIndex);
+
+			FRayTracingInstance RayTracingInstance;
+			RayTracingInstance.Geometry = InstanceDesc.Mode == EDeformMeshRayTracingMode::Cached ? Section->Cache->GetRayTracingGeometry() : LODResources.RayTracingGeometry;
+			RayTracingInstance.InstanceTransforms.Add(InstanceDesc.InstanceToWorld);
+
+			const FMatrix PreviousSectionLocalToWorld = FMatrix(PreviousDeformTransforms[InstanceDesc.SectionIndex]).GetTransposed() * PreviousLocalToWorld;
+			FDynamicPrimitiveUniformBuffer& PrimitiveUniformBuffer = Context.RayTracingMeshResourceCollector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+			PrimitiveUniformBuffer.Set(InstanceDesc.ShadingLocalToWorld, PreviousSectionLocalToWorld, FBoxSphereBounds(Section->WorldBox), FBoxSphereBounds(Section->MeshBox), true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
+
+			//One mesh batch per segment of the geometry, in the same order
+			for (int32 SegmentIndex = 0; SegmentIndex < LODResources.Sections.Num(); SegmentIndex++)
+			{
+				const FDeformMeshLODSection& LODSection = LODResources.Sections[SegmentIndex];
+				FMeshBatch Mesh;
+				FMeshBatchElement& BatchElement = Mesh.Elements[0];
+				BatchElement.IndexBuffer = LODResources.IndexBuffer;
+				BatchElement.FirstIndex = LODSection.FirstIndex;
+				BatchElement.NumPrimitives = LODSection.NumTriangles;
+				BatchElement.MinVertexIndex = LODSection.MinVertexIndex;
+				BatchElement.MaxVertexIndex = LODSection.MaxVertexIndex;
+				BatchElement.PrimitiveUniformBufferResource = &PrimitiveUniformBuffer.UniformBuffer;
+				Mesh.VertexFactory = LODResources.StaticVertexFactory;
+				Mesh.MaterialRenderProxy = GetSectionMaterial(Section, LODSection)->GetRenderProxy();
+				Mesh.SegmentIndex = SegmentIndex;
+				Mesh.LODIndex = (int8)InstanceDesc.LODIndex;
+				Mesh.CastShadow = LODSection.bCastShadow && Section->ShadowMode != EDeformMeshShadowMode::None;
+				Mesh.CastRayTracedShadow = Mesh.CastShadow && CastsDynamicShadow();
+				//A section can be mirrored by its deform transform alone
+				Mesh.ReverseCulling = InstanceDesc.ShadingLocalToWorld.Determinant() < 0.0f;
+				Mesh.Type = PT_TriangleList;
+				Mesh.DepthPriorityGroup = SDPG_World;
+				Mesh.bCanApplyViewModeOverrides = false;
+				RayTracingInstance.Materials.Add(Mesh);
+			}
+
+			RayTracingInstance.BuildInstanceMaskAndFlags(GetScene().GetFeatureLevel());
+			OutRayTracingInstances.Add(RayTracingInstance);
+		}
+		INC_DWORD_STAT_BY(STAT_DeformMesh_RayTracingInstances, RayTracingInstanceDescs.Num());
+	}
+#endif
+
+	virtual uint32 GetMemoryFootprint(void) const
 	{
 		return(sizeof(*this) + GetAllocatedSize());
 	}
 
+	/* The shared render resources aren't counted here, they're reported once by FDeformMeshResourceCache::GetAllocatedSize*/
 	uint32 GetAllocatedSize(void) const
 	{
-		return(FPrimitiveSceneProxy::GetAllocatedSize());
+		uint32 Size = FPrimitiveSceneProxy::GetAllocatedSize();
+		Size += Sections.GetAllocatedSize() + DeformTransforms.GetAllocatedSize() + TransformSerials.GetAllocatedSize() + OrphanTransforms.GetAllocatedSize() + PreviousDeformTransforms.GetAllocatedSize() + DirtyTransforms.GetAllocatedSize() + MovedTransforms.GetAllocatedSize() + SectionGroups.GetAllocatedSize() + CachedSectionGroups.GetAllocatedSize() + InstanceTransformIndices.GetAllocatedSize();
+		Size += InstanceGroups.GetAllocatedSize() + InstanceGroupRuns.GetAllocatedSize() + InstanceRuns.GetAllocatedSize();
+		Size += LatticeSlots.GetAllocatedSize() + Lattices.GetAllocatedSize() + FreeLatticeSlots.GetAllocatedSize();
+#if RHI_RAYTRACING
+		Size += RayTracingSections.GetAllocatedSize() + RayTracingInstanceDescs.GetAllocatedSize() + RayTracingRefitSections.GetAllocatedSize();
+#endif
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr)
+			{
+				Size += sizeof(FDeformMeshSectionProxy) + Section->Materials.GetAllocatedSize() + Section->LatticeOffsets.GetAllocatedSize();
+				Size += Section->Cache != nullptr ? sizeof(FDeformMeshSectionCache) : 0;
+			}
+		}
+		return Size;
 	}
 
-	//Getter to the SRV of the transforms structured buffer
-	inline FShaderResourceViewRHIRef& GetDeformTransformsSRV() { return DeformTransformsSRV; }
+	//Getter to the SRV of the transforms structured buffer, used by the vertex factory when binding its shader parameters
+	inline FRHIShaderResourceView* GetDeformTransformsSRV() const { return DeformTransformsSRV; }
+	inline FRHIShaderResourceView* GetPreviousDeformTransformsSRV() const { return PreviousDeformTransformsSRV; }
+
+	//Getters to the SRVs of the lattice slot of each section and of the lattices, used by the vertex factory when binding its shader parameters
+	inline FRHIShaderResourceView* GetLatticeSlotsSRV() const { return LatticeSlotsSRV; }
+	inline FRHIShaderResourceView* GetLatticesSRV() const { return LatticesSRV; }
+
+	//Getter to the format of the transforms buffer, the vertex factory passes it to the shader so it knows how to decode them
+	inline EDeformMeshTransformFormat GetTransformFormat() const { return TransformFormat; }
+
+	//Getter to the SRV of the instance transform indices, used by the vertex factory when binding its shader parameters
+	inline FRHIShaderResourceView* GetInstanceTransformIndicesSRV() const { return InstanceTransformIndicesSRV; }
+
+	//Getter to the deform cache of a section, used by the cached vertex factory when binding its shader parameters
+	inline const FDeformMeshSectionCache* GetSectionCache(int32 SectionIndex) const { return Sections[SectionIndex]->Cache; }
+
+	//Getters to the sections as the render thread sees them, used by DeformMesh.StressSectionUpdates to compare them with the component
+	inline int32 GetNumSections_RenderThread() const { return Sections.Num(); }
+	inline int32 GetTransformsCapacity_RenderThread() const { return TransformsCapacity; }
+	inline const FMatrix44f* FindSectionTransform_RenderThread(int32 SectionIndex) const { return Sections.IsValidIndex(SectionIndex) && Sections[SectionIndex] != nullptr ? &DeformTransforms[SectionIndex] : nullptr; }
+
+	//Whether a section can be added without recreating the proxy, called on the game thread, the number of GPU scene instances never changes
+	inline bool HasInstanceSlot(int32 SectionIndex) const { return !bGPUSceneInstances || SectionIndex < InstanceSceneData.Num(); }
 
 private:
+	/*
+	 * Creates the structured buffers with room for Capacity sections, and fills the transforms buffer with the current transforms
+	 * This is also used to grow the buffers, the previous ones are released once the renderer doesn't use them anymore
+	*/
+	void CreateTransformsBuffers_RenderThread(int32 Capacity)
+	{
+		check(IsInRenderingThread());
+		check(Capacity >= DeformTransforms.Num());
+		TransformsCapacity = Capacity;
+
+		///////////////////////////////////////////////////////////////
+		//// CREATING THE STRUCTURED BUFFER FOR THE DEFORM TRANSFORMS OF ALL THE SECTIONS
+		//We'll use one structured buffer for all the mesh sections of the component
+		//The transforms are encoded in TransformFormat (see FDeformMeshTransformCodec), the shader reads the buffer as a ByteAddressBuffer and decodes them
+		const uint32 Stride = FDeformMeshTransformCodec::GetStride(TransformFormat);
+
+		//We first create a resource array to use it in the create info for initializing the structured buffer on creation
+		//The entries past the last section are only there to make room for the sections that will be added
+		TResourceArray<uint8>* ResourceArray = new TResourceArray<uint8>(true);
+		FRHIResourceCreateInfo CreateInfo(TEXT("DeformMesh_TransformsSB"));
+		ResourceArray->AddZeroed(Capacity * Stride);
+		EncodeTransforms(DeformTransforms, 0, DeformTransforms.Num(), ResourceArray->GetData());
+		CreateInfo.ResourceArray = ResourceArray;
+
+		//The buffer isn't dynamic since we write parts of it (see UpdateDeformTransformsSB_RenderThread), locking a range of a dynamic buffer can discard the rest of it on some RHIs
+		DeformTransformsSB = RHICreateStructuredBuffer(sizeof(uint32), Capacity * Stride, BUF_ShaderResource | BUF_Static | BUF_ByteAddressBuffer, CreateInfo);
+		DirtyTransforms.SetRange(0, DirtyTransforms.Num(), false);
+		NumDirtyTransforms = 0;
+		///////////////////////////////////////////////////////////////
+		//// CREATING AN SRV FOR THE STRUCTUED BUFFER SO WA CAN USE IT AS A SHADER RESOURCE PARAMETER AND BIND IT TO THE VERTEX FACTORY
+		DeformTransformsSRV = RHICreateShaderResourceView(DeformTransformsSB);
+
+		///////////////////////////////////////////////////////////////
+		//// CREATING THE STRUCTURED BUFFER FOR THE DEFORM TRANSFORMS OF THE PREVIOUS FRAME
+		//Same format and capacity, the vertex factory reads it to compute the motion vectors
+		TResourceArray<uint8>* PreviousResourceArray = new TResourceArray<uint8>(true);
+		FRHIResourceCreateInfo PreviousCreateInfo(TEXT("DeformMesh_PreviousTransformsSB"));
+		PreviousResourceArray->AddZeroed(Capacity * Stride);
+		EncodeTransforms(PreviousDeformTransforms, 0, PreviousDeformTransforms.Num(), PreviousResourceArray->GetData());
+		PreviousCreateInfo.ResourceArray = PreviousResourceArray;
+		PreviousDeformTransformsSB = RHICreateStructuredBuffer(sizeof(uint32), Capacity * Stride, BUF_ShaderResource | BUF_Static | BUF_ByteAddressBuffer, PreviousCreateInfo);
+		PreviousDeformTransformsSRV = RHICreateShaderResourceView(PreviousDeformTransformsSB);
+
+		///////////////////////////////////////////////////////////////
+		//// CREATING THE STRUCTURED BUFFER FOR THE TRANSFORM INDICES OF THE INSTANCED BATCHES
+		//The shader always declares it, so we create it even when we're not drawing instanced, it never holds more than one index per section
+		FRHIResourceCreateInfo IndicesCreateInfo(TEXT("DeformMesh_InstanceTransformIndicesSB"));
+		InstanceTransformIndicesSB = RHICreateStructuredBuffer(sizeof(uint32), Capacity * sizeof(uint32), BUF_ShaderResource | BUF_Dynamic, IndicesCreateInfo);
+		InstanceTransformIndicesSRV = RHICreateShaderResourceView(InstanceTransformIndicesSB);
+
+		///////////////////////////////////////////////////////////////
+		//// CREATING THE STRUCTURED BUFFER FOR THE LATTICE SLOT OF EACH SECTION
+		//It's indexed like the transforms, the sections without a lattice have INDEX_NONE
+		TResourceArray<int32>* SlotsResourceArray = new TResourceArray<int32>(true);
+		FRHIResourceCreateInfo SlotsCreateInfo(TEXT("DeformMesh_LatticeSlotsSB"));
+		SlotsResourceArray->Reserve(Capacity);
+		SlotsResourceArray->Append(LatticeSlots);
+		while (SlotsResourceArray->Num() < Capacity)
+		{
+			SlotsResourceArray->Add(INDEX_NONE);
+		}
+		SlotsCreateInfo.ResourceArray = SlotsResourceArray;
+		LatticeSlotsSB = RHICreateStructuredBuffer(sizeof(uint32), Capacity * sizeof(uint32), BUF_ShaderResource | BUF_Dynamic, SlotsCreateInfo);
+		LatticeSlotsSRV = RHICreateShaderResourceView(LatticeSlotsSB);
+		///////////////////////////////////////////////////////////////
+	}
+
+	/* Creates the structured buffer of the lattices with room for Capacity lattices, and fills it with the current ones */
+	void CreateLatticesBuffer_RenderThread(int32 Capacity)
+	{
+		check(IsInRenderingThread());
+		check(Capacity >= GetNumLatticeSlots());
+		LatticesCapacity = Capacity;
+
+		TResourceArray<FVector4f>* ResourceArray = new TResourceArray<FVector4f>(true);
+		FRHIResourceCreateInfo CreateInfo(TEXT("DeformMesh_LatticesSB"));
+		ResourceArray->Append(Lattices);
+		ResourceArray->AddZeroed(Capacity * FDeformMeshLattice::GPUStride - Lattices.Num());
+		CreateInfo.ResourceArray = ResourceArray;
+
+		//Like the transforms buffer, it's not dynamic since we only write the lattices that changed
+		LatticesSB = RHICreateStructuredBuffer(sizeof(FVector4f), Capacity * FDeformMeshLattice::GPUStride * sizeof(FVector4f), BUF_ShaderResource | BUF_Static, CreateInfo);
+		LatticesSRV = RHICreateShaderResourceView(LatticesSB);
+	}
+
+	/* Number of lattices in the CPU copy of the lattices buffer, including the free ones */
+	inline int32 GetNumLatticeSlots() const
+	{
+		return Lattices.Num() / FDeformMeshLattice::GPUStride;
+	}
+
+	/* Gives a slot of the lattices buffer to the section if it has a lattice, or frees its slot, and writes the lattice in the CPU copy of the buffer */
+	void AssignSectionLattice_RenderThread(int32 SectionIndex)
+	{
+		const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section == nullptr || Section->LatticeOffsets.Num() == 0)
+		{
+			FreeSectionLattice_RenderThread(SectionIndex);
+			return;
+		}
+
+		int32& Slot = LatticeSlots[SectionIndex];
+		if (Slot == INDEX_NONE)
+		{
+			if (FreeLatticeSlots.Num() > 0)
+			{
+				Slot = FreeLatticeSlots.Pop(false);
+			}
+			else
+			{
+				Slot = GetNumLatticeSlots();
+				Lattices.AddZeroed(FDeformMeshLattice::GPUStride);
+			}
+		}
+		FDeformMeshLattice::WriteGPUData(Section->LatticeBox, Section->LatticeOffsets, &Lattices[Slot * FDeformMeshLattice::GPUStride]);
+	}
+
+	/* The slot is reused by the next section that gets a lattice */
+	void FreeSectionLattice_RenderThread(int32 SectionIndex)
+	{
+		if (LatticeSlots[SectionIndex] != INDEX_NONE)
+		{
+			FreeLatticeSlots.Add(LatticeSlots[SectionIndex]);
+			LatticeSlots[SectionIndex] = INDEX_NONE;
+		}
+	}
+
+	/*
+	 * Uploads the lattice slot of every section, and the control points of one lattice
+	 * The lattices buffer grows geometrically like the transforms buffer, when it's full it's recreated with every lattice
+	*/
+	void UpdateLatticeBuffers_RenderThread(int32 DirtySlot)
+	{
+		check(IsInRenderingThread());
+
+		if (GetNumLatticeSlots() > LatticesCapacity)
+		{
+			//The cached draws hold the SRV of the old buffer
+			CreateLatticesBuffer_RenderThread(FMath::Max(GetNumLatticeSlots(), LatticesCapacity * 2));
+			UpdateCachedDraws_RenderThread();
+		}
+		else if (DirtySlot != INDEX_NONE)
+		{
+			const uint32 LatticeSize = FDeformMeshLattice::GPUStride * sizeof(FVector4f);
+			void* LatticeData = RHILockBuffer(LatticesSB, DirtySlot * LatticeSize, LatticeSize, RLM_WriteOnly);
+			FMemory::Memcpy(LatticeData, &Lattices[DirtySlot * FDeformMeshLattice::GPUStride], LatticeSize);
+			RHIUnlockBuffer(LatticesSB);
+		}
+
+		if (LatticeSlotsSB && LatticeSlots.Num() > 0)
+		{
+			void* SlotsData = RHILockBuffer(LatticeSlotsSB, 0, LatticeSlots.Num() * sizeof(int32), RLM_WriteOnly);
+			FMemory::Memcpy(SlotsData, LatticeSlots.GetData(), LatticeSlots.Num() * sizeof(int32));
+			RHIUnlockBuffer(LatticeSlotsSB);
+		}
+	}
+
+	/* Drops the reference of a section to the shared render resources and deletes it, its transform stays in the buffer until the entry is reused */
+	void ReleaseSection_RenderThread(int32 SectionIndex)
+	{
+		FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section != nullptr)
+		{
+			NumHotSections -= Section->bHot ? 1 : 0;
+			FreeSectionLattice_RenderThread(SectionIndex);
+			FDeformMeshResourceCache::Get().Release(Section->RenderResources);
+			delete Section->Cache;
+			delete Section;
+			Sections[SectionIndex] = nullptr;
+		}
+	}
+
+	/* Encodes Num transforms of Transforms starting at First into Dest, in the format of the transforms buffers */
+	void EncodeTransforms(const TArray<FMatrix44f>& Transforms, int32 First, int32 Num, uint8* Dest) const
+	{
+		if (TransformFormat == EDeformMeshTransformFormat::Full)
+		{
+			FMemory::Memcpy(Dest, &Transforms[First], Num * sizeof(FMatrix44f));
+			return;
+		}
+
+		const uint32 Stride = FDeformMeshTransformCodec::GetStride(TransformFormat);
+		for (int32 Index = 0; Index < Num; Index++)
+		{
+			FDeformMeshTransformCodec::Encode(TransformFormat, Transforms[First + Index], Dest + Index * Stride);
+		}
+	}
+
+	/* Writes Num previous transforms starting at First to the previous transforms buffer */
+	void UploadPreviousTransforms_RenderThread(int32 First, int32 Num)
+	{
+		const uint32 Stride = FDeformMeshTransformCodec::GetStride(TransformFormat);
+		void* StructuredBufferData = RHILockBuffer(PreviousDeformTransformsSB, First * Stride, Num * Stride, RLM_WriteOnly);
+		EncodeTransforms(PreviousDeformTransforms, First, Num, (uint8*)StructuredBufferData);
+		RHIUnlockBuffer(PreviousDeformTransformsSB);
+		INC_DWORD_STAT_BY(STAT_DeformMesh_TransformBytesUploaded, Num * Stride);
+	}
+
+	/*
+	 * Called at the beginning of each frame, the transforms that moved during the last frame become the previous transforms
+	 * The sections that didn't move have the same transform in both buffers, when no section moved the proxy stops asking for velocity
+	*/
+	void UpdatePreviousTransforms_RenderThread()
+	{
+		check(IsInRenderingThread());
+		if (NumMovedTransforms > 0)
+		{
+			int32 NumInstancesWritten = 0;
+			for (TConstSetBitIterator<> It(MovedTransforms); It; ++It)
+			{
+				PreviousDeformTransforms[It.GetIndex()] = DeformTransforms[It.GetIndex()];
+				if (bGPUSceneInstances && Sections[It.GetIndex()] != nullptr)
+				{
+					WriteSectionInstance(It.GetIndex());
+					NumInstancesWritten++;
+				}
+			}
+			UpdateGPUSceneInstances_RenderThread(NumInstancesWritten);
+
+			if (PreviousDeformTransformsSB)
+			{
+				TArray<FDeformMeshDirtyRange, TInlineAllocator<16>> MovedRanges;
+				FDeformMeshDirtyRanges::Build(MovedTransforms, DirtyRangeMaxGap, MovedRanges);
+				if (MovedRanges.Num() > MaxDirtyRanges)
+				{
+					UploadPreviousTransforms_RenderThread(0, PreviousDeformTransforms.Num());
+				}
+				else
+				{
+					for (const FDeformMeshDirtyRange& Range : MovedRanges)
+					{
+						UploadPreviousTransforms_RenderThread(Range.First, Range.Num);
+					}
+				}
+			}
+
+			MovedTransforms.SetRange(0, MovedTransforms.Num(), false);
+			NumMovedTransforms = 0;
+		}
+		bAlwaysHasVelocity = false;
+	}
+
+	/* Flag a transform as moved during this frame, its section outputs velocity until the next frame */
+	inline void MarkTransformMoved(int32 SectionIndex)
+	{
+		if (!MovedTransforms[SectionIndex])
+		{
+			MovedTransforms[SectionIndex] = true;
+			NumMovedTransforms++;
+		}
+		bAlwaysHasVelocity = true;
+	}
+
+	/* Flag a transform to be written by the next UpdateDeformTransformsSB_RenderThread */
+	inline void MarkTransformDirty(int32 SectionIndex)
+	{
+		if (!DirtyTransforms[SectionIndex])
+		{
+			DirtyTransforms[SectionIndex] = true;
+			NumDirtyTransforms++;
+		}
+	}
+
+	/* Whether a section is drawn at all, the sections are hidden until the render resources of their static mesh are initialized */
+	static inline bool IsSectionDrawn(const FDeformMeshSectionProxy* Section)
+	{
+		return Section->bSectionVisible && Section->RenderResources->IsInitialized();
+	}
+
+	/*
+	 * Counts the sections waiting for their render resources, and listens to the resource cache while there are some
+	 * The count is sent to the component when it changes, or always when bReport is set so that the component hears back after every section change
+	*/
+	void UpdatePendingSections_RenderThread(bool bReport)
+	{
+		check(IsInRenderingThread());
+
+		int32 NewNumPendingSections = 0;
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr && !Section->RenderResources->IsInitialized())
+			{
+				NewNumPendingSections++;
+			}
+		}
+
+		FDeformMeshResourceCache& ResourceCache = FDeformMeshResourceCache::Get();
+		if (NewNumPendingSections > 0 && !ResourcesInitializedHandle.IsValid())
+		{
+			ResourcesInitializedHandle = ResourceCache.OnResourcesInitialized_RenderThread.AddRaw(this, &FDeformMeshSceneProxy::OnResourcesInitialized_RenderThread);
+		}
+		else if (NewNumPendingSections == 0 && ResourcesInitializedHandle.IsValid())
+		{
+			ResourceCache.OnResourcesInitialized_RenderThread.Remove(ResourcesInitializedHandle);
+			ResourcesInitializedHandle.Reset();
+		}
+
+		if (bReport || NewNumPendingSections != NumPendingSections)
+		{
+			NumPendingSections = NewNumPendingSections;
+			AsyncTask(ENamedThreads::GameThread, [WeakComponent = OwnerComponent, NewNumPendingSections]()
+				{
+					if (UDeformMeshComponent* Component = WeakComponent.Get())
+					{
+						Component->SetNumPendingSections(NewNumPendingSections);
+					}
+				});
+		}
+	}
+
+	/* Called by the resource cache, the sections using these resources can now be drawn */
+	void OnResourcesInitialized_RenderThread(const FDeformMeshRenderResources* Resources)
+	{
+		const bool bUsed = Sections.ContainsByPredicate([Resources](const FDeformMeshSectionProxy* Section)
+			{
+				return Section != nullptr && Section->RenderResources == Resources;
+			});
+		if (bUsed)
+		{
+			for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+			{
+				if (Sections[SectionIndex] != nullptr && Sections[SectionIndex]->RenderResources == Resources)
+				{
+					UpdateSectionCache_RenderThread(SectionIndex);
+				}
+			}
+			UpdateSectionGroups_RenderThread();
+			UpdateCachedDraws_RenderThread();
+			UpdatePendingSections_RenderThread(false);
+		}
+	}
+
+	/*
+	 * Called by the resource cache when LODs of a static mesh were streamed in or out, before the vertex factories of the streamed out LODs are released
+	 * The caches move to the LOD they'd be created with now, and the cached draws are rebuilt so none of them keeps a streamed out vertex factory
+	*/
+	void OnResourcesFirstLODChanged_RenderThread(const FDeformMeshRenderResources* Resources)
+	{
+		bool bUsed = false;
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			if (Section == nullptr || Section->RenderResources != Resources)
+			{
+				continue;
+			}
+			bUsed = true;
+			if (Section->Cache != nullptr && Section->Cache->GetLODIndex() != GetSectionCacheLOD(Section))
+			{
+				delete Section->Cache;
+				Section->Cache = nullptr;
+			}
+			UpdateSectionCache_RenderThread(SectionIndex);
+		}
+		if (bUsed)
+		{
+			UpdateSectionGroups_RenderThread();
+			UpdateCachedDraws_RenderThread();
+		}
+	}
+
+	/* The LOD held by the deform cache of a section: the forced LOD, or the finest LOD that it's allowed to draw */
+	int32 GetSectionCacheLOD(const FDeformMeshSectionProxy* Section) const
+	{
+		const FDeformMeshRenderResources* RenderResources = Section->RenderResources;
+		const int32 LODIndex = ForcedLOD != INDEX_NONE ? ForcedLOD : FMath::Max(MinLOD, RenderResources->FirstLOD);
+		return FMath::Clamp(LODIndex, RenderResources->FirstLOD, RenderResources->LODs.Num() - 1);
+	}
+
+	/*
+	 * Creates the deform cache of a section if it needs one, or deletes it, a new cache is deformed right away
+	 * Only the sections with a lattice are cached, the other ones are cheap enough to deform in the vertex factory
+	 * Returns whether the section moved in or out of the cache, the caller has to rebuild the groups and the cached draws then
+	*/
+	bool UpdateSectionCache_RenderThread(int32 SectionIndex)
+	{
+		check(IsInRenderingThread());
+		FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		if (Section == nullptr)
+		{
+			return false;
+		}
+
+		const FDeformMeshLODResources* LODResources = nullptr;
+		if (bDeformCache && Section->LatticeOffsets.Num() > 0 && Section->RenderResources->IsInitialized() && DeformTransformsSRV)
+		{
+			LODResources = &Section->RenderResources->LODs[GetSectionCacheLOD(Section)];
+			if (!FDeformMeshSectionCache::IsSupported(*LODResources->VertexBuffers))
+			{
+				LODResources = nullptr;
+			}
+		}
+
+		if (LODResources == nullptr)
+		{
+			const bool bHadCache = Section->Cache != nullptr;
+			delete Section->Cache;
+			Section->Cache = nullptr;
+			return bHadCache;
+		}
+
+		const bool bNewCache = Section->Cache == nullptr;
+		if (bNewCache)
+		{
+			Section->Cache = new FDeformMeshSectionCache(GetSectionCacheLOD(Section), *LODResources->VertexBuffers, GetScene().GetFeatureLevel());
+		}
+		DispatchSectionCache_RenderThread(SectionIndex);
+#if RHI_RAYTRACING
+		//The BLAS of a new cache is built from the positions that were just written, the other ones are refit
+		if (bNewCache && IsRayTracingEnabled())
+		{
+			Section->Cache->InitRayTracingGeometry_RenderThread(*LODResources);
+		}
+#endif
+		RefitRayTracingGeometries_RenderThread();
+
+		//A new section doesn't have a previous frame, it starts without motion
+		if (bNewCache)
+		{
+			Section->Cache->UpdatePreviousPositions_RenderThread(FRHICommandListExecutor::GetImmediateCommandList());
+		}
+		return bNewCache;
+	}
+
+	/* Deforms the vertices of a cached section with its current transform and lattice, its BLAS is refit by the next RefitRayTracingGeometries_RenderThread */
+	void DispatchSectionCache_RenderThread(int32 SectionIndex)
+	{
+		Sections[SectionIndex]->Cache->Dispatch_RenderThread(FRHICommandListExecutor::GetImmediateCommandList(), SectionIndex, TransformFormat, DeformTransformsSRV, LatticeSlotsSRV, LatticesSRV);
+		INC_DWORD_STAT(STAT_DeformMesh_CacheDispatches);
+#if RHI_RAYTRACING
+		RayTracingRefitSections.Add(SectionIndex);
+#endif
+	}
+
+	/* Refits the BLAS of the caches deformed since the last refit, with one build for all of them */
+	void RefitRayTracingGeometries_RenderThread()
+	{
+#if RHI_RAYTRACING
+		TArray<FRayTracingGeometryBuildParams, TInlineAllocator<16>> BuildParams;
+		for (const int32 SectionIndex : RayTracingRefitSections)
+		{
+			if (Sections.IsValidIndex(SectionIndex) && Sections[SectionIndex] != nullptr && Sections[SectionIndex]->Cache != nullptr)
+			{
+				Sections[SectionIndex]->Cache->AddRayTracingRefit(BuildParams);
+			}
+		}
+		RayTracingRefitSections.Reset();
+
+		if (BuildParams.Num() > 0)
+		{
+			FRHICommandListExecutor::GetImmediateCommandList().BuildAccelerationStructures(BuildParams);
+			INC_DWORD_STAT_BY(STAT_DeformMesh_RayTracingRefits, BuildParams.Num());
+		}
+#endif
+	}
+
+#if RHI_RAYTRACING
+	/* Whether the rigid sections can be traced with the BLAS of this static mesh LOD */
+	static bool HasStaticRayTracingGeometry(const FDeformMeshLODResources& LODResources)
+	{
+		const FRayTracingGeometry* Geometry = LODResources.RayTracingGeometry;
+		//The static mesh keeps a segment for its empty ranges, which we skip, the materials wouldn't line up with the segments then
+		return Geometry != nullptr && Geometry->RayTracingGeometryRHI.IsValid()
+			&& Geometry->Initializer.Segments.Num() == LODResources.Sections.Num()
+			&& LODResources.StaticVertexFactory != nullptr;
+	}
+#endif
+
+	/* Everything that has a previous frame copy moves to the new frame */
+	void OnBeginFrame_RenderThread()
+	{
+		UpdatePreviousTransforms_RenderThread();
+		UpdatePreviousPositions_RenderThread();
+		ShadowDrawCounts->Publish();
+	}
+
+	/* Called at the beginning of each render thread frame, the positions written during the last frame become the previous positions */
+	void UpdatePreviousPositions_RenderThread()
+	{
+		FRHICommandListImmediate& RHICmdList = FRHICommandListExecutor::GetImmediateCommandList();
+		for (FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr && Section->Cache != nullptr)
+			{
+				Section->Cache->UpdatePreviousPositions_RenderThread(RHICmdList);
+			}
+		}
+	}
+
+	/* Whether a section is drawn with the cached draws, with the GPU scene instances they're only made of the instance sections */
+	inline bool IsSectionCached(const FDeformMeshSectionProxy* Section) const
+	{
+		return bGPUSceneInstances ? IsSectionInstance(Section) : bStaticDrawPath && !Section->bHot;
+	}
+
+	/* Whether a section is drawn as a GPU scene instance, the static mesh vertex factory can't apply a lattice */
+	inline bool IsSectionInstance(const FDeformMeshSectionProxy* Section) const
+	{
+		return bGPUSceneInstances && Section->LatticeOffsets.Num() == 0;
+	}
+
+	/* Writes the instance of a section from its deform transforms and its mesh box, the instances without a section are never drawn but still get a valid transform */
+	void WriteSectionInstance(int32 SectionIndex)
+	{
+		if (!InstanceSceneData.IsValidIndex(SectionIndex))
+		{
+			return;
+		}
+
+		const FDeformMeshSectionProxy* Section = Sections.IsValidIndex(SectionIndex) ? Sections[SectionIndex] : nullptr;
+		if (Section == nullptr)
+		{
+			InstanceSceneData[SectionIndex].LocalToPrimitive.SetIdentity();
+			InstanceDynamicData[SectionIndex].PrevLocalToPrimitive.SetIdentity();
+			InstanceLocalBounds[SectionIndex] = FRenderBounds(FVector3f::ZeroVector, FVector3f::ZeroVector);
+			return;
+		}
+
+		//The deform transforms are stored transposed for the shader
+		InstanceSceneData[SectionIndex].LocalToPrimitive = FRenderTransform(DeformTransforms[SectionIndex].GetTransposed());
+		InstanceDynamicData[SectionIndex].PrevLocalToPrimitive = FRenderTransform(PreviousDeformTransforms[SectionIndex].GetTransposed());
+		InstanceLocalBounds[SectionIndex] = FRenderBounds(Section->MeshBox);
+	}
+
+	/* Asks the GPU scene to upload the instances of the primitive again, after NumInstancesWritten of them were written, the cached draws stay valid */
+	void UpdateGPUSceneInstances_RenderThread(int32 NumInstancesWritten)
+	{
+		if (NumInstancesWritten > 0 && GetPrimitiveSceneInfo() != nullptr)
+		{
+			GetScene().RequestGPUSceneUpdate(*GetPrimitiveSceneInfo(), EPrimitiveDirtyState::ChangedAll);
+			INC_DWORD_STAT_BY(STAT_DeformMesh_GPUSceneInstancesUpdated, NumInstancesWritten);
+		}
+	}
+
+	/*
+	 * Groups the drawn instance sections by (mesh, material), and compresses the instances of each group in runs of consecutive section indices
+	 * DrawStaticElements draws each group with one batch per material range, the instance culling of the renderer then culls each instance of the runs
+	*/
+	void UpdateInstanceRuns_RenderThread()
+	{
+		TArray<FDeformMeshSectionGroupKey, TInlineAllocator<64>> Keys;
+		Keys.SetNum(Sections.Num());
+		bHasDynamicSections = false;
+		for (int32 SectionIndex = 0; SectionIndex < Sections.Num(); SectionIndex++)
+		{
+			const FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+			if (Section != nullptr && IsSectionDrawn(Section))
+			{
+				const bool bInstance = IsSectionInstance(Section) && InstanceSceneData.IsValidIndex(SectionIndex);
+				Keys[SectionIndex] = FDeformMeshSectionGroupKey(Section->RenderResources, Section->Materials[0], bInstance, (uint8)Section->ShadowMode);
+				bHasDynamicSections |= !bInstance;
+			}
+		}
+
+		TArray<uint32> InstanceIndices;
+		FDeformMeshSectionGroups::Build(Keys, InstanceGroups, InstanceIndices);
+		FDeformMeshSectionGroups::BuildInstanceRuns(InstanceGroups, InstanceIndices, InstanceGroupRuns, InstanceRuns);
+	}
+
+	/* Whether some drawn sections cast shadows, and how many of them are drawn by the cached draws, the shadow passes skip the primitive when none does */
+	void UpdateShadowCasters_RenderThread()
+	{
+		bHasShadowSections = false;
+		int32 NumCachedShadowSections = 0;
+		for (const FDeformMeshSectionProxy* Section : Sections)
+		{
+			if (Section != nullptr && IsSectionDrawn(Section) && Section->ShadowMode != EDeformMeshShadowMode::None)
+			{
+				bHasShadowSections = true;
+				NumCachedShadowSections += IsSectionCached(Section) ? 1 : 0;
+			}
+		}
+		ShadowDrawCounts->NumCachedShadowSections.store(NumCachedShadowSections);
+	}
+
+	/* Ask the renderer to call DrawStaticElements again, when the set of cached sections changed */
+	void UpdateCachedDraws_RenderThread()
+	{
+		if (bStaticDrawPath && GetPrimitiveSceneInfo() != nullptr)
+		{
+			GetScene().UpdateCachedRenderStates(this);
+		}
+	}
+
+	/*
+	 * Adds the batches of a cached section, or of a group of cached sections, for each LOD that can be drawn
+	 * Like static meshes, the renderer picks the LOD from the screen size of each batch, using the bounds of the whole primitive
+	 * With GroupRuns, the batches draw these runs of GPU scene instances with the static mesh vertex factory instead
+	 * A Simplified section casts the shadows of a coarser LOD: the batches of each LOD don't cast shadows, and get shadow only batches made of the coarser LOD, like the shadow batches of static meshes
+	*/
+	void DrawStaticSection(FStaticPrimitiveDrawInterface* PDI, const FDeformMeshSectionProxy* Section, int32 UserIndex, uint32 NumInstances, const FDeformMeshInstanceRuns* GroupRuns = nullptr) const
+	{
+		const FDeformMeshRenderResources* RenderResources = Section->RenderResources;
+		const int32 LastLOD = RenderResources->LODs.Num() - 1;
+		int32 FirstCachedLOD = FMath::Clamp(FMath::Max(MinLOD, RenderResources->FirstLOD), 0, LastLOD);
+		int32 LastCachedLOD = LastLOD;
+		if (ForcedLOD != INDEX_NONE)
+		{
+			FirstCachedLOD = LastCachedLOD = FMath::Clamp(ForcedLOD, RenderResources->FirstLOD, LastLOD);
+		}
+		//A section with a deform cache only has the vertices of one LOD
+		if (Section->Cache != nullptr)
+		{
+			FirstCachedLOD = LastCachedLOD = Section->Cache->GetLODIndex();
+		}
+		const bool bSingleLOD = ForcedLOD != INDEX_NONE || Section->Cache != nullptr;
+
+		for (int32 LODIndex = FirstCachedLOD; LODIndex <= LastCachedLOD; LODIndex++)
+		{
+			const float ScreenSize = bSingleLOD ? FLT_MAX : RenderResources->LODScreenSizes[LODIndex];
+			//The shadow only batches keep the LOD index of the batches they stand in for, so the renderer picks them together
+			const int32 ShadowLOD = Section->ShadowMode == EDeformMeshShadowMode::Simplified && Section->Cache == nullptr ? GetShadowLOD(Section, LODIndex) : LODIndex;
+			const bool bCastShadow = Section->ShadowMode != EDeformMeshShadowMode::None && ShadowLOD == LODIndex;
+			const int32 NumBatchLODs = ShadowLOD != LODIndex ? 2 : 1;
+			for (int32 BatchLOD = 0; BatchLOD < NumBatchLODs; BatchLOD++)
+			{
+				const bool bShadowOnly = BatchLOD > 0;
+				const FDeformMeshLODResources& LODResources = RenderResources->LODs[bShadowOnly ? ShadowLOD : LODIndex];
+				const FVertexFactory* VertexFactory = GroupRuns != nullptr ? LODResources.StaticVertexFactory : GetSectionVertexFactory(Section, LODResources);
+				for (const FDeformMeshLODSection& LODSection : LODResources.Sections)
+				{
+					FMeshBatch Mesh;
+					SetupMeshBatch(Mesh, LODResources, VertexFactory, LODSection, LODIndex, GetSectionMaterial(Section, LODSection)->GetRenderProxy(), UserIndex, NumInstances, false);
+					if (GroupRuns != nullptr)
+					{
+						//The vertex factory finds the transform of each section in the primitive's instance data
+						FMeshBatchElement& BatchElement = Mesh.Elements[0];
+						BatchElement.UserData = nullptr;
+						BatchElement.bIsInstanceRuns = true;
+						BatchElement.InstanceRuns = &InstanceRuns[GroupRuns->FirstRun * 2];
+						BatchElement.NumInstances = GroupRuns->NumRuns;
+					}
+					if (bShadowOnly)
+					{
+						Mesh.bUseForMaterial = false;
+						Mesh.bUseForDepthPass = false;
+						Mesh.bUseAsOccluder = false;
+					}
+					else
+					{
+						Mesh.CastShadow &= bCastShadow;
+					}
+					PDI->DrawMesh(Mesh, ScreenSize);
+				}
+			}
+		}
+	}
+
+	/* The LOD a Simplified section is drawn with in the shadow passes, when it's drawn with LODIndex in the other passes */
+	int32 GetShadowLOD(const FDeformMeshSectionProxy* Section, int32 LODIndex) const
+	{
+		return FMath::Min(LODIndex + ShadowLODBias, Section->RenderResources->LODs.Num() - 1);
+	}
+
+	/*
+	 * Whether a section is drawn in a shadow view, and the LOD it's drawn with there, LODIndex is the LOD of the other passes
+	 * The sections that don't cast shadows are skipped, and so are the Simplified sections that are too small on screen
+	*/
+	bool SelectShadowLOD(const FDeformMeshSectionProxy* Section, float ScreenSize, int32& LODIndex) const
+	{
+		switch (Section->ShadowMode)
+		{
+		case EDeformMeshShadowMode::None:
+			return false;
+		case EDeformMeshShadowMode::Simplified:
+			if (ScreenSize < ShadowMinScreenSize)
+			{
+				return false;
+			}
+			LODIndex = GetShadowLOD(Section, LODIndex);
+			return true;
+		default:
+			return true;
+		}
+	}
+
+	/* The vertex factory that draws a section, the cached sections read their deformed vertices from their cache */
+	static const FVertexFactory* GetSectionVertexFactory(const FDeformMeshSectionProxy* Section, const FDeformMeshLODResources& LODResources)
+	{
+		return Section->Cache != nullptr ? (const FVertexFactory*)&LODResources.CachedVertexFactory : (const FVertexFactory*)&LODResources.VertexFactory;
+	}
+
+	/* The material of a section used by a range of its static mesh */
+	static UMaterialInterface* GetSectionMaterial(const FDeformMeshSectionProxy* Section, const FDeformMeshLODSection& LODSection)
+	{
+		return Section->Materials.IsValidIndex(LODSection.MaterialIndex) ? Section->Materials[LODSection.MaterialIndex] : Section->Materials[0];
+	}
+
+	/* Recompute the world box of a section from its mesh box, its deform transform and the primitive's local to world transform*/
+	void UpdateSectionWorldBox(int32 SectionIndex)
+	{
+		FDeformMeshSectionProxy* Section = Sections[SectionIndex];
+		//The deform transforms are stored transposed for the shader
+		const FMatrix DeformMatrix = FMatrix(DeformTransforms[SectionIndex]).GetTransposed();
+		Section->WorldBox = Section->MeshBox.TransformBy(DeformMatrix * GetLocalToWorld());
+	}
+
+	/* Whether a world box intersects the frustum of a view, shadow depth views give us their own culling frustum*/
+	static bool IsBoxInView(const FSceneView* View, const FBox& WorldBox)
+	{
+		const FVector Origin = WorldBox.GetCenter();
+		const FVector Extent = WorldBox.GetExtent();
+		if (const FConvexVolume* ShadowCullFrustum = View->GetDynamicMeshElementsShadowCullFrustum())
+		{
+			return ShadowCullFrustum->IntersectBox(Origin + View->GetPreShadowTranslation(), Extent);
+		}
+		return View->ViewFrustum.IntersectBox(Origin, Extent);
+	}
+
+	/* Projected screen size of a section's world box in this view, scaled by the view's LOD distance factor like static meshes */
+	static float GetSectionScreenSize(const FSceneView* View, const FDeformMeshSectionProxy* Section)
+	{
+		const FVector4 Origin(Section->WorldBox.GetCenter(), 1.0f);
+		const float SphereRadius = Section->WorldBox.GetExtent().Size();
+		return ComputeBoundsScreenSize(Origin, SphereRadius, *View) * View->LODDistanceFactor;
+	}
+
+	/* The LOD to draw a section with, from its screen size and the LOD settings of the component */
+	int32 SelectSectionLOD(const FDeformMeshSectionProxy* Section, float ScreenSize) const
+	{
+		const FDeformMeshRenderResources* RenderResources = Section->RenderResources;
+		return FDeformMeshLODSelection::SelectLOD(RenderResources->LODScreenSizes, ScreenSize, FMath::Max(MinLOD, RenderResources->FirstLOD), ForcedLOD);
+	}
+
+	/*
+	 * Allocates a temporary primitive uniform buffer for this frame and fills it with the primitive data
+	 * The LocalVertexFactory uses it to get data like the local to world transform for this frame and for the previous one
+	*/
+	FDynamicPrimitiveUniformBuffer& CreatePrimitiveUniformBuffer(FMeshElementCollector& Collector) const
+	{
+		SCOPE_CYCLE_COUNTER(STAT_DeformMesh_PrimitiveUniformBuffer);
+
+		//Most of this data can be fetched using the helper function below
+		bool bHasPrecomputedVolumetricLightmap;
+		FMatrix PreviousLocalToWorld;
+		int32 SingleCaptureIndex;
+		bool bOutputVelocity;
+		GetScene().GetPrimitiveUniformShaderParameters_RenderThread(GetPrimitiveSceneInfo(), bHasPrecomputedVolumetricLightmap, PreviousLocalToWorld, SingleCaptureIndex, bOutputVelocity);
+
+		FDynamicPrimitiveUniformBuffer& DynamicPrimitiveUniformBuffer = Collector.AllocateOneFrameResource<FDynamicPrimitiveUniformBuffer>();
+		//The moving sections have velocity even when the primitive didn't move
+		bOutputVelocity |= AlwaysHasVelocity();
+		DynamicPrimitiveUniformBuffer.Set(GetLocalToWorld(), PreviousLocalToWorld, GetBounds(), GetLocalBounds(), true, bHasPrecomputedVolumetricLightmap, DrawsVelocity(), bOutputVelocity);
+		return DynamicPrimitiveUniformBuffer;
+	}
+
+	/*
+	 * Adds one mesh batch per material of the section's LOD, they all share the LOD's vertex factory and index buffer
+	 * WireframeMaterial replaces all the materials when it isn't null
+	 * PrimitiveUniformBuffer is created by the first batch of the frame if it's still null
+	*/
+	void AddSectionMeshBatches(int32 ViewIndex, const FDeformMeshSectionProxy* Section, int32 LODIndex, FMaterialRenderProxy* WireframeMaterial, int32 UserIndex, uint32 NumInstances, FDynamicPrimitiveUniformBuffer*& PrimitiveUniformBuffer, FMeshElementCollector& Collector) const
+	{
+		if (PrimitiveUniformBuffer == nullptr)
+		{
+			PrimitiveUniformBuffer = &CreatePrimitiveUniformBuffer(Collector);
+		}
+
+		//A section with a deform cache only has the vertices of one LOD
+		if (Section->Cache != nullptr)
+		{
+			LODIndex = Section->Cache->GetLODIndex();
+		}
+
+		const FDeformMeshLODResources& LODResources = Section->RenderResources->GetLOD(LODIndex);
+		const FVertexFactory* VertexFactory = GetSectionVertexFactory(Section, LODResources);
+		for (const FDeformMeshLODSection& LODSection : LODResources.Sections)
+		{
+			//Get the material of this range, or the wireframe material if we're rendering in wireframe mode
+			FMaterialRenderProxy* MaterialProxy = WireframeMaterial != nullptr ? WireframeMaterial : GetSectionMaterial(Section, LODSection)->GetRenderProxy();
+			AddMeshBatch(ViewIndex, LODResources, VertexFactory, LODSection, LODIndex, MaterialProxy, UserIndex, NumInstances, WireframeMaterial != nullptr, *PrimitiveUniformBuffer, Collector);
+		}
+	}
+
+	/*
+	 * Fills a mesh batch that draws one material range of NumInstances sections sharing the same LOD resources and material
+	 * UserIndex is the section index for a single section, or the offset of the group in the instance transform indices for an instanced batch
+	 * This is shared by the dynamic and the cached draws, the primitive data is set by the caller
+	*/
+	void SetupMeshBatch(FMeshBatch& Mesh, const FDeformMeshLODResources& LODResources, const FVertexFactory* VertexFactory, const FDeformMeshLODSection& LODSection, int32 LODIndex, FMaterialRenderProxy* MaterialProxy, int32 UserIndex, uint32 NumInstances, bool bWireframe) const
+	{
+		FMeshBatchElement& BatchElement = Mesh.Elements[0];
+		//Fill this batch element with the mesh section's render data
+		BatchElement.IndexBuffer = LODResources.IndexBuffer;
+		Mesh.bWireframe = bWireframe;
+		Mesh.VertexFactory = VertexFactory;
+		Mesh.LODIndex = (int8)LODIndex;
+
+		//The vertex factory is shared, so the batch element tells it where to find this section's deform transform
+		BatchElement.UserData = this;
+		BatchElement.UserIndex = UserIndex;
+		BatchElement.NumInstances = NumInstances;
+		Mesh.MaterialRenderProxy = MaterialProxy;
+
+		//Additional data 
+		BatchElement.FirstIndex = LODSection.FirstIndex;
+		BatchElement.NumPrimitives = LODSection.NumTriangles;
+		BatchElement.MinVertexIndex = LODSection.MinVertexIndex;
+		BatchElement.MaxVertexIndex = LODSection.MaxVertexIndex;
+		Mesh.CastShadow = LODSection.bCastShadow;
+		Mesh.ReverseCulling = IsLocalToWorldDeterminantNegative();
+		Mesh.Type = PT_TriangleList;
+		Mesh.DepthPriorityGroup = SDPG_World;
+		Mesh.bCanApplyViewModeOverrides = false;
+	}
+
+	/*
+	 * Allocates a mesh batch that draws one material range of NumInstances sections, and adds it to the collector
+	*/
+	void AddMeshBatch(int32 ViewIndex, const FDeformMeshLODResources& LODResources, const FVertexFactory* VertexFactory, const FDeformMeshLODSection& LODSection, int32 LODIndex, FMaterialRenderProxy* MaterialProxy, int32 UserIndex, uint32 NumInstances, bool bWireframe, const FDynamicPrimitiveUniformBuffer& PrimitiveUniformBuffer, FMeshElementCollector& Collector) const
+	{
+		// Allocate a mesh batch and fill it with the section's render data
+		FMeshBatch& Mesh = Collector.AllocateMesh();
+		SetupMeshBatch(Mesh, LODResources, VertexFactory, LODSection, LODIndex, MaterialProxy, UserIndex, NumInstances, bWireframe);
+
+		//The primitive uniform buffer is shared by all the batches of this frame
+		FMeshBatchElement& BatchElement = Mesh.Elements[0];
+		BatchElement.PrimitiveUniformBufferResource = &PrimitiveUniformBuffer.UniformBuffer;
+		BatchElement.PrimitiveIdMode = PrimID_DynamicPrimitiveShaderData;
+
+		//Add the batch to the collector
+		Collector.AddMesh(ViewIndex, Mesh);
+	}
+
 	/** Array of sections */
 	TArray<FDeformMeshSectionProxy*> Sections;
+	//The primitive transform the world boxes of the sections were last computed with, zero until the first OnTransformChanged
+	FMatrix SectionsLocalToWorld;
 
 	FMaterialRelevance MaterialRelevance;
 
 	//The render thread array of transforms of all the sections
 	//Individual updates of each section's deform transform will just update the entry in this array
 	//Before binding the SRV, we update the content of the structured buffer with this updated array
-	TArray<FMatrix> DeformTransforms;
+	TArray<FMatrix44f> DeformTransforms;
+
+	//The game thread writes the transforms to the mailbox, the render thread drains it once per game thread frame (see DrainTransformMailbox_RenderThread)
+	TSharedPtr<FDeformMeshTransformMailbox, ESPMode::ThreadSafe> TransformMailbox;
+
+	//The shadow draws of each frame, read by the component on the game thread (see UDeformMeshComponent::GetShadowDrawStats)
+	TSharedPtr<FDeformMeshShadowDrawCounts, ESPMode::ThreadSafe> ShadowDrawCounts;
+	//The mailbox frame each transform was written in, and the entries that arrived before the command adding their section
+	TArray<uint32> TransformSerials;
+	TMap<int32, FDeformMeshMailboxEntry> OrphanTransforms;
 
 	//The structured buffer that will contain all the deform transoform and going to be used as a shader resource
 	FBufferRHIRef DeformTransformsSB;
 
+	//Number of transforms that the structured buffers can hold, it can be bigger than the number of sections since the buffers grow geometrically
+	int32 TransformsCapacity;
+
+	//How the transforms are stored in the structured buffer, the CPU array always keeps the full matrices
+	EDeformMeshTransformFormat TransformFormat;
+
 	//The shader resource view of the structured buffer, this is what we bind to the vertex factory shader
 	FShaderResourceViewRHIRef DeformTransformsSRV;
 
-	//Whether the structured buffer needs to be updated or not
-	bool bDeformTransformsDirty;
+	//The transforms that changed since the last upload of the structured buffer, and how many they are
+	TBitArray<> DirtyTransforms;
+	int32 NumDirtyTransforms;
+
+	//The transforms that were used to draw the previous frame, and their structured buffer, for the motion vectors
+	TArray<FMatrix44f> PreviousDeformTransforms;
+	FBufferRHIRef PreviousDeformTransformsSB;
+	FShaderResourceViewRHIRef PreviousDeformTransformsSRV;
+
+	//The transforms that changed during this frame, they're copied to the previous transforms at the beginning of the next one
+	TBitArray<> MovedTransforms;
+	int32 NumMovedTransforms;
+
+	//Above this fraction of dirty transforms, the whole array is uploaded with one copy
+	static constexpr float FullUploadDirtyRatio = 0.25f;
+	//Dirty transforms separated by up to this many clean ones are uploaded with one copy
+	static constexpr int32 DirtyRangeMaxGap = 4;
+	//Above this many dirty ranges, the whole array is uploaded with one copy
+	static constexpr int32 MaxDirtyRanges = 32;
+
+	//Whether the sections sharing a mesh and a material are drawn with one instanced batch
+	bool bInstancedDrawing;
+
+	//Whether the sections without a lattice are instances of the primitive in the GPU scene (see UpdateInstanceRuns_RenderThread), the cached draws are only made of them then
+	bool bGPUSceneInstances;
+
+	//Whether the sections that aren't hot are drawn with cached draws (see DrawStaticElements)
+	bool bStaticDrawPath;
+
+	//Whether the sections with a lattice are deformed once per update by a compute pass (see FDeformMeshSectionCache)
+	bool bDeformCache;
+	//Registered to the beginning of the render thread frames, to update the previous transforms and the previous positions of the caches
+	FDelegateHandle BeginFrameHandle;
+
+	//When it's 0 and the cached draws are used, GetDynamicMeshElements isn't called at all
+	int32 NumHotSections;
+
+	//The LOD that all the sections are drawn with, or INDEX_NONE to pick it from the screen size of each section
+	int32 ForcedLOD;
+	//The finest LOD that the sections can be drawn with
+	int32 MinLOD;
+
+	//How the Simplified sections are drawn in the shadow passes: how many LODs coarser, and the screen size below which they aren't drawn there
+	int32 ShadowLODBias;
+	float ShadowMinScreenSize;
+
+	//The component is told on the game thread when its sections are ready to be drawn
+	TWeakObjectPtr<UDeformMeshComponent> OwnerComponent;
+
+	//Number of sections whose render resources aren't initialized yet, as last sent to the component
+	int32 NumPendingSections;
+
+	//Registered to the resource cache while some sections are pending
+	FDelegateHandle ResourcesInitializedHandle;
+	//Registered to the resource cache for the whole life of the proxy, the LOD streaming can change the LODs of any section
+	FDelegateHandle FirstLODChangedHandle;
+
+	//The groups of sections drawn by the instanced path, rebuilt when the visibility of a section changes
+	//The groups of the cached sections are drawn by DrawStaticElements
+	TArray<FDeformMeshSectionGroup> SectionGroups;
+	TArray<FDeformMeshSectionGroup> CachedSectionGroups;
+
+	//The groups of GPU scene instances drawn by DrawStaticElements, where their runs are, and the runs of all the groups, pointed to by the cached batches
+	//Whether some drawn sections aren't GPU scene instances, these are drawn by GetDynamicMeshElements every frame
+	TArray<FDeformMeshSectionGroup> InstanceGroups;
+	TArray<FDeformMeshInstanceRuns> InstanceGroupRuns;
+	TArray<uint32> InstanceRuns;
+	bool bHasDynamicSections = false;
+
+	//Whether some drawn sections cast shadows (see UpdateShadowCasters_RenderThread)
+	bool bHasShadowSections = true;
+
+	//For each instance of each group, the index of its section's deform transform, kept on the CPU to cull the groups
+	TArray<uint32> InstanceTransformIndices;
+	FBufferRHIRef InstanceTransformIndicesSB;
+	FShaderResourceViewRHIRef InstanceTransformIndicesSRV;
+
+	//The slot of each section's lattice in the lattices buffer, or INDEX_NONE, indexed like the transforms
+	TArray<int32> LatticeSlots;
+	FBufferRHIRef LatticeSlotsSB;
+	FShaderResourceViewRHIRef LatticeSlotsSRV;
+
+	//CPU copy of the lattices buffer, FDeformMeshLattice::GPUStride float4 per slot, and the slots that aren't used anymore
+	TArray<FVector4f> Lattices;
+	TArray<int32> FreeLatticeSlots;
+	FBufferRHIRef LatticesSB;
+	FShaderResourceViewRHIRef LatticesSRV;
+	//Number of lattices that the lattices buffer can hold
+	int32 LatticesCapacity;
+
+	//The deform track driving the first sections, null when no track plays, the time it was last evaluated at,
+	//and the arrays it's decoded to, kept between frames
+	TUniquePtr<FDeformMeshTrackReader> TrackReader;
+	double TrackTime = 0.0;
+	TArray<int32> TrackSectionIndices;
+	TArray<FMatrix44f> TrackTransforms;
+
+#if RHI_RAYTRACING
+	//The inputs and the outputs of FDeformMeshRayTracing::GatherInstances, kept between frames
+	TArray<FDeformMeshRayTracingSection> RayTracingSections;
+	TArray<FDeformMeshRayTracingInstanceDesc> RayTracingInstanceDescs;
+	//The cached sections deformed since their BLAS was last refit, can hold duplicates
+	TArray<int32> RayTracingRefitSections;
+#endif
 };
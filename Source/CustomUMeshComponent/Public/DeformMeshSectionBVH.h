@@ -0,0 +1,79 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Section BVH
+/*
+ * Bounding volume hierarchy over the local boxes of the sections, used to find the sections hit by a ray without testing all of them
+ * Unlike FDeformMeshBoundsTree, the sections are grouped by position when the tree is built, so a ray only visits the nodes along its path
+ * When the deform transforms change, the boxes are refit in place: the topology stays the one of the last build, only the node boxes are recomputed
+ * The tree gets looser as the sections move away from where they were at build time, rebuilding it is up to the owner
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshSectionBVH
+{
+public:
+	/* Maximum number of sections in a leaf */
+	static constexpr int32 MaxLeafSize = 4;
+
+	/* Above this fraction of refit sections, all the nodes are recomputed with one pass instead of walking up from each section */
+	static constexpr float FullRefitRatio = 0.125f;
+
+	/* Builds the tree from the boxes of all the sections, O(N log N). Invalid boxes (cleared sections) are kept in the tree so they can be refit later */
+	void Build(TArrayView<const FBox> ItemBoxes);
+
+	/* Empties the tree, the next query has to build it again */
+	void Reset();
+
+	/* Number of sections the tree was built for */
+	inline int32 Num() const { return ItemBoxes.Num(); }
+
+	/* Replaces the boxes of some sections, Items[i] gets Boxes[i], and refits the nodes above them */
+	void Refit(TArrayView<const int32> Items, TArrayView<const FBox> Boxes);
+
+	/* Recomputes every node from the boxes of the sections, O(N) */
+	void RefitAll();
+
+	/*
+	 * Visits the sections whose box is crossed by the segment, roughly front to back, and returns the closest one that HitItem accepts or INDEX_NONE
+	 * HitItem(Item, InOutTime) tests the section's own geometry, InOutTime is the time of the closest hit so far along the segment (1 at the end),
+	 * it returns true and lowers InOutTime when the section is hit before it. The nodes behind the closest hit aren't visited
+	 */
+	int32 Raycast(const FVector& Start, const FVector& End, TFunctionRef<bool(int32 Item, double& InOutTime)> HitItem) const;
+
+	/* Entry time of a segment in a box, with the normal of the face that it enters through. The time is 0 when the segment starts inside the box */
+	static bool IntersectSegmentBox(const FVector& Start, const FVector& Delta, const FBox& Box, double MaxTime, double& OutTime, FVector* OutNormal = nullptr);
+
+	inline SIZE_T GetAllocatedSize() const
+	{
+		return Nodes.GetAllocatedSize() + NodeParents.GetAllocatedSize() + ItemBoxes.GetAllocatedSize() + LeafItems.GetAllocatedSize() + ItemLeaves.GetAllocatedSize();
+	}
+
+private:
+	struct FNode
+	{
+		FBox Box;
+		/* Inner node: index of the first child, the second one follows it. Leaf: index of the first section in LeafItems */
+		int32 First;
+		/* 0 for inner nodes, number of sections for leaves */
+		int32 NumItems;
+	};
+
+	/* Splits LeafItems[Begin, End) at the median along the largest axis of their centers, recursively */
+	void BuildNode(int32 NodeIndex, int32 Begin, int32 End, TArray<FVector>& Centers);
+
+	/* Recomputes the box of a node from its children or its sections */
+	void RefitNode(int32 NodeIndex);
+
+	/* The children always come after their parent, node 0 is the root */
+	TArray<FNode> Nodes;
+	TArray<int32> NodeParents;
+
+	/* The box of each section, indexed by section */
+	TArray<FBox> ItemBoxes;
+	/* The sections of each leaf, stored contiguously */
+	TArray<int32> LeafItems;
+	/* The leaf of each section, to refit a section without searching for it */
+	TArray<int32> ItemLeaves;
+};
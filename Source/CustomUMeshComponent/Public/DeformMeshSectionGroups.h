@@ -0,0 +1,72 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Section Groups
+/*
+ * When instanced drawing is enabled, the sections that share the same mesh resources and the same material are drawn with one instanced mesh batch
+ * Each instance of the batch is one section, the vertex factory finds the section's deform transform using the instance ID:
+ * InstanceTransformIndices[Group.FirstInstance + InstanceID] is the index of the section in the transforms buffer
+*/
+///////////////////////////////////////////////////////////////////////
+
+/* What we need to know about a section to group it, the keys are only compared and never dereferenced */
+struct FDeformMeshSectionGroupKey
+{
+	const void* Mesh;
+	const void* Material;
+	bool bVisible;
+	/* How the sections cast shadows, the sections of a group share their batches so they must cast them the same way */
+	uint8 ShadowMode;
+
+	FDeformMeshSectionGroupKey()
+		: Mesh(nullptr)
+		, Material(nullptr)
+		, bVisible(false)
+		, ShadowMode(0)
+	{}
+
+	FDeformMeshSectionGroupKey(const void* InMesh, const void* InMaterial, bool bInVisible, uint8 InShadowMode = 0)
+		: Mesh(InMesh)
+		, Material(InMaterial)
+		, bVisible(bInVisible)
+		, ShadowMode(InShadowMode)
+	{}
+};
+
+/* A range of instances drawn by one instanced mesh batch */
+struct FDeformMeshSectionGroup
+{
+	/* Section index of the first section of the group, used to fetch the mesh resources and the material */
+	int32 FirstSection;
+	/* Offset of this group into the instance transform indices */
+	int32 FirstInstance;
+	/* Number of sections drawn by this group */
+	int32 NumInstances;
+};
+
+/* The instance runs of one group, see FDeformMeshSectionGroups::BuildInstanceRuns */
+struct FDeformMeshInstanceRuns
+{
+	/* Offset of the group's first run, in runs, a run is two uint32 */
+	int32 FirstRun;
+	int32 NumRuns;
+};
+
+struct DEFORMMESH_API FDeformMeshSectionGroups
+{
+	/*
+	 * Groups the visible sections by (Mesh, Material, ShadowMode), in the order in which each key first appears
+	 * Inside a group, the instances keep the order of their sections
+	 * Sections with a null mesh and hidden sections are skipped
+	*/
+	static void Build(TArrayView<const FDeformMeshSectionGroupKey> Sections, TArray<FDeformMeshSectionGroup>& OutGroups, TArray<uint32>& OutInstanceTransformIndices);
+
+	/*
+	 * Compresses the instances of each group into runs of consecutive section indices, for the sections drawn as GPU scene instances
+	 * The runs are [First, Last] pairs in OutRuns, like FMeshBatchElement::InstanceRuns, OutGroupRuns[i] tells where the runs of group i are
+	 * The instances of a group must be sorted, which Build guarantees
+	*/
+	static void BuildInstanceRuns(TArrayView<const FDeformMeshSectionGroup> Groups, TArrayView<const uint32> InstanceTransformIndices, TArray<FDeformMeshInstanceRuns>& OutGroupRuns, TArray<uint32>& OutRuns);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include <atomic>
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Stats
+/*
+ * Use "stat DeformMesh" to display them
+*/
+///////////////////////////////////////////////////////////////////////
+DECLARE_STATS_GROUP(TEXT("DeformMesh"), STATGROUP_DeformMesh, STATCAT_Advanced);
+
+/* Sections that were culled against a view frustum in GetDynamicMeshElements, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections Culled"), STAT_DeformMesh_SectionsCulled, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Sections that were added to the collector in GetDynamicMeshElements, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sections Submitted"), STAT_DeformMesh_SectionsSubmitted, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Bytes written to the deform transforms structured buffers, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Transform Bytes Uploaded"), STAT_DeformMesh_TransformBytesUploaded, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Sections deformed by the deform cache compute shader, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cache Dispatches"), STAT_DeformMesh_CacheDispatches, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Ray tracing instances added by GetDynamicRayTracingInstances, and BLAS refits of the deform caches, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ray Tracing Instances"), STAT_DeformMesh_RayTracingInstances, STATGROUP_DeformMesh, DEFORMMESH_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Ray Tracing Refits"), STAT_DeformMesh_RayTracingRefits, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Sections drawn in the shadow views by GetDynamicMeshElements, and sections skipped there by their shadow mode or the shadow frustum, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shadow Sections Submitted"), STAT_DeformMesh_ShadowSectionsSubmitted, STATGROUP_DeformMesh, DEFORMMESH_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Shadow Sections Skipped"), STAT_DeformMesh_ShadowSectionsSkipped, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* GPU scene instances rewritten after their section moved, per frame */
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("GPU Scene Instances Updated"), STAT_DeformMesh_GPUSceneInstancesUpdated, STATGROUP_DeformMesh, DEFORMMESH_API);
+
+/* Render thread time spent in GetDynamicMeshElements */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GetDynamicMeshElements"), STAT_DeformMesh_GetDynamicMeshElements, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Render thread time spent in GetDynamicRayTracingInstances */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("GetDynamicRayTracingInstances"), STAT_DeformMesh_GetDynamicRayTracingInstances, STATGROUP_DeformMesh, DEFORMMESH_API);
+/* Render thread time spent building the primitive uniform buffers, once per GetDynamicMeshElements call that draws something */
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Primitive Uniform Buffer"), STAT_DeformMesh_PrimitiveUniformBuffer, STATGROUP_DeformMesh, DEFORMMESH_API);
+
+/* The shadow draws of one component during one frame */
+struct FDeformMeshShadowDrawStats
+{
+	/* Shadow views that gathered the dynamic sections of the component */
+	int32 NumShadowViews = 0;
+	/* Sections drawn in these views by GetDynamicMeshElements, and sections skipped there */
+	int32 NumSectionsDrawn = 0;
+	int32 NumSectionsSkipped = 0;
+	/* Sections of the cached draws that cast shadows, the renderer draws them in every shadow view that sees the component */
+	int32 NumCachedShadowSections = 0;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Shadow Draw Counts
+/*
+ * The per component counterpart of the shadow stats above, shared by a component and its scene proxy
+ * The proxy counts on the render thread, where several shadow views can be gathered in parallel, and publishes the counts of a frame at the beginning of the next one
+ * The game thread reads the last published frame
+*/
+///////////////////////////////////////////////////////////////////////
+struct FDeformMeshShadowDrawCounts
+{
+	//Render thread, the frame being counted
+	std::atomic<int32> NumShadowViews{ 0 };
+	std::atomic<int32> NumSectionsDrawn{ 0 };
+	std::atomic<int32> NumSectionsSkipped{ 0 };
+	std::atomic<int32> NumCachedShadowSections{ 0 };
+
+	/* Render thread: ends the frame being counted */
+	void Publish()
+	{
+		LastNumShadowViews.store(NumShadowViews.exchange(0));
+		LastNumSectionsDrawn.store(NumSectionsDrawn.exchange(0));
+		LastNumSectionsSkipped.store(NumSectionsSkipped.exchange(0));
+		LastNumCachedShadowSections.store(NumCachedShadowSections.load());
+	}
+
+	/* Any thread: the counts of the last published frame */
+	FDeformMeshShadowDrawStats GetLastFrame() const
+	{
+		FDeformMeshShadowDrawStats Stats;
+		Stats.NumShadowViews = LastNumShadowViews.load();
+		Stats.NumSectionsDrawn = LastNumSectionsDrawn.load();
+		Stats.NumSectionsSkipped = LastNumSectionsSkipped.load();
+		Stats.NumCachedShadowSections = LastNumCachedShadowSections.load();
+		return Stats;
+	}
+
+private:
+	std::atomic<int32> LastNumShadowViews{ 0 };
+	std::atomic<int32> LastNumSectionsDrawn{ 0 };
+	std::atomic<int32> LastNumSectionsSkipped{ 0 };
+	std::atomic<int32> LastNumCachedShadowSections{ 0 };
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "DeformMeshSubsystem.generated.h"
+
+class UDeformMeshComponent;
+class UStaticMesh;
+class UMaterialInterface;
+struct FDeformMeshSection;
+
+/** Where a section of a batched component is drawn: one section of one of the subsystem's batch components */
+struct FDeformMeshBatchSlot
+{
+	int32 BatchIndex = INDEX_NONE;
+	int32 SectionIndex = INDEX_NONE;
+	/* The generation of the batch section when the slot was given, a slot kept after its section was removed doesn't match the section that reuses the index */
+	uint32 Generation = 0;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Subsystem
+/*
+ * Pools the sections of the batched deform mesh components of a world (see UDeformMeshComponent::bUseBatching)
+ * Each batch is a deform mesh component owned by the subsystem, holding the sections of many components that use the same static mesh and the same material
+ * A batch has one scene proxy, one transforms buffer and draws with instanced drawing, the geometry is already shared by FDeformMeshResourceCache,
+ * so thousands of components cost a handful of primitives in the scene instead of one each
+ * The batches are in world space: the transform of a batched section is its deform transform followed by the transform of its component
+ * The transform updates are queued and sent to the batches once per frame, so many components moving in the same frame make one update per batch
+ * The batches draw with their own settings, set by CreateBatch, not with those of the batched components:
+ * instanced drawing on the dynamic path, so each section is culled and LOD'ed on its own, Full transforms, no GPU scene instances, no deform cache and no collision
+*/
+///////////////////////////////////////////////////////////////////////
+UCLASS()
+class DEFORMMESH_API UDeformMeshSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+
+	/** A batch holds at most this many sections, another batch is opened for the same static mesh and material once the others are full */
+	static constexpr int32 MaxSectionsPerBatch = 4096;
+
+	/** Add a section to a batch using its static mesh and Material, Section is in world space. Returns an invalid slot if the subsystem is shutting down */
+	FDeformMeshBatchSlot AddSection(const FDeformMeshSection& Section, UMaterialInterface* Material);
+
+	/** Remove a section from its batch and reset the slot */
+	void RemoveSection(FDeformMeshBatchSlot& Slot);
+
+	/** Queue a new world transform for a batched section, the queued transforms are sent to the batches at the end of the frame's tick */
+	void UpdateSectionTransform(const FDeformMeshBatchSlot& Slot, const FMatrix& WorldTransform);
+
+	/** Send the lattice of a batched section to its batch */
+	void SetSectionLattice(const FDeformMeshBatchSlot& Slot, TArrayView<const FVector3f> ControlPointOffsets);
+
+	/** Show or hide a batched section */
+	void SetSectionVisible(const FDeformMeshBatchSlot& Slot, bool bNewVisibility);
+
+	/** Send the queued transforms to the batches now */
+	void FlushSectionTransforms();
+
+	/** Number of batch components, and number of sections in all of them */
+	int32 GetNumBatches() const;
+	int32 GetNumBatchedSections() const;
+
+	//~ Begin USubsystem Interface.
+	virtual void Deinitialize() override;
+	//~ End USubsystem Interface.
+
+	//~ Begin FTickableGameObject Interface.
+	/* Flushes the transforms queued during the frame, the subsystem ticks after the actors and components */
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+	virtual bool IsTickableInEditor() const override { return true; }
+	virtual bool IsTickableWhenPaused() const override { return true; }
+	//~ End FTickableGameObject Interface.
+
+private:
+
+	/** Create and register a new batch component with the batch draw settings, returns its index */
+	int32 CreateBatch();
+
+	/** Whether the slot still points to the section it was given for */
+	bool IsValidSlot(const FDeformMeshBatchSlot& Slot) const;
+
+	struct FBatchKey
+	{
+		const UStaticMesh* StaticMesh;
+		const UMaterialInterface* Material;
+
+		bool operator==(const FBatchKey& Other) const
+		{
+			return StaticMesh == Other.StaticMesh && Material == Other.Material;
+		}
+
+		friend uint32 GetTypeHash(const FBatchKey& Key)
+		{
+			return HashCombine(::GetTypeHash(Key.StaticMesh), ::GetTypeHash(Key.Material));
+		}
+	};
+
+	struct FBatch
+	{
+		/* Number of sections in use, the batch component can have more sections that were cleared */
+		int32 NumSections = 0;
+		/* The cleared sections of the batch component, reused before adding new ones */
+		TArray<int32> FreeSections;
+		/* The generation of each section index, bumped when its section is removed, kept when the batch is emptied since the indices start over */
+		TArray<uint32> SectionGenerations;
+		/* The transforms queued since the last flush, a section can appear more than once and its last transform wins */
+		TArray<int32> PendingSections;
+		TArray<FMatrix> PendingTransforms;
+	};
+
+	/** The batch components, the subsystem keeps them alive */
+	UPROPERTY(Transient)
+		TArray<UDeformMeshComponent*> Batches;
+
+	/** Same indices as Batches */
+	TArray<FBatch> BatchStates;
+
+	/** The batches of each static mesh and material, in the order they were created */
+	TMap<FBatchKey, TArray<int32, TInlineAllocator<1>>> BatchesByKey;
+
+	/** The batches with queued transforms */
+	TArray<int32> DirtyBatches;
+
+	int32 NumBatchedSections = 0;
+};
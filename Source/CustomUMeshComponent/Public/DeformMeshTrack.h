@@ -0,0 +1,144 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "DeformMeshTransformFormat.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/* Where the sections of a track are during one chunk, used for the component bounds while the track plays */
+struct FDeformMeshTrackChunkBounds
+{
+	/* Box of the translations of all the sections over the frames of the chunk */
+	FVector3f TranslationMin;
+	FVector3f TranslationMax;
+	/* Largest absolute scale of any section on any axis over the frames of the chunk */
+	float MaxScale;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Track
+/*
+ * The deform transforms of a range of sections, sampled at a fixed frame rate and stored in a compact binary file:
+ * 1 The header (FDeformMeshTrack::FHeader)
+ * 2 The bounds of each chunk (FDeformMeshTrackChunkBounds)
+ * 3 The frames, NumSections keys each, grouped in chunks of FramesPerChunk frames. A key is a translation, rotation and scale in the Quantized layout of FDeformMeshTransformCodec (24 bytes)
+ * The chunks have a fixed size, so the offset of any frame is computed without a table and a player only needs the chunks around its current time
+ * The file is memory mapped when the platform can do it, and read whole otherwise. Everything is little endian
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshTrack
+{
+public:
+	static constexpr uint32 Magic = 0x4B544D44; //"DMTK"
+	static constexpr uint32 Version = 1;
+
+	struct FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 NumSections;
+		uint32 NumFrames;
+		float FrameRate;
+		uint32 FramesPerChunk;
+		uint32 NumChunks;
+		uint32 Reserved;
+	};
+
+	/* Encodes a track, Frames[Frame * NumSections + Section] is the deform transform of Section at Frame / FrameRate seconds */
+	static void Encode(int32 NumSections, float FrameRate, int32 FramesPerChunk, TArrayView<const FTransform3f> Frames, TArray<uint8>& OutData);
+
+	/* Opens a track file, returns null if it can't be read or isn't a valid track */
+	static TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> OpenFile(const FString& Filename);
+
+	/* Wraps a track that is already in memory, for tracks encoded at runtime */
+	static TSharedPtr<FDeformMeshTrack, ESPMode::ThreadSafe> CreateFromMemory(TArray<uint8>&& Data);
+
+	~FDeformMeshTrack();
+
+	inline int32 GetNumSections() const { return Header.NumSections; }
+	inline int32 GetNumFrames() const { return Header.NumFrames; }
+	inline int32 GetNumChunks() const { return Header.NumChunks; }
+	inline float GetFrameRate() const { return Header.FrameRate; }
+
+	/* Time of the last frame, the track is clamped or looped after it */
+	inline double GetDuration() const { return (Header.NumFrames - 1) / (double)Header.FrameRate; }
+
+	/* The chunk holding the frame right before Time */
+	int32 GetChunkIndex(double Time) const;
+
+	inline const FDeformMeshTrackChunkBounds& GetChunkBounds(int32 ChunkIndex) const { return ChunkBounds[ChunkIndex]; }
+
+	/* Whether the frames are read from a mapped file rather than from memory */
+	inline bool IsMemoryMapped() const { return MappedFile.IsValid(); }
+
+private:
+	FDeformMeshTrack() = default;
+
+	/* Checks the header against the size of the data, and computes where the frames start */
+	bool InitHeader(const FHeader& InHeader, int64 DataSize);
+
+	/* Offset of a chunk from the start of the file, and its size, the last chunk can be shorter */
+	int64 GetChunkOffset(int32 ChunkIndex) const;
+	int64 GetChunkSize(int32 ChunkIndex) const;
+
+	/* Size of one frame of keys */
+	inline int64 GetFrameSize() const { return (int64)Header.NumSections * FDeformMeshTransformCodec::QuantizedStride; }
+
+	FHeader Header;
+	TArray<FDeformMeshTrackChunkBounds> ChunkBounds;
+	/* Offset of the first chunk, after the header and the bounds, aligned to 16 bytes */
+	int64 FramesOffset = 0;
+
+	/* Either the mapped file, or the whole track in memory */
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TArray<uint8> Data;
+	/* The readers of different threads map and unmap regions of the same file */
+	FCriticalSection MappingLock;
+
+	friend class FDeformMeshTrackReader;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Track Reader
+/*
+ * Evaluates a track at any time, interpolating between the two frames around it
+ * It keeps two chunks mapped, the one of the current time and the next one, which is mapped ahead with a preload hint so the OS reads it before it's needed
+ * The chunks behind are unmapped, so playing a long track never keeps more than two chunks in memory
+ * A reader isn't thread safe, each thread evaluating a track has its own reader, the scene proxy has the one of the render thread
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshTrackReader
+{
+public:
+	/* Number of sections decoded by each parallel task, below this count everything runs on the calling thread */
+	static constexpr int32 SectionsPerTask = 256;
+
+	explicit FDeformMeshTrackReader(TSharedRef<FDeformMeshTrack, ESPMode::ThreadSafe> InTrack);
+	~FDeformMeshTrackReader();
+
+	/* Writes the deform transforms of the first OutTransforms.Num() sections at Time, transposed like the transforms of the scene proxy. Time is clamped to the track */
+	void Evaluate(double Time, TArrayView<FMatrix44f> OutTransforms);
+
+	inline const FDeformMeshTrack& GetTrack() const { return *Track; }
+
+private:
+	struct FMappedChunk
+	{
+		int32 ChunkIndex = INDEX_NONE;
+		const uint8* Data = nullptr;
+		TUniquePtr<IMappedFileRegion> Region;
+	};
+
+	/* The keys of a frame, mapping its chunk if needed */
+	const uint8* GetFrame(int32 Frame);
+
+	/* Maps a chunk in the slot of its parity, unmapping the chunk that was there */
+	FMappedChunk& MapChunk(int32 ChunkIndex, bool bPreload);
+
+	TSharedRef<FDeformMeshTrack, ESPMode::ThreadSafe> Track;
+
+	/* Consecutive chunks have different parities, so the chunk of the current time and the next one are always both mapped */
+	FMappedChunk Chunks[2];
+};
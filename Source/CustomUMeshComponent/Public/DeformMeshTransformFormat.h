@@ -0,0 +1,45 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DeformMeshTransformFormat.generated.h"
+
+/** How the deform transforms are stored in the GPU buffer read by the vertex factory */
+UENUM()
+enum class EDeformMeshTransformFormat : uint8
+{
+	/** The full 4x4 float matrix, 64 bytes per section, exact */
+	Full,
+	/** The 3 rows of the matrix that hold the affine transform, 48 bytes per section, exact for affine transforms */
+	Affine3x4,
+	/** Float translation, quantized rotation and half precision scale, 24 bytes per section, shear can't be represented */
+	Quantized,
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Transform Codec
+/*
+ * Encodes the deform transforms (the transposed FMatrix44f layout built by FDeformMeshTransformUtils) into the format stored on the GPU, and decodes them back
+ * The decode mirrors LoadDeformTransform in DeformMeshCommon.ush, so what the CPU decodes is what the shader sees
+ * Error bounds, for a transform built from an FTransform:
+ * 1 Full, Affine3x4: exact
+ * 2 Quantized: the translation is exact, the rotation is stored as the 3 smallest quaternion components on 15 bits each,
+ *   so each of these components is off by at most 2.2e-5 and the rotation by less than 1.6e-4 radians, the largest component is rebuilt from the others,
+ *   the scale is stored as halves, its relative error is at most 2^-11 (about 0.05%) and its magnitude must stay within the half range
+*/
+///////////////////////////////////////////////////////////////////////
+struct DEFORMMESH_API FDeformMeshTransformCodec
+{
+	/* Size in bytes of one encoded transform, a multiple of 4 since the shader reads the buffer as a ByteAddressBuffer */
+	static uint32 GetStride(EDeformMeshTransformFormat Format);
+
+	/* Writes GetStride(Format) bytes to Dest */
+	static void Encode(EDeformMeshTransformFormat Format, const FMatrix44f& Transform, uint8* Dest);
+
+	/* Reads GetStride(Format) bytes from Src */
+	static FMatrix44f Decode(EDeformMeshTransformFormat Format, const uint8* Src);
+
+	/* The Quantized packing of a translation, rotation and scale, without going through a matrix. The deform tracks store their keys this way (see FDeformMeshTrack) */
+	static constexpr uint32 QuantizedStride = 6 * sizeof(uint32);
+	static void EncodeQuantized(const FTransform3f& Transform, uint8* Dest);
+	static FTransform3f DecodeQuantized(const uint8* Src);
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/* One transform written by the game thread, Serial is the frame of the mailbox it was written in */
+struct FDeformMeshMailboxEntry
+{
+	int32 SectionIndex;
+	uint32 Serial;
+	FMatrix44f Transform;
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Transform Mailbox
+/*
+ * Carries the deform transforms from the game thread to the render thread without a render command per update
+ * It's a triple buffer of sparse frames: the game thread writes into the back slot and publishes it, the render thread takes the latest published slot
+ * A frame that is published over another one the render thread hasn't taken is merged into the next back slot, so no transform is lost when the render thread falls behind, it only sees fewer and bigger frames
+ * Each slot keeps its allocation, so once the slots have grown writing and publishing don't allocate
+ * One producer and one consumer: all the game thread methods must be called from one thread at a time, and the render thread methods from another
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshTransformMailbox
+{
+public:
+	FDeformMeshTransformMailbox();
+
+	/*
+	 * Game thread: writes the transform of a section into the back slot, a later write to the same section in the same frame replaces it
+	*/
+	void Write(int32 SectionIndex, const FMatrix44f& Transform);
+
+	/*
+	 * Game thread: publishes the back slot if anything was written since the last publish, and starts the next frame
+	 * Returns true if a frame was published
+	 * Publishing over a frame the render thread skipped can leave entries that only the skipped frame had in the back slot (see HasUnpublishedWrites),
+	 * publishing again right away sends them, the back slot is then a superset of the frame that's left behind
+	*/
+	bool Publish();
+
+	/* Game thread: whether the back slot holds entries that still have to be published */
+	inline bool HasUnpublishedWrites() const { return bBackDirty; }
+
+	/* Game thread: the serial of the frame being written, the frames published before it have smaller serials */
+	inline uint32 GetWriteSerial() const { return WriteSerial; }
+
+	/*
+	 * Game thread: returns true if the caller must make the render thread call Acquire, false if a call is already on its way
+	 * This keeps at most one pending drain per mailbox, however fast the game thread publishes
+	*/
+	bool RequestDrain();
+
+	/*
+	 * Render thread: takes the latest published frame, or returns an empty view if nothing was published since the last call
+	 * The view stays valid until the next call
+	*/
+	TArrayView<const FDeformMeshMailboxEntry> Acquire();
+
+private:
+	struct FSlot
+	{
+		TArray<FDeformMeshMailboxEntry> Entries;
+	};
+
+	/* Merges entries into the back slot, keeping the most recent transform of each section */
+	void MergeIntoBack(TArrayView<const FDeformMeshMailboxEntry> NewEntries);
+
+	static constexpr uint32 SlotMask = 3;
+	/* Set on the middle slot when it holds a frame the render thread hasn't taken */
+	static constexpr uint32 FreshFlag = 4;
+
+	FSlot Slots[3];
+
+	/* The slot exchanged between the threads, with FreshFlag */
+	std::atomic<uint32> Middle;
+	/* Set by RequestDrain, cleared by Acquire */
+	std::atomic<bool> bDrainRequested;
+
+	//Game thread only
+	uint32 Back;
+	uint32 WriteSerial;
+	bool bBackDirty;
+	/* Index of each section's entry in the back slot, INDEX_NONE if it has none */
+	TArray<int32> BackEntryIndices;
+
+	//Render thread only
+	uint32 Front;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Transform Utils
+/*
+ * Conversion of the deform FTransforms to what the rest of the component needs:
+ * 1 The transposed float matrix that is uploaded to the transforms structured buffer and read by the vertex factory
+ * 2 The section's local box, transformed by the deform transform
+ * The bulk conversion runs the SIMD kernel over chunks of transforms in parallel, the scalar one is the reference it must match
+*/
+///////////////////////////////////////////////////////////////////////
+struct DEFORMMESH_API FDeformMeshTransformUtils
+{
+	/* Number of transforms converted by each parallel task, below this count everything runs on the calling thread */
+	static constexpr int32 ChunkSize = 256;
+
+	/*
+	 * Converts Transforms[i] to OutMatrices[i] and LocalBoxes[i] transformed by it to OutBoxes[i]
+	 * The outputs must already be sized, they're written in place so the caller can hand them to the render thread without copying
+	 */
+	static void ConvertTransforms(TArrayView<const FTransform> Transforms, TArrayView<const FBox> LocalBoxes, TArrayView<FMatrix44f> OutMatrices, TArrayView<FBox> OutBoxes);
+
+	/* Same as ConvertTransforms, one transform at a time using the FTransform and FBox math */
+	static void ConvertTransformsScalar(TArrayView<const FTransform> Transforms, TArrayView<const FBox> LocalBoxes, TArrayView<FMatrix44f> OutMatrices, TArrayView<FBox> OutBoxes);
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "LocalVertexFactory.h"
+#include "MeshMaterialShader.h"
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Vertex Factory
+/*
+ * A local vertex factory that also deforms the vertices with the deform transform of its mesh section
+ * All the sections of a component share one structured buffer of deform transforms, owned by the scene proxy
+ * The vertex factory doesn't hold any per section state, so it can be shared by every section built from the same static mesh (see FDeformMeshResourceCache)
+ * Each batch element tells which proxy and which transform to use, the shader does the rest (see CustomLocalVertexFactory.ush)
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshVertexFactory : public FLocalVertexFactory
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FDeformMeshVertexFactory);
+public:
+
+	FDeformMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FLocalVertexFactory(InFeatureLevel, "FDeformMeshVertexFactory")
+	{
+		//We're fetching the vertex streams through the vertex declaration, the deform transforms are the only thing we fetch manually
+		bSupportsManualVertexFetch = false;
+	}
+
+	FDeformMeshVertexFactory(ERHIFeatureLevel::Type InFeatureLevel, const char* InDebugName)
+		: FLocalVertexFactory(InFeatureLevel, InDebugName)
+	{
+		bSupportsManualVertexFetch = false;
+	}
+
+	/* Only compile this vertex factory for surface materials that can be used on the platform */
+	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters);
+
+	/* Adds the DEFORM_MESH define on top of the local vertex factory ones, this enables the deform code paths of the shader */
+	static void ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Cached Vertex Factory
+/*
+ * Draws the sections whose vertices were already deformed by the deform cache compute pass (see FDeformMeshSectionCache)
+ * It's bound to the same static mesh vertex buffers as FDeformMeshVertexFactory for the UVs and colors, but reads the positions and tangents from the section's cache
+ * The cache is per section, so the batches drawn with this vertex factory are never instanced
+*/
+///////////////////////////////////////////////////////////////////////
+class DEFORMMESH_API FDeformMeshCachedVertexFactory : public FDeformMeshVertexFactory
+{
+	DECLARE_VERTEX_FACTORY_TYPE(FDeformMeshCachedVertexFactory);
+public:
+
+	FDeformMeshCachedVertexFactory(ERHIFeatureLevel::Type InFeatureLevel)
+		: FDeformMeshVertexFactory(InFeatureLevel, "FDeformMeshCachedVertexFactory")
+	{}
+
+	/* The cache is written by a compute shader, so this is only compiled for the platforms that have them */
+	static bool ShouldCompilePermutation(const FVertexFactoryShaderPermutationParameters& Parameters);
+
+	/* Adds the DEFORM_MESH_CACHE define on top of the deform mesh ones */
+	static void ModifyCompilationEnvironment(const FVertexFactoryShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment);
+};
+
+///////////////////////////////////////////////////////////////////////
+// The Deform Mesh Vertex Factory Shader Parameters
+/*
+ * Binds the local vertex factory parameters, plus the transforms SRVs of this frame and of the previous one, and the transform index of the section being drawn
+ * The batch element carries the section's data: UserData points to the FDeformMeshSceneProxy that owns the transforms buffer, and UserIndex is the transform index
+ * For instanced batches (NumInstances > 1) UserIndex is the offset of the batch into the proxy's instance transform indices instead
+ * The bindings are captured when the renderer caches the draws of the static path, the SRVs only change when the scene proxy is recreated
+ * With FDeformMeshCachedVertexFactory, UserIndex is always a section index, and the section's cache SRVs are bound too
+*/
+///////////////////////////////////////////////////////////////////////
+class FDeformMeshVertexFactoryShaderParameters : public FLocalVertexFactoryShaderParametersBase
+{
+	DECLARE_TYPE_LAYOUT(FDeformMeshVertexFactoryShaderParameters, NonVirtual);
+public:
+
+	void Bind(const FShaderParameterMap& ParameterMap);
+
+	void GetElementShaderBindings(
+		const class FSceneInterface* Scene,
+		const class FSceneView* View,
+		const class FMeshMaterialShader* Shader,
+		const EVertexInputStreamType InputStreamType,
+		ERHIFeatureLevel::Type FeatureLevel,
+		const class FVertexFactory* VertexFactory,
+		const struct FMeshBatchElement& BatchElement,
+		class FMeshDrawSingleShaderBindings& ShaderBindings,
+		FVertexInputStreamArray& VertexStreams) const;
+
+	/* Number of the deform parameters (the DM* ones, not the local vertex factory ones) that Bind found in the parameter map */
+	uint32 GetNumBoundDeformParameters() const;
+
+private:
+	LAYOUT_FIELD(FShaderParameter, TransformIndex);
+	LAYOUT_FIELD(FShaderResourceParameter, TransformsSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, PreviousTransformsSRV);
+	LAYOUT_FIELD(FShaderParameter, TransformFormat);
+	LAYOUT_FIELD(FShaderParameter, Instanced);
+	LAYOUT_FIELD(FShaderResourceParameter, InstanceTransformIndicesSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, LatticeSlotsSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, LatticesSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, CachePositionsSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, CachePreviousPositionsSRV);
+	LAYOUT_FIELD(FShaderResourceParameter, CacheTangentsSRV);
+};